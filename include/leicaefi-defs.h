@@ -151,6 +151,11 @@
 #define LEICAEFI_POWERSRCBIT_CHGACT (1 << 14)
 #define LEICAEFI_POWERSRCBIT_UVLO (1 << 15)
 
+// General command bits
+#define LEICAEFI_CMD_READ_FLAG (0x8000)
+#define LEICAEFI_CMD_SUBSYSTEM_SHIFT (8)
+#define LEICAEFI_CMD_SUBSYSTEM_MASK (0x7F)
+
 // Subsystems
 #define LEICAEFI_CMD_LED_TEST_MODE_WRITE (0x0300)
 #define LEICAEFI_CMD_BATTERY1_READMSG_MASK (0x8A00)
@@ -56,6 +56,18 @@ struct leicaefi_ioctl_regrw {
 	__u16 reg_value;
 };
 
+/* Maximum number of registers read by LEICAEFI_IOCTL_READ_MULTI */
+#define LEICAEFI_IOCTL_READ_MULTI_MAX (16)
+
+struct leicaefi_ioctl_regrw_multi {
+	/* in: number of registers to read */
+	__u8 count;
+	/* in: registers to read */
+	__u8 reg_no[LEICAEFI_IOCTL_READ_MULTI_MAX];
+	/* out: values read */
+	__u16 reg_value[LEICAEFI_IOCTL_READ_MULTI_MAX];
+};
+
 struct leicaefi_ioctl_flash_checksum {
 	/* in: flash partition to check (separate partitions are defined for each mode) */
 	__u8 mode;
@@ -104,6 +116,34 @@ struct leicaefi_ioctl_onewire_device {
 	__u8 family_code;
 };
 
+/*
+ * Battery power sample, records of the debugfs 'samples' file of the
+ * battery (oldest first).
+ */
+struct leicaefi_battery_sample {
+	/* CLOCK_MONOTONIC time in ns */
+	__s64 timestamp_ns;
+	/* battery voltage in mV */
+	__s32 voltage_mv;
+	/* battery current in mA, positive when charging */
+	__s32 current_ma;
+	/* power drawn from the battery in uW, negative when charging */
+	__s64 power_uw;
+	/* energy drawn since the sampling started in uWh */
+	__s64 energy_uwh;
+};
+
+/*
+ * Read from the device file (blocks until available, poll is supported):
+ * interrupt flags raised since the previous read from the same file.
+ */
+struct leicaefi_event {
+	/* IFG register bits (LEICAEFI_IRQBIT_*) */
+	__u16 irq_bits;
+	/* ERR register bits (LEICAEFI_ERRBIT_*) */
+	__u16 err_bits;
+};
+
 /* write means user -> write-to -> kernel */
 #define LEICAEFI_IOCTL_MAGIC 0xDF
 
@@ -162,4 +202,8 @@ struct leicaefi_ioctl_onewire_device {
 	_IOC(_IOC_READ | _IOC_WRITE, LEICAEFI_IOCTL_MAGIC, 16,                 \
 	     sizeof(struct leicaefi_ioctl_onewire_device))
 
+#define LEICAEFI_IOCTL_READ_MULTI                                              \
+	_IOC(_IOC_READ | _IOC_WRITE, LEICAEFI_IOCTL_MAGIC, 17,                 \
+	     sizeof(struct leicaefi_ioctl_regrw_multi))
+
 #endif /*_LINUX_LEICAEFI_H*/
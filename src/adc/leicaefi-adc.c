@@ -0,0 +1,246 @@
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/bitops.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include <leicaefi.h>
+#include <common/leicaefi-chip.h>
+#include <common/leicaefi-device.h>
+#include <common/leicaefi-adc.h>
+
+enum leicaefi_adc_channel {
+	LEICAEFI_ADC_CHANNEL_VEXT1,
+	LEICAEFI_ADC_CHANNEL_VEXT2,
+	LEICAEFI_ADC_CHANNEL_VPOE1,
+	LEICAEFI_ADC_CHANNEL_VBAT1,
+	LEICAEFI_ADC_CHANNEL_VLINE,
+	LEICAEFI_ADC_CHANNEL_COUNT,
+};
+
+static const u8 leicaefi_adc_regs[LEICAEFI_ADC_CHANNEL_COUNT] = {
+	[LEICAEFI_ADC_CHANNEL_VEXT1] = LEICAEFI_REG_PWR_VEXT1,
+	[LEICAEFI_ADC_CHANNEL_VEXT2] = LEICAEFI_REG_PWR_VEXT2,
+	[LEICAEFI_ADC_CHANNEL_VPOE1] = LEICAEFI_REG_PWR_VPOE1,
+	[LEICAEFI_ADC_CHANNEL_VBAT1] = LEICAEFI_REG_PWR_VBAT1,
+	[LEICAEFI_ADC_CHANNEL_VLINE] = LEICAEFI_REG_PWR_VLINE,
+};
+
+struct leicaefi_adc_device {
+	struct platform_device *pdev;
+	struct leicaefi_chip *efichip;
+
+	/* buffer for the triggered capture: channels and aligned timestamp */
+	struct {
+		u16 channels[LEICAEFI_ADC_CHANNEL_COUNT];
+		s64 timestamp __aligned(8);
+	} scan;
+};
+
+#define LEICAEFI_ADC_VOLTAGE_CHANNEL(index, name)                              \
+	{                                                                      \
+		.type = IIO_VOLTAGE, .indexed = 1, .channel = (index),         \
+		.extend_name = (name), .address = (index),                     \
+		.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),                  \
+		.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),          \
+		.scan_index = (index),                                         \
+		.scan_type = {                                                 \
+			.sign = 'u',                                           \
+			.realbits = 10,                                        \
+			.storagebits = 16,                                     \
+			.endianness = IIO_CPU,                                 \
+		},                                                             \
+	}
+
+static const struct iio_chan_spec leicaefi_adc_channels[] = {
+	LEICAEFI_ADC_VOLTAGE_CHANNEL(LEICAEFI_ADC_CHANNEL_VEXT1, "vext1"),
+	LEICAEFI_ADC_VOLTAGE_CHANNEL(LEICAEFI_ADC_CHANNEL_VEXT2, "vext2"),
+	LEICAEFI_ADC_VOLTAGE_CHANNEL(LEICAEFI_ADC_CHANNEL_VPOE1, "vpoe1"),
+	LEICAEFI_ADC_VOLTAGE_CHANNEL(LEICAEFI_ADC_CHANNEL_VBAT1, "vbat1"),
+	LEICAEFI_ADC_VOLTAGE_CHANNEL(LEICAEFI_ADC_CHANNEL_VLINE, "vline"),
+	IIO_CHAN_SOFT_TIMESTAMP(LEICAEFI_ADC_CHANNEL_COUNT),
+};
+
+static int leicaefi_adc_read_raw(struct iio_dev *indio_dev,
+				 struct iio_chan_spec const *chan, int *val,
+				 int *val2, long mask)
+{
+	struct leicaefi_adc_device *efidev = iio_priv(indio_dev);
+	u16 reg_value = 0;
+	int rv = 0;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		rv = iio_device_claim_direct_mode(indio_dev);
+		if (rv != 0) {
+			return rv;
+		}
+
+		rv = leicaefi_chip_read(efidev->efichip,
+					leicaefi_adc_regs[chan->address],
+					&reg_value);
+		iio_device_release_direct_mode(indio_dev);
+		if (rv != 0) {
+			return rv;
+		}
+
+		*val = reg_value & LEICAEFI_ADC_RESOLUTION;
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SCALE:
+		/* millivolts per LSB */
+		*val = LEICAEFI_ADC_VREF_COMP_MV;
+		*val2 = LEICAEFI_ADC_RESOLUTION;
+		return IIO_VAL_FRACTIONAL;
+	default:
+		break;
+	}
+
+	return -EINVAL;
+}
+
+static const struct iio_info leicaefi_adc_info = {
+	.read_raw = leicaefi_adc_read_raw,
+};
+
+static irqreturn_t leicaefi_adc_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct leicaefi_adc_device *efidev = iio_priv(indio_dev);
+	u8 regs[LEICAEFI_ADC_CHANNEL_COUNT];
+	unsigned int count = 0;
+	unsigned int i = 0;
+	int bit = 0;
+	int rv = 0;
+
+	for_each_set_bit(bit, indio_dev->active_scan_mask,
+			 indio_dev->masklength) {
+		if (bit < LEICAEFI_ADC_CHANNEL_COUNT) {
+			regs[count++] = leicaefi_adc_regs[bit];
+		}
+	}
+
+	/* only the timestamp is enabled, nothing to read */
+	if (count == 0) {
+		goto push;
+	}
+
+	/* all enabled channels in one bus transaction */
+	rv = leicaefi_chip_read_multi(efidev->efichip, regs,
+				      efidev->scan.channels, count);
+	if (rv != 0) {
+		dev_warn_ratelimited(&efidev->pdev->dev,
+				     "%s - reading channels failed: %d\n",
+				     __func__, rv);
+		goto done;
+	}
+
+	for (i = 0; i < count; ++i) {
+		efidev->scan.channels[i] &= LEICAEFI_ADC_RESOLUTION;
+	}
+
+push:
+	iio_push_to_buffers_with_timestamp(indio_dev, &efidev->scan,
+					   iio_get_time_ns(indio_dev));
+
+done:
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+static int leicaefi_adc_probe(struct platform_device *pdev)
+{
+	struct leicaefi_adc_device *efidev = NULL;
+	struct leicaefi_platform_data *pdata = NULL;
+	struct iio_dev *indio_dev = NULL;
+	int rv = 0;
+
+	dev_dbg(&pdev->dev, "%s\n", __func__);
+
+	indio_dev = devm_iio_device_alloc(&pdev->dev, sizeof(*efidev));
+	if (indio_dev == NULL) {
+		dev_err(&pdev->dev, "Cannot allocate memory for device\n");
+		return -ENOMEM;
+	}
+
+	efidev = iio_priv(indio_dev);
+	platform_set_drvdata(pdev, indio_dev);
+	efidev->pdev = pdev;
+
+	pdata = pdev->dev.platform_data;
+	if (!pdata) {
+		dev_err(&efidev->pdev->dev, "Platform data not available.\n");
+		return -ENODEV;
+	}
+
+	efidev->efichip = pdata->efichip;
+	if (!efidev->efichip) {
+		dev_err(&efidev->pdev->dev, "Chip not available.\n");
+		return -ENODEV;
+	}
+
+	indio_dev->dev.parent = &pdev->dev;
+	indio_dev->name = "leicaefi-adc";
+	indio_dev->info = &leicaefi_adc_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = leicaefi_adc_channels;
+	indio_dev->num_channels = ARRAY_SIZE(leicaefi_adc_channels);
+
+	/* any trigger may be used, e.g. iio-trig-hrtimer for fixed rate */
+	rv = devm_iio_triggered_buffer_setup(&pdev->dev, indio_dev, NULL,
+					     leicaefi_adc_trigger_handler,
+					     NULL);
+	if (rv != 0) {
+		dev_err(&efidev->pdev->dev,
+			"Cannot setup triggered buffer (error: %d).\n", rv);
+		return rv;
+	}
+
+	rv = devm_iio_device_register(&pdev->dev, indio_dev);
+	if (rv != 0) {
+		dev_err(&efidev->pdev->dev,
+			"Cannot register IIO device (error: %d).\n", rv);
+		return rv;
+	}
+
+	return 0;
+}
+
+static int leicaefi_adc_remove(struct platform_device *pdev)
+{
+	dev_dbg(&pdev->dev, "%s\n", __func__);
+
+	// resources allocated using devm are freed automatically
+
+	return 0;
+}
+
+static const struct of_device_id leicaefi_adc_of_id_table[] = {
+	{
+		.compatible = "leica,efi-adc",
+	},
+	{},
+};
+MODULE_DEVICE_TABLE(of, leicaefi_adc_of_id_table);
+
+static struct platform_driver leicaefi_adc_driver = {
+	.driver =
+		{
+			.name = "leica-efi-adc",
+			.of_match_table = leicaefi_adc_of_id_table,
+		},
+	.probe = leicaefi_adc_probe,
+	.remove = leicaefi_adc_remove,
+};
+
+module_platform_driver(leicaefi_adc_driver);
+
+// Module information
+MODULE_DESCRIPTION("Leica EFI ADC driver");
+MODULE_AUTHOR(
+	"Krzysztof Kapuscik <krzysztof.kapuscik-ext@leica-geosystems.com>");
+MODULE_VERSION("0.1");
+MODULE_LICENSE("GPL v2");
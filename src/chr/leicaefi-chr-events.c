@@ -0,0 +1,260 @@
+#include <linux/platform_device.h>
+#include <linux/interrupt.h>
+#include <linux/uaccess.h>
+
+#include <chr/leicaefi-chr.h>
+#include <leicaefi.h>
+
+struct leicaefi_chr_event_source {
+	const char *name;
+	u16 bit;
+	bool is_error;
+};
+
+#define LEICAEFI_CHR_EVENT_SOURCE(id, irq_name, irq_bit, error, users)         \
+	[LEICAEFI_IRQNO_##id] = {                                              \
+		.name = (irq_name),                                            \
+		.bit = (irq_bit),                                              \
+		.is_error = (error),                                           \
+	},
+
+static const struct leicaefi_chr_event_source
+	leicaefi_chr_event_sources[LEICAEFI_TOTAL_IRQ_COUNT] = {
+		LEICAEFI_IRQ_TABLE(LEICAEFI_CHR_EVENT_SOURCE)
+	};
+
+static irqreturn_t leicaefi_chr_events_irq_handler(int irq, void *data)
+{
+	struct leicaefi_chr_event_irq *event_irq = data;
+	struct leicaefi_chr_events *events = &event_irq->efidev->events;
+	struct leicaefi_chr_file *file = NULL;
+
+	/* nested IRQ handlers run in the IRQ thread, no need to disable IRQs */
+	spin_lock(&events->lock);
+	list_for_each_entry(file, &events->files, node) {
+		file->irq_bits |= event_irq->irq_bit;
+		file->err_bits |= event_irq->err_bit;
+	}
+	spin_unlock(&events->lock);
+
+	wake_up_interruptible(&events->wq);
+
+	return IRQ_HANDLED;
+}
+
+static bool leicaefi_chr_events_pending(struct leicaefi_chr_file *file)
+{
+	struct leicaefi_chr_events *events = &file->efidev->events;
+	bool pending = false;
+
+	spin_lock(&events->lock);
+	pending = (file->irq_bits != 0) || (file->err_bits != 0);
+	spin_unlock(&events->lock);
+
+	return pending;
+}
+
+/* Frees the interrupts, must be called with users_lock held. */
+static void leicaefi_chr_events_free_irqs(struct leicaefi_chr_events *events,
+					  int count)
+{
+	int i = 0;
+
+	for (i = 0; i < count; ++i) {
+		struct leicaefi_chr_event_irq *event_irq = &events->irqs[i];
+
+		if (event_irq->irq > 0) {
+			free_irq(event_irq->irq, event_irq);
+		}
+	}
+
+	events->irqs_requested = false;
+}
+
+/* Requests the interrupts, must be called with users_lock held. */
+static int leicaefi_chr_events_request_irqs(struct leicaefi_chr_device *efidev)
+{
+	struct leicaefi_chr_events *events = &efidev->events;
+	int i = 0;
+	int rc = 0;
+
+	for (i = 0; i < LEICAEFI_TOTAL_IRQ_COUNT; ++i) {
+		struct leicaefi_chr_event_irq *event_irq = &events->irqs[i];
+
+		if (event_irq->irq <= 0) {
+			continue;
+		}
+
+		/* shared with the children handling the interrupt itself */
+		rc = request_threaded_irq(event_irq->irq, NULL,
+					  leicaefi_chr_events_irq_handler,
+					  IRQF_ONESHOT | IRQF_SHARED,
+					  dev_name(&efidev->pdev->dev),
+					  event_irq);
+		if (rc) {
+			dev_err(&efidev->pdev->dev,
+				"%s - failed: irq request (IRQ: %s/%d, error :%d)\n",
+				__func__, leicaefi_chr_event_sources[i].name,
+				event_irq->irq, rc);
+			leicaefi_chr_events_free_irqs(events, i);
+			return rc;
+		}
+	}
+
+	events->irqs_requested = true;
+
+	return 0;
+}
+
+int leicaefi_chr_events_open(struct leicaefi_chr_file *file)
+{
+	struct leicaefi_chr_events *events = &file->efidev->events;
+	int rc = 0;
+
+	mutex_lock(&events->users_lock);
+
+	if (events->users == 0) {
+		rc = leicaefi_chr_events_request_irqs(file->efidev);
+	}
+	if (rc == 0) {
+		++events->users;
+
+		spin_lock(&events->lock);
+		list_add_tail(&file->node, &events->files);
+		spin_unlock(&events->lock);
+	}
+
+	mutex_unlock(&events->users_lock);
+
+	return rc;
+}
+
+void leicaefi_chr_events_release(struct leicaefi_chr_file *file)
+{
+	struct leicaefi_chr_events *events = &file->efidev->events;
+
+	mutex_lock(&events->users_lock);
+
+	spin_lock(&events->lock);
+	list_del(&file->node);
+	spin_unlock(&events->lock);
+
+	if ((--events->users == 0) && events->irqs_requested) {
+		leicaefi_chr_events_free_irqs(events,
+					      LEICAEFI_TOTAL_IRQ_COUNT);
+	}
+
+	mutex_unlock(&events->users_lock);
+}
+
+ssize_t leicaefi_chr_events_read(struct leicaefi_chr_file *file,
+				 char __user *buffer, size_t length,
+				 bool nonblock)
+{
+	struct leicaefi_chr_events *events = &file->efidev->events;
+	struct leicaefi_event event;
+	int rc = 0;
+
+	if (length < sizeof(event)) {
+		return -EINVAL;
+	}
+
+	for (;;) {
+		spin_lock(&events->lock);
+		event.irq_bits = file->irq_bits;
+		event.err_bits = file->err_bits;
+		file->irq_bits = 0;
+		file->err_bits = 0;
+		spin_unlock(&events->lock);
+
+		if ((event.irq_bits != 0) || (event.err_bits != 0)) {
+			break;
+		}
+
+		if (nonblock) {
+			return -EAGAIN;
+		}
+
+		rc = wait_event_interruptible(
+			events->wq, leicaefi_chr_events_pending(file));
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	if (copy_to_user(buffer, &event, sizeof(event))) {
+		return -EFAULT;
+	}
+
+	return sizeof(event);
+}
+
+__poll_t leicaefi_chr_events_poll(struct leicaefi_chr_file *file,
+				  struct file *filep, poll_table *wait)
+{
+	poll_wait(filep, &file->efidev->events.wq, wait);
+
+	if (leicaefi_chr_events_pending(file)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+
+	return 0;
+}
+
+/* Frees the interrupts still requested by files open on removal. */
+static void leicaefi_chr_events_cleanup(void *data)
+{
+	struct leicaefi_chr_events *events = data;
+
+	mutex_lock(&events->users_lock);
+
+	if (events->irqs_requested) {
+		leicaefi_chr_events_free_irqs(events,
+					      LEICAEFI_TOTAL_IRQ_COUNT);
+	}
+
+	mutex_unlock(&events->users_lock);
+}
+
+int leicaefi_chr_events_init(struct leicaefi_chr_device *efidev)
+{
+	struct leicaefi_chr_events *events = &efidev->events;
+	int i = 0;
+
+	spin_lock_init(&events->lock);
+	INIT_LIST_HEAD(&events->files);
+	init_waitqueue_head(&events->wq);
+	mutex_init(&events->users_lock);
+
+	for (i = 0; i < LEICAEFI_TOTAL_IRQ_COUNT; ++i) {
+		const struct leicaefi_chr_event_source *source =
+			&leicaefi_chr_event_sources[i];
+		struct leicaefi_chr_event_irq *event_irq = &events->irqs[i];
+
+		/* command completion is internal to the chip */
+		if ((i == LEICAEFI_IRQNO_GENCMD_COMPLETE) ||
+		    (i == LEICAEFI_IRQNO_GENCMD_ERROR)) {
+			continue;
+		}
+
+		event_irq->efidev = efidev;
+		if (source->is_error) {
+			event_irq->err_bit = source->bit;
+		} else {
+			event_irq->irq_bit = source->bit;
+		}
+
+		/* requested when the device is opened */
+		event_irq->irq =
+			platform_get_irq_byname(efidev->pdev, source->name);
+		if (event_irq->irq < 0) {
+			dev_err(&efidev->pdev->dev,
+				"%s - failed: cannot find irq %s (error :%d)\n",
+				__func__, source->name, event_irq->irq);
+			return -EINVAL;
+		}
+	}
+
+	return devm_add_action_or_reset(&efidev->pdev->dev,
+					leicaefi_chr_events_cleanup, events);
+}
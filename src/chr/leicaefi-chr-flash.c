@@ -2,19 +2,35 @@
 #include <linux/uaccess.h>
 #include <linux/interrupt.h>
 #include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/jiffies.h>
 
 #include <chr/leicaefi-chr.h>
 #include <leicaefi.h>
 #include <common/leicaefi-chip.h>
 #include <chr/leicaefi-chr-utils.h>
 
+#include <trace/events/leicaefi.h>
+
 static const unsigned int LEICAEFI_SET_MODE_DELAY_MS = 100;
 
+static unsigned int flash_timeout_ms = 10000;
+module_param(flash_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(flash_timeout_ms,
+		 "Flash operation timeout in ms (0 - no timeout)");
+
+static unsigned int flash_drain_ms = 1000;
+module_param(flash_drain_ms, uint, 0644);
+MODULE_PARM_DESC(flash_drain_ms,
+		 "Wait in ms for a late interrupt of a timed out flash operation before the next one (0 - no wait)");
+
 enum leicaefi_flash_op_state {
 	LEICAEFI_FLASH_OP_IDLE,
 	LEICAEFI_FLASH_OP_PENDING,
 	LEICAEFI_FLASH_OP_DONE,
 	LEICAEFI_FLASH_OP_FAILED,
+	/* timed out, a late interrupt of the operation is dropped */
+	LEICAEFI_FLASH_OP_DRAINING,
 };
 
 static int leicaefi_chr_flash_exclusive_lock(struct leicaefi_chr_device *efidev)
@@ -44,6 +60,151 @@ static int leicaefi_chr_flash_set_op_state(struct leicaefi_chr_device *efidev,
 	return 0;
 }
 
+static ktime_t leicaefi_chr_flash_op_begin(const char *op)
+{
+	trace_leicaefi_flash_start(op);
+
+	return ktime_get();
+}
+
+static void leicaefi_chr_flash_op_end(struct leicaefi_chr_device *efidev,
+				      const char *op, ktime_t start, int rc,
+				      unsigned int bytes)
+{
+	leicaefi_chip_stats_record(efidev->efichip, LEICAEFI_STATS_OP_FLASH,
+				   start, rc, bytes);
+	trace_leicaefi_flash_finish(op, rc, start);
+}
+
+/*
+ * Called when no flash interrupt came in time. Processes the interrupts
+ * pending in the chip in case the interrupt was lost, if the operation is
+ * still not finished the state machine is reset.
+ */
+static int leicaefi_chr_flash_recover(struct leicaefi_chr_device *efidev,
+				      const char *op_info)
+{
+	int rc = 0;
+	int state_value = 0;
+	int next_state = LEICAEFI_FLASH_OP_IDLE;
+
+	rc = leicaefi_chip_poll_irq(efidev->efichip);
+	if (rc) {
+		dev_warn(&efidev->pdev->dev,
+			 "%s - cannot poll interrupts for %s: %d\n", __func__,
+			 op_info, rc);
+	}
+
+	/*
+	 * The chip may still finish the operation. Its interrupt must not
+	 * complete the next operation, so it is awaited first.
+	 */
+	if (flash_drain_ms > 0) {
+		efidev->flash.drain_deadline =
+			jiffies + msecs_to_jiffies(flash_drain_ms);
+		next_state = LEICAEFI_FLASH_OP_DRAINING;
+	}
+
+	state_value = atomic_cmpxchg(&efidev->flash.op_state,
+				     LEICAEFI_FLASH_OP_PENDING, next_state);
+	if (state_value != LEICAEFI_FLASH_OP_PENDING) {
+		atomic_inc(&efidev->flash.recoveries);
+		dev_warn(&efidev->pdev->dev,
+			 "%s - recovered lost interrupt for %s\n", __func__,
+			 op_info);
+		return 0;
+	}
+
+	atomic_inc(&efidev->flash.timeouts);
+	dev_err(&efidev->pdev->dev, "%s - %s timed out\n", __func__, op_info);
+
+	return -ETIMEDOUT;
+}
+
+/*
+ * Marks a new operation as pending. If the previous one timed out, waits
+ * until its late interrupt is received or flash_drain_ms passes.
+ */
+static int leicaefi_chr_flash_op_start(struct leicaefi_chr_device *efidev,
+				       const char *op_info)
+{
+	long timeout = (long)(efidev->flash.drain_deadline - jiffies);
+
+	if (atomic_read(&efidev->flash.op_state) ==
+	    LEICAEFI_FLASH_OP_DRAINING) {
+		/* non-interruptible - bounded by flash_drain_ms */
+		if (timeout > 0) {
+			wait_event_timeout(efidev->flash.op_wq,
+					   atomic_read(&efidev->flash.op_state) !=
+						   LEICAEFI_FLASH_OP_DRAINING,
+					   timeout);
+		}
+
+		/* interrupt may be pending in the chip */
+		leicaefi_chip_poll_irq(efidev->efichip);
+
+		if (atomic_cmpxchg(&efidev->flash.op_state,
+				   LEICAEFI_FLASH_OP_DRAINING,
+				   LEICAEFI_FLASH_OP_IDLE) ==
+		    LEICAEFI_FLASH_OP_DRAINING) {
+			dev_warn(&efidev->pdev->dev,
+				 "%s - no completion of timed out operation\n",
+				 __func__);
+		}
+	}
+
+	return leicaefi_chr_flash_set_op_state(efidev, op_info,
+					       LEICAEFI_FLASH_OP_IDLE,
+					       LEICAEFI_FLASH_OP_PENDING);
+}
+
+/* Finishes the pending operation from the interrupt handlers. */
+static void leicaefi_chr_flash_op_finish(struct leicaefi_chr_device *efidev,
+					 int next_state)
+{
+	if (atomic_cmpxchg(&efidev->flash.op_state,
+			   LEICAEFI_FLASH_OP_DRAINING,
+			   LEICAEFI_FLASH_OP_IDLE) ==
+	    LEICAEFI_FLASH_OP_DRAINING) {
+		dev_warn(&efidev->pdev->dev,
+			 "%s - dropped late completion (state: %d)\n",
+			 __func__, next_state);
+	} else {
+		leicaefi_chr_flash_set_op_state(efidev, "flash_irq",
+						LEICAEFI_FLASH_OP_PENDING,
+						next_state);
+	}
+
+	wake_up(&efidev->flash.op_wq);
+}
+
+/* Waits until the pending operation is finished by the interrupt. */
+static int leicaefi_chr_flash_wait(struct leicaefi_chr_device *efidev,
+				   const char *op_info)
+{
+	unsigned int timeout_ms = flash_timeout_ms;
+	long remaining = 0;
+
+	/* non-interruptible - it must be finished */
+	if (timeout_ms == 0) {
+		wait_event(efidev->flash.op_wq,
+			   atomic_read(&efidev->flash.op_state) !=
+				   LEICAEFI_FLASH_OP_PENDING);
+		return 0;
+	}
+
+	remaining = wait_event_timeout(
+		efidev->flash.op_wq,
+		atomic_read(&efidev->flash.op_state) !=
+			LEICAEFI_FLASH_OP_PENDING,
+		msecs_to_jiffies(timeout_ms));
+	if (remaining > 0) {
+		return 0;
+	}
+
+	return leicaefi_chr_flash_recover(efidev, op_info);
+}
+
 static int leicaefi_chr_request_set_mode(struct leicaefi_chr_device *efidev,
 					 const struct leicaefi_ioctl_mode *data)
 {
@@ -80,9 +241,7 @@ static int leicaefi_chr_request_set_mode(struct leicaefi_chr_device *efidev,
 		return 0;
 	}
 
-	rc = leicaefi_chr_flash_set_op_state(efidev, "set_mode_start",
-					     LEICAEFI_FLASH_OP_IDLE,
-					     LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_op_start(efidev, "set_mode_start");
 	if (rc) {
 		return rc;
 	}
@@ -102,9 +261,10 @@ static int leicaefi_chr_request_set_mode(struct leicaefi_chr_device *efidev,
 		return -EIO;
 	}
 
-	/* non-interruptible - it must be finished */
-	wait_event(efidev->flash.op_wq, atomic_read(&efidev->flash.op_state) !=
-						LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_wait(efidev, "set_mode");
+	if (rc) {
+		return rc;
+	}
 
 	state_value = atomic_read(&efidev->flash.op_state);
 	if (state_value == LEICAEFI_FLASH_OP_DONE) {
@@ -117,6 +277,9 @@ static int leicaefi_chr_request_set_mode(struct leicaefi_chr_device *efidev,
 
 		msleep(LEICAEFI_SET_MODE_DELAY_MS);
 
+		/* the other software may report different register values */
+		leicaefi_chip_invalidate_cache(efidev->efichip);
+
 		return 0;
 	} else if (state_value == LEICAEFI_FLASH_OP_FAILED) {
 		rc = leicaefi_chr_flash_set_op_state(efidev, "set_mode_fail",
@@ -199,9 +362,7 @@ static int leicaefi_chr_flash_request_check_checksum(
 	}
 
 	/* execute the check */
-	rc = leicaefi_chr_flash_set_op_state(efidev, "flash_ctrl_start",
-					     LEICAEFI_FLASH_OP_IDLE,
-					     LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_op_start(efidev, "flash_ctrl_start");
 	if (rc) {
 		return rc;
 	}
@@ -221,9 +382,10 @@ static int leicaefi_chr_flash_request_check_checksum(
 		return -EIO;
 	}
 
-	/* non-interruptible - it must be finished */
-	wait_event(efidev->flash.op_wq, atomic_read(&efidev->flash.op_state) !=
-						LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_wait(efidev, "flash_ctrl");
+	if (rc) {
+		return rc;
+	}
 
 	state_value = atomic_read(&efidev->flash.op_state);
 	if (state_value == LEICAEFI_FLASH_OP_DONE) {
@@ -307,9 +469,7 @@ leicaefi_chr_flash_request_write(struct leicaefi_chr_device *efidev,
 	int rc = 0;
 	int state_value = 0;
 
-	rc = leicaefi_chr_flash_set_op_state(efidev, "flash_write_start",
-					     LEICAEFI_FLASH_OP_IDLE,
-					     LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_op_start(efidev, "flash_write_start");
 	if (rc) {
 		return rc;
 	}
@@ -331,9 +491,10 @@ leicaefi_chr_flash_request_write(struct leicaefi_chr_device *efidev,
 		return -EIO;
 	}
 
-	/* non-interruptible - it must be finished */
-	wait_event(efidev->flash.op_wq, atomic_read(&efidev->flash.op_state) !=
-						LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_wait(efidev, "flash_write");
+	if (rc) {
+		return rc;
+	}
 
 	state_value = atomic_read(&efidev->flash.op_state);
 	if (state_value == LEICAEFI_FLASH_OP_DONE) {
@@ -369,9 +530,7 @@ leicaefi_chr_flash_request_erase(struct leicaefi_chr_device *efidev,
 	int rc = 0;
 	int state_value = 0;
 
-	rc = leicaefi_chr_flash_set_op_state(efidev, "flash_erase_start",
-					     LEICAEFI_FLASH_OP_IDLE,
-					     LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_op_start(efidev, "flash_erase_start");
 	if (rc) {
 		return rc;
 	}
@@ -393,9 +552,10 @@ leicaefi_chr_flash_request_erase(struct leicaefi_chr_device *efidev,
 		return -EIO;
 	}
 
-	/* non-interruptible - it must be finished */
-	wait_event(efidev->flash.op_wq, atomic_read(&efidev->flash.op_state) !=
-						LEICAEFI_FLASH_OP_PENDING);
+	rc = leicaefi_chr_flash_wait(efidev, "flash_erase");
+	if (rc) {
+		return rc;
+	}
 
 	state_value = atomic_read(&efidev->flash.op_state);
 	if (state_value == LEICAEFI_FLASH_OP_DONE) {
@@ -462,7 +622,11 @@ leicaefi_chr_ioctl_flash_check_checksum(struct leicaefi_chr_device *efidev,
 
 	rc = leicaefi_chr_flash_exclusive_lock(efidev);
 	if (rc == 0) {
+		ktime_t start = leicaefi_chr_flash_op_begin("check_checksum");
+
 		rc = leicaefi_chr_flash_request_check_checksum(efidev, &data);
+		leicaefi_chr_flash_op_end(efidev, "check_checksum", start, rc,
+					  0);
 		if (rc == 0) {
 			rc = leicaefi_chr_copy_to_user(arg, &data,
 						       sizeof(data));
@@ -486,7 +650,11 @@ static long leicaefi_chr_ioctl_flash_read(struct leicaefi_chr_device *efidev,
 
 	rc = leicaefi_chr_flash_exclusive_lock(efidev);
 	if (rc == 0) {
+		ktime_t start = leicaefi_chr_flash_op_begin("read");
+
 		rc = leicaefi_chr_flash_request_read(efidev, &data);
+		leicaefi_chr_flash_op_end(efidev, "read", start, rc,
+					  sizeof(data.value));
 		if (rc == 0) {
 			rc = leicaefi_chr_copy_to_user(arg, &data,
 						       sizeof(data));
@@ -511,7 +679,11 @@ static long leicaefi_chr_ioctl_flash_write(struct leicaefi_chr_device *efidev,
 
 	rc = leicaefi_chr_flash_exclusive_lock(efidev);
 	if (rc == 0) {
+		ktime_t start = leicaefi_chr_flash_op_begin("write");
+
 		rc = leicaefi_chr_flash_request_write(efidev, &data);
+		leicaefi_chr_flash_op_end(efidev, "write", start, rc,
+					  sizeof(data.value));
 		leicaefi_chr_flash_exclusive_unlock(efidev);
 	}
 
@@ -532,7 +704,10 @@ leicaefi_chr_ioctl_flash_erase_segment(struct leicaefi_chr_device *efidev,
 
 	rc = leicaefi_chr_flash_exclusive_lock(efidev);
 	if (rc == 0) {
+		ktime_t start = leicaefi_chr_flash_op_begin("erase");
+
 		rc = leicaefi_chr_flash_request_erase(efidev, &data);
+		leicaefi_chr_flash_op_end(efidev, "erase", start, rc, 0);
 		leicaefi_chr_flash_exclusive_unlock(efidev);
 	}
 
@@ -574,7 +749,10 @@ static long leicaefi_chr_ioctl_set_mode(struct leicaefi_chr_device *efidev,
 
 	rc = leicaefi_chr_flash_exclusive_lock(efidev);
 	if (rc == 0) {
+		ktime_t start = leicaefi_chr_flash_op_begin("set_mode");
+
 		rc = leicaefi_chr_request_set_mode(efidev, &data);
+		leicaefi_chr_flash_op_end(efidev, "set_mode", start, rc, 0);
 		leicaefi_chr_flash_exclusive_unlock(efidev);
 	}
 
@@ -608,10 +786,7 @@ static irqreturn_t leicaefi_chr_handle_flash_complete_irq(int irq,
 
 	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
 
-	leicaefi_chr_flash_set_op_state(efidev, "flash_irq",
-					LEICAEFI_FLASH_OP_PENDING,
-					LEICAEFI_FLASH_OP_DONE);
-	wake_up(&efidev->flash.op_wq);
+	leicaefi_chr_flash_op_finish(efidev, LEICAEFI_FLASH_OP_DONE);
 
 	return IRQ_HANDLED;
 }
@@ -623,10 +798,7 @@ static irqreturn_t leicaefi_chr_handle_flash_error_irq(int irq, void *dev_efi)
 
 	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
 
-	leicaefi_chr_flash_set_op_state(efidev, "flash_irq",
-					LEICAEFI_FLASH_OP_PENDING,
-					LEICAEFI_FLASH_OP_FAILED);
-	wake_up(&efidev->flash.op_wq);
+	leicaefi_chr_flash_op_finish(efidev, LEICAEFI_FLASH_OP_FAILED);
 
 	return IRQ_HANDLED;
 }
@@ -645,7 +817,11 @@ static long leicaefi_chr_ioctl_iflash_read(struct leicaefi_chr_device *efidev,
 	// NOTE: we are using the same lock here
 	rc = leicaefi_chr_flash_exclusive_lock(efidev);
 	if (rc == 0) {
+		ktime_t start = leicaefi_chr_flash_op_begin("iflash_read");
+
 		rc = leicaefi_chr_iflash_request_read(efidev, &data);
+		leicaefi_chr_flash_op_end(efidev, "iflash_read", start, rc,
+					  sizeof(data.value));
 		if (rc == 0) {
 			rc = leicaefi_chr_copy_to_user(arg, &data,
 						       sizeof(data));
@@ -723,8 +899,8 @@ int leicaefi_chr_flash_init_irq(struct leicaefi_chr_device *efidev,
 	}
 
 	rc = devm_request_threaded_irq(&efidev->pdev->dev, *irq_ptr, NULL,
-				       handler_func, IRQF_ONESHOT, NULL,
-				       efidev);
+				       handler_func, IRQF_ONESHOT | IRQF_SHARED,
+				       NULL, efidev);
 	if (rc) {
 		dev_err(&efidev->pdev->dev,
 			"%s - failed: irq request (IRQ: %s/%d, error :%d)\n",
@@ -735,6 +911,34 @@ int leicaefi_chr_flash_init_irq(struct leicaefi_chr_device *efidev,
 	return 0;
 }
 
+static ssize_t flash_timeouts_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct leicaefi_chr_device *efidev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", atomic_read(&efidev->flash.timeouts));
+}
+static DEVICE_ATTR_RO(flash_timeouts);
+
+static ssize_t flash_recoveries_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct leicaefi_chr_device *efidev = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", atomic_read(&efidev->flash.recoveries));
+}
+static DEVICE_ATTR_RO(flash_recoveries);
+
+static struct attribute *leicaefi_chr_flash_attrs[] = {
+	&dev_attr_flash_timeouts.attr,
+	&dev_attr_flash_recoveries.attr,
+	NULL,
+};
+
+static const struct attribute_group leicaefi_chr_flash_attr_group = {
+	.attrs = leicaefi_chr_flash_attrs,
+};
+
 int leicaefi_chr_flash_init(struct leicaefi_chr_device *efidev)
 {
 	int rc = 0;
@@ -742,6 +946,17 @@ int leicaefi_chr_flash_init(struct leicaefi_chr_device *efidev)
 	mutex_init(&efidev->flash.op_lock);
 	atomic_set(&efidev->flash.op_state, LEICAEFI_FLASH_OP_IDLE);
 	init_waitqueue_head(&efidev->flash.op_wq);
+	atomic_set(&efidev->flash.timeouts, 0);
+	atomic_set(&efidev->flash.recoveries, 0);
+
+	rc = devm_device_add_group(&efidev->pdev->dev,
+				   &leicaefi_chr_flash_attr_group);
+	if (rc) {
+		dev_err(&efidev->pdev->dev,
+			"%s - cannot add sysfs attributes: %d\n", __func__,
+			rc);
+		return rc;
+	}
 
 	rc = leicaefi_chr_flash_init_irq(
 		efidev, &efidev->flash.irq_flash_complete, "LEICAEFI_FLASH",
@@ -33,6 +33,41 @@ static long leicaefi_chr_ioctl_read(struct leicaefi_chr_device *efidev,
 	return 0;
 }
 
+static long leicaefi_chr_ioctl_read_multi(struct leicaefi_chr_device *efidev,
+					  unsigned long arg)
+{
+	struct leicaefi_ioctl_regrw_multi data;
+	int rc = 0;
+
+	BUILD_BUG_ON(LEICAEFI_IOCTL_READ_MULTI_MAX >
+		     LEICAEFI_CHIP_READ_MULTI_MAX);
+
+	rc = leicaefi_chr_copy_from_user(&data, arg, sizeof(data));
+	if (rc) {
+		return rc;
+	}
+
+	if ((data.count == 0) ||
+	    (data.count > LEICAEFI_IOCTL_READ_MULTI_MAX)) {
+		return -EINVAL;
+	}
+
+	if (leicaefi_chip_read_multi(efidev->efichip, data.reg_no,
+				     data.reg_value, data.count) != 0) {
+		dev_warn(&efidev->pdev->dev,
+			 "%s - I/O operation failed (count: %d)\n", __func__,
+			 (int)data.count);
+		return -EIO;
+	}
+
+	rc = leicaefi_chr_copy_to_user(arg, &data, sizeof(data));
+	if (rc) {
+		return rc;
+	}
+
+	return 0;
+}
+
 static long leicaefi_chr_ioctl_write(struct leicaefi_chr_device *efidev,
 				     unsigned long arg)
 {
@@ -149,6 +184,10 @@ long leicaefi_chr_reg_handle_ioctl(struct leicaefi_chr_device *efidev,
 		result = leicaefi_chr_ioctl_read(efidev, arg);
 		*handled = true;
 		break;
+	case LEICAEFI_IOCTL_READ_MULTI:
+		result = leicaefi_chr_ioctl_read_multi(efidev, arg);
+		*handled = true;
+		break;
 	case LEICAEFI_IOCTL_WRITE:
 		result = leicaefi_chr_ioctl_write(efidev, arg);
 		*handled = true;
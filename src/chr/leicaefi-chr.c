@@ -1,6 +1,7 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/interrupt.h>
+#include <linux/slab.h>
 
 #include <chr/leicaefi-chr.h>
 #include <leicaefi.h>
@@ -12,47 +13,71 @@ static int leicaefi_chr_open(struct inode *inode, struct file *filep)
 {
 	struct leicaefi_chr_device *efidev = container_of(
 		inode->i_cdev, struct leicaefi_chr_device, chr_cdev);
+	struct leicaefi_chr_file *file = NULL;
+	int rc = 0;
 
 	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
 
-	// store pointer to the device in file for later use
-	filep->private_data = efidev;
+	file = kzalloc(sizeof(*file), GFP_KERNEL);
+	if (!file) {
+		return -ENOMEM;
+	}
+
+	file->efidev = efidev;
+	rc = leicaefi_chr_events_open(file);
+	if (rc != 0) {
+		kfree(file);
+		return rc;
+	}
+
+	// store file state (with pointer to the device) for later use
+	filep->private_data = file;
 
 	return 0;
 }
 
 static int leicaefi_chr_release(struct inode *inode, struct file *filep)
 {
-	struct leicaefi_chr_device *efidev = filep->private_data;
-	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
+	struct leicaefi_chr_file *file = filep->private_data;
+	dev_dbg(&file->efidev->pdev->dev, "%s\n", __func__);
+
+	leicaefi_chr_events_release(file);
+	kfree(file);
+
 	return 0;
 }
 
 static ssize_t leicaefi_chr_read(struct file *filep, char __user *buffer,
 				 size_t length, loff_t *offset)
 {
-	struct leicaefi_chr_device *efidev = filep->private_data;
-	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
+	struct leicaefi_chr_file *file = filep->private_data;
+	dev_dbg(&file->efidev->pdev->dev, "%s\n", __func__);
 
-	// TODO: planned feature - interrupts support
-	// TODO: the file could be used to pass interrupts to be handled to the listeners (as in UIO).
-	// TODO: for example by using blocking i/o as in https://www.oreilly.com/library/view/linux-device-drivers/0596005903/ch06.html
+	// interrupts are passed to the listeners (as in UIO)
+	return leicaefi_chr_events_read(file, buffer, length,
+					filep->f_flags & O_NONBLOCK);
+}
 
-	return 0;
+static __poll_t leicaefi_chr_poll(struct file *filep, poll_table *wait)
+{
+	struct leicaefi_chr_file *file = filep->private_data;
+
+	return leicaefi_chr_events_poll(file, filep, wait);
 }
 
 static ssize_t leicaefi_chr_write(struct file *filep, const char __user *buffer,
 				  size_t length, loff_t *offset)
 {
-	struct leicaefi_chr_device *efidev = filep->private_data;
-	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
+	struct leicaefi_chr_file *file = filep->private_data;
+	dev_dbg(&file->efidev->pdev->dev, "%s\n", __func__);
 	return -EPERM;
 }
 
 static long leicaefi_chr_unlocked_ioctl(struct file *filep, unsigned int cmd,
 					unsigned long arg)
 {
-	struct leicaefi_chr_device *efidev = filep->private_data;
+	struct leicaefi_chr_file *file = filep->private_data;
+	struct leicaefi_chr_device *efidev = file->efidev;
 	long result = 0;
 	bool handled = false;
 
@@ -100,6 +125,7 @@ static int leicaefi_chr_create_device(struct leicaefi_chr_device *efidev)
 	efidev->chr_file_ops.release = leicaefi_chr_release;
 	efidev->chr_file_ops.read = leicaefi_chr_read;
 	efidev->chr_file_ops.write = leicaefi_chr_write;
+	efidev->chr_file_ops.poll = leicaefi_chr_poll;
 	efidev->chr_file_ops.unlocked_ioctl = leicaefi_chr_unlocked_ioctl;
 
 	// this does not work currently for multiple devices (driver instances)
@@ -193,6 +219,13 @@ static int leicaefi_chr_probe(struct platform_device *pdev)
 		return rc;
 	}
 
+	rc = leicaefi_chr_events_init(efidev);
+	if (rc != 0) {
+		dev_err(&efidev->pdev->dev,
+			"Events component initialization failed.\n");
+		return rc;
+	}
+
 	rc = leicaefi_chr_create_device(efidev);
 	if (rc != 0) {
 		dev_err(&efidev->pdev->dev, "Cannot create CHR device.\n");
@@ -6,8 +6,12 @@
 #include <linux/atomic.h>
 #include <linux/mutex.h>
 #include <linux/cdev.h>
+#include <linux/list.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
 
 #include <common/leicaefi-device.h>
+#include <common/leicaefi-irqs.h>
 
 struct leicaefi_chr_flash {
 	int irq_flash_complete;
@@ -15,6 +19,41 @@ struct leicaefi_chr_flash {
 	struct mutex op_lock;
 	atomic_t op_state;
 	wait_queue_head_t op_wq;
+	/* end of waiting for a late interrupt of a timed out operation */
+	unsigned long drain_deadline;
+	/* operations aborted / finished by polling after the timeout */
+	atomic_t timeouts;
+	atomic_t recoveries;
+};
+
+struct leicaefi_chr_device;
+
+struct leicaefi_chr_event_irq {
+	struct leicaefi_chr_device *efidev;
+	int irq;
+	u16 irq_bit;
+	u16 err_bit;
+};
+
+struct leicaefi_chr_events {
+	/* protects the files list and their pending bits */
+	spinlock_t lock;
+	struct list_head files;
+	wait_queue_head_t wq;
+	/* interrupts are requested only while the device is open */
+	struct mutex users_lock;
+	unsigned int users;
+	bool irqs_requested;
+	struct leicaefi_chr_event_irq irqs[LEICAEFI_TOTAL_IRQ_COUNT];
+};
+
+/* Opened device file. */
+struct leicaefi_chr_file {
+	struct leicaefi_chr_device *efidev;
+	struct list_head node;
+	/* interrupts raised since the last read */
+	u16 irq_bits;
+	u16 err_bits;
 };
 
 struct leicaefi_chr_device {
@@ -30,6 +69,7 @@ struct leicaefi_chr_device {
 	int chr_major;
 
 	struct leicaefi_chr_flash flash;
+	struct leicaefi_chr_events events;
 };
 
 long leicaefi_chr_reg_handle_ioctl(struct leicaefi_chr_device *efidev,
@@ -54,4 +94,17 @@ long leicaefi_chr_onewire_handle_ioctl(struct leicaefi_chr_device *efidev,
 
 int leicaefi_chr_flash_init(struct leicaefi_chr_device *efidev);
 
+int leicaefi_chr_events_init(struct leicaefi_chr_device *efidev);
+
+int leicaefi_chr_events_open(struct leicaefi_chr_file *file);
+
+void leicaefi_chr_events_release(struct leicaefi_chr_file *file);
+
+ssize_t leicaefi_chr_events_read(struct leicaefi_chr_file *file,
+				 char __user *buffer, size_t length,
+				 bool nonblock);
+
+__poll_t leicaefi_chr_events_poll(struct leicaefi_chr_file *file,
+				  struct file *filep, poll_table *wait);
+
 #endif /*_LINUX_LEICAEFI_CHR_H*/
@@ -0,0 +1,34 @@
+#ifndef _LINUX_LEICAEFI_ADC_H
+#define _LINUX_LEICAEFI_ADC_H
+
+#include <linux/types.h>
+
+/* Supply rail measurement: 10 bit ADC, 2.5V reference, 104.7k/10k divider */
+#define LEICAEFI_ADC_RESOLUTION (0x03FF)
+#define LEICAEFI_ADC_VREF_MV (2500)
+#define LEICAEFI_ADC_DIVIDER_R1 (104700)
+#define LEICAEFI_ADC_DIVIDER_R2 (10000)
+#define LEICAEFI_ADC_VREF_COMP_MV                                              \
+	(LEICAEFI_ADC_VREF_MV *                                                \
+	 (LEICAEFI_ADC_DIVIDER_R1 + LEICAEFI_ADC_DIVIDER_R2) /                 \
+	 LEICAEFI_ADC_DIVIDER_R2)
+
+/* Converts supply rail register value (PWR_Vxxx) to microvolts. */
+static inline int leicaefi_adc_to_microvolts(u16 reg_value)
+{
+	int value = (reg_value & LEICAEFI_ADC_RESOLUTION);
+
+	value *= LEICAEFI_ADC_VREF_COMP_MV;
+	value /= LEICAEFI_ADC_RESOLUTION;
+	value *= 1000;
+
+	return value;
+}
+
+/* Converts temperature register value (0.1K) to millidegrees Celsius. */
+static inline int leicaefi_adc_to_millicelsius(u16 reg_value)
+{
+	return ((int)reg_value - 2732) * 100;
+}
+
+#endif /*_LINUX_LEICAEFI_ADC_H*/
@@ -2,8 +2,14 @@
 #define _LINUX_LEICAEFI_UTILS_H
 
 #include <linux/types.h>
+#include <linux/list.h>
+#include <linux/ktime.h>
 
 struct leicaefi_chip;
+struct regmap;
+
+/* Maximum number of registers read by leicaefi_chip_read_multi(). */
+#define LEICAEFI_CHIP_READ_MULTI_MAX (16)
 
 // TODO?: add 'bool user_access' and protect important registers (interrupts, flash)
 //        from direct access by the user
@@ -13,12 +19,97 @@ int leicaefi_chip_set_bits(struct leicaefi_chip *efichip, u8 reg_no, u16 mask);
 int leicaefi_chip_clear_bits(struct leicaefi_chip *efichip, u8 reg_no,
 			     u16 mask);
 
+/*
+ * Sets the bits of 'mask' to 'value'. On the set/clear registers only the
+ * bits that differ from the cached register value are sent.
+ */
+int leicaefi_chip_update_bits(struct leicaefi_chip *efichip, u8 reg_no,
+			      u16 mask, u16 value);
+
+/*
+ * Plain register write. On the set/clear registers (MOD_IE, PWR_SETTINGS,
+ * LED_CTRL1/2) the chip clears the given bits.
+ */
 int leicaefi_chip_write(struct leicaefi_chip *efichip, u8 reg_no, u16 value);
 
 int leicaefi_chip_read(struct leicaefi_chip *efichip, u8 reg_no,
 		       u16 *value_ptr);
 
+/*
+ * Reads several registers at once. Registers not served from the cache are
+ * read in a single combined I2C transfer if the adapter supports it.
+ */
+int leicaefi_chip_read_multi(struct leicaefi_chip *efichip, const u8 *regs,
+			     u16 *vals, unsigned int count);
+
+/* Drops all cached register values (e.g. after software mode switch). */
+void leicaefi_chip_invalidate_cache(struct leicaefi_chip *efichip);
+
+/* Register map of the chip, e.g. for bulk access from child devices. */
+struct regmap *leicaefi_chip_get_regmap(struct leicaefi_chip *efichip);
+
+/* Operation types reported in the debugfs statistics. */
+enum leicaefi_stats_op {
+	LEICAEFI_STATS_OP_READ,
+	LEICAEFI_STATS_OP_READ_MULTI,
+	LEICAEFI_STATS_OP_WRITE,
+	LEICAEFI_STATS_OP_SET_BITS,
+	LEICAEFI_STATS_OP_CLEAR_BITS,
+	LEICAEFI_STATS_OP_UPDATE_BITS,
+	LEICAEFI_STATS_OP_GENCMD,
+	LEICAEFI_STATS_OP_FLASH,
+	LEICAEFI_STATS_OP_COUNT,
+};
+
+/* Adds operation started at 'start' to the statistics. */
+void leicaefi_chip_stats_record(struct leicaefi_chip *efichip,
+				enum leicaefi_stats_op op, ktime_t start,
+				int result, unsigned int bytes);
+
 int leicaefi_chip_gencmd(struct leicaefi_chip *efichip, u16 cmd, u16 input_data,
 			 u16 *output_data_ptr);
 
+/*
+ * Processes the pending interrupts without waiting for the IRQ line,
+ * used to recover from lost interrupts.
+ */
+int leicaefi_chip_poll_irq(struct leicaefi_chip *efichip);
+
+/* Asynchronous general command request. */
+struct leicaefi_gencmd_request {
+	/* in: command and its input data */
+	u16 cmd;
+	u16 input_data;
+	/* in: skip reading the output data */
+	bool no_output;
+	/* in: called when finished (IRQ thread or submitter context) */
+	void (*complete)(struct leicaefi_gencmd_request *req);
+	/* in: owner data, not used by the chip */
+	void *context;
+
+	/* out: result code and output data */
+	int result;
+	u16 output_data;
+
+	/* private: queue entry */
+	struct list_head node;
+	/* private: identical requests sharing the result of this one */
+	struct list_head followers;
+	/* private: time of submission */
+	ktime_t submit_time;
+};
+
+/*
+ * Queues the request for execution, commands are executed in FIFO order.
+ * The completion callback is called exactly once if the request was
+ * accepted (return value 0), also when the command could not be started.
+ * Read-type requests identical to one already queued or executing are not
+ * executed again but complete with the result of the earlier one.
+ * Commands not finished within gencmd_timeout_ms complete with -ETIMEDOUT.
+ * The request must stay valid until completed. The callback must not wait
+ * for other general commands as it may be called from the IRQ thread.
+ */
+int leicaefi_chip_gencmd_submit(struct leicaefi_chip *efichip,
+				struct leicaefi_gencmd_request *req);
+
 #endif /*_LINUX_LEICAEFI_UTILS_H*/
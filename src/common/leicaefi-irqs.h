@@ -0,0 +1,74 @@
+#ifndef _LINUX_LEICAEFI_IRQS_H
+#define _LINUX_LEICAEFI_IRQS_H
+
+#include <leicaefi-defs.h>
+
+/* Child devices requesting the interrupt (MFD cells getting its resource). */
+#define LEICAEFI_IRQ_USER_NONE 0
+#define LEICAEFI_IRQ_USER_CHR (1 << 0)
+#define LEICAEFI_IRQ_USER_KEYS (1 << 1)
+#define LEICAEFI_IRQ_USER_POWER (1 << 2)
+#define LEICAEFI_IRQ_USER_THERMAL (1 << 3)
+
+/*
+ * Interrupts provided by the EFI IRQ domain:
+ *   X(number suffix, resource name, IFG/ERR bit, is ERR register bit, users)
+ *
+ * The order defines the hardware IRQ numbers, new entries go at the end.
+ * The command interrupts are used by the core only.
+ */
+#define LEICAEFI_IRQ_TABLE(X)                                                  \
+	X(FLASH, "LEICAEFI_FLASH", LEICAEFI_IRQBIT_FLASH, false,               \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_FLASH, "LEICAEFI_FLASH_ERROR", LEICAEFI_ERRBIT_FLASH, true,      \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(KEY, "LEICAEFI_KEY", LEICAEFI_IRQBIT_KEY, false,                     \
+	  LEICAEFI_IRQ_USER_CHR | LEICAEFI_IRQ_USER_KEYS)                      \
+	X(GENCMD_COMPLETE, "LEICAEFI_GENCMD", LEICAEFI_IRQBIT_GCC, false,      \
+	  LEICAEFI_IRQ_USER_NONE)                                              \
+	X(GENCMD_ERROR, "LEICAEFI_GENCMD_ERROR", LEICAEFI_ERRBIT_GCE, true,    \
+	  LEICAEFI_IRQ_USER_NONE)                                              \
+	X(CBL, "LEICAEFI_CBL", LEICAEFI_IRQBIT_CBL, false,                     \
+	  LEICAEFI_IRQ_USER_CHR | LEICAEFI_IRQ_USER_POWER)                     \
+	X(SRC, "LEICAEFI_SRC", LEICAEFI_IRQBIT_SRC, false,                     \
+	  LEICAEFI_IRQ_USER_CHR | LEICAEFI_IRQ_USER_POWER)                     \
+	X(PWR, "LEICAEFI_PWR", LEICAEFI_IRQBIT_PWR, false,                     \
+	  LEICAEFI_IRQ_USER_CHR | LEICAEFI_IRQ_USER_POWER)                     \
+	X(DEV, "LEICAEFI_DEV", LEICAEFI_IRQBIT_DEV, false,                     \
+	  LEICAEFI_IRQ_USER_CHR | LEICAEFI_IRQ_USER_THERMAL)                   \
+	X(SMB, "LEICAEFI_SMB", LEICAEFI_IRQBIT_SMB, false,                     \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(OW, "LEICAEFI_OW", LEICAEFI_IRQBIT_OW, false,                        \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(COM, "LEICAEFI_COM", LEICAEFI_IRQBIT_COM, false,                     \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(LED, "LEICAEFI_LED", LEICAEFI_IRQBIT_LED, false,                     \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_IA, "LEICAEFI_IA_ERROR", LEICAEFI_ERRBIT_IA, true,               \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_KEY, "LEICAEFI_KEY_ERROR", LEICAEFI_ERRBIT_KEY, true,            \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_PWR, "LEICAEFI_PWR_ERROR", LEICAEFI_ERRBIT_PWR, true,            \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_DEV, "LEICAEFI_DEV_ERROR", LEICAEFI_ERRBIT_DEV, true,            \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_SMB, "LEICAEFI_SMB_ERROR", LEICAEFI_ERRBIT_SMB, true,            \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_OW, "LEICAEFI_OW_ERROR", LEICAEFI_ERRBIT_OW, true,               \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_COM, "LEICAEFI_COM_ERROR", LEICAEFI_ERRBIT_COM, true,            \
+	  LEICAEFI_IRQ_USER_CHR)                                               \
+	X(ERR_HMI, "LEICAEFI_HMI_ERROR", LEICAEFI_ERRBIT_HMI, true,            \
+	  LEICAEFI_IRQ_USER_CHR)
+
+#define LEICAEFI_IRQ_TABLE_NUMBER(id, name, bit, is_error, users)              \
+	LEICAEFI_IRQNO_##id,
+
+enum leicaefi_irqno {
+	LEICAEFI_IRQ_TABLE(LEICAEFI_IRQ_TABLE_NUMBER)
+	LEICAEFI_TOTAL_IRQ_COUNT
+};
+
+#undef LEICAEFI_IRQ_TABLE_NUMBER
+
+#endif /*_LINUX_LEICAEFI_IRQS_H*/
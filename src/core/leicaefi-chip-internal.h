@@ -1,12 +1,17 @@
 #ifndef _LINUX_LEICAEFI_CHIP_INTERNAL_H
 #define _LINUX_LEICAEFI_CHIP_INTERNAL_H
 
-#include <linux/i2c.h>
+#include <linux/device.h>
+#include <linux/debugfs.h>
 #include <common/leicaefi-chip.h>
 
 #include "leicaefi-irq.h"
+#include "leicaefi-transport.h"
 
-int devm_leicaefi_add_chip(struct i2c_client *i2c,
+/* Adds the chip accessed with given transport, bound to the device. */
+int devm_leicaefi_add_chip(struct device *dev,
+			   const struct leicaefi_transport_ops *transport,
+			   void *transport_context,
 			   struct leicaefi_chip **efichip);
 
 void devm_leicaefi_del_chip(struct device *dev, struct leicaefi_chip *efichip);
@@ -14,4 +19,25 @@ void devm_leicaefi_del_chip(struct device *dev, struct leicaefi_chip *efichip);
 int leicaefi_chip_init(struct leicaefi_chip *efichip,
 		       struct leicaefi_irq_chip *irqchip);
 
+/* Creates the chip debugfs files in the given directory. */
+void leicaefi_chip_create_debugfs(struct leicaefi_chip *efichip,
+				  struct dentry *parent);
+
+/* Checks if a general command is executed (hint, no locking). */
+bool leicaefi_chip_gencmd_in_progress(struct leicaefi_chip *efichip);
+
+/*
+ * Passes output of the current command read by the IRQ thread together
+ * with the interrupt flags, it is used instead of reading it again.
+ */
+void leicaefi_chip_gencmd_prefetched(struct leicaefi_chip *efichip,
+				     u16 output_data);
+
+#if IS_ENABLED(CONFIG_KUNIT)
+/* Command engine steps run by the interrupts and the watchdog. */
+void leicaefi_chip_gencmd_finish(struct leicaefi_chip *efichip, int result);
+void leicaefi_chip_gencmd_expire(struct leicaefi_chip *efichip);
+void leicaefi_chip_gencmd_drain_end(struct leicaefi_chip *efichip);
+#endif /* CONFIG_KUNIT */
+
 #endif /*_LINUX_LEICAEFI_CHIP_INTERNAL_H*/
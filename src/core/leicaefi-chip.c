@@ -2,102 +2,399 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/interrupt.h>
+#include <linux/regmap.h>
+#include <linux/bitmap.h>
+#include <linux/completion.h>
+#include <linux/module.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/atomic.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/average.h>
+#include <linux/delay.h>
+#include <kunit/visibility.h>
 
 #include <core/leicaefi-chip-internal.h>
 #include <leicaefi-defs.h>
 #include <leicaefi.h>
 
 #include "leicaefi-irq.h"
+#include "leicaefi-stats.h"
+#include "leicaefi-transport.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/leicaefi.h>
+
+EXPORT_TRACEPOINT_SYMBOL(leicaefi_flash_start);
+EXPORT_TRACEPOINT_SYMBOL(leicaefi_flash_finish);
+
+static unsigned int gencmd_timeout_ms = 1000;
+module_param(gencmd_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(
+	gencmd_timeout_ms,
+	"General command execution timeout in ms (0 - no timeout, callers wait until the chip answers)");
+
+static unsigned int gencmd_drain_ms = 100;
+module_param(gencmd_drain_ms, uint, 0644);
+MODULE_PARM_DESC(
+	gencmd_drain_ms,
+	"Time in ms to wait for a late completion of a timed out command before the next one is started");
+
+static unsigned int gencmd_poll_threshold_us = 0;
+module_param(gencmd_poll_threshold_us, uint, 0644);
+MODULE_PARM_DESC(gencmd_poll_threshold_us,
+		 "Poll for commands faster than this in us (0 - off)");
+
+static unsigned int gencmd_poll_window_us = 500;
+module_param(gencmd_poll_window_us, uint, 0644);
+MODULE_PARM_DESC(gencmd_poll_window_us,
+		 "Maximum time spent polling for command completion in us");
+
+static unsigned int gencmd_poll_classes[8];
+static unsigned int gencmd_poll_classes_count = 0;
+module_param_array(gencmd_poll_classes, uint, &gencmd_poll_classes_count,
+		   0644);
+MODULE_PARM_DESC(gencmd_poll_classes,
+		 "Command subsystems (cmd bits 8-14) allowed to poll");
 
 //----------------------
 
-enum leicaefi_gencmd_state {
-	LEICAEFI_GENCMD_IDLE,
-	LEICAEFI_GENCMD_PENDING,
-	LEICAEFI_GENCMD_DONE,
-	LEICAEFI_GENCMD_FAILED,
+#define LEICAEFI_GENCMD_CLASS_COUNT (LEICAEFI_CMD_SUBSYSTEM_MASK + 1)
+
+/* backoff between the command completion polls */
+#define LEICAEFI_GENCMD_POLL_DELAY_MIN_US (10UL)
+#define LEICAEFI_GENCMD_POLL_DELAY_MAX_US (100UL)
+
+DECLARE_EWMA(gencmd_latency, 4, 8)
+
+/* completion statistics of a command subsystem */
+struct leicaefi_gencmd_class_stats {
+	/* execution time in us */
+	struct ewma_gencmd_latency latency;
+	/* synchronous calls finished while polling / sleeping */
+	atomic_t polled;
+	atomic_t slept;
+};
+
+enum leicaefi_reg_cache_class {
+	/* value may change at any time, always read from the chip */
+	LEICAEFI_REG_VOLATILE = 0,
+	/* value may change at any time and reading it has side effects */
+	LEICAEFI_REG_PRECIOUS,
+	/* value does not change while in the same software mode */
+	LEICAEFI_REG_STATIC,
+	/* value is changed only by the host, set/clear register */
+	LEICAEFI_REG_HOST_OWNED,
+};
+
+#define LEICAEFI_REG_COUNT (LEICAEFI_REGNO_MASK + 1)
+
+/* registers not listed here are volatile */
+static const u8 leicaefi_reg_cache_classes[LEICAEFI_REG_COUNT] = {
+	[LEICAEFI_REG_MOD_ID] = LEICAEFI_REG_STATIC,
+	[LEICAEFI_REG_MOD_REGV] = LEICAEFI_REG_STATIC,
+	[LEICAEFI_REG_MOD_FWV] = LEICAEFI_REG_STATIC,
+	[LEICAEFI_REG_MOD_LDRV] = LEICAEFI_REG_STATIC,
+	[LEICAEFI_REG_MOD_HW] = LEICAEFI_REG_STATIC,
+	[LEICAEFI_REG_MOD_IE] = LEICAEFI_REG_HOST_OWNED,
+	[LEICAEFI_REG_MOD_IFG] = LEICAEFI_REG_PRECIOUS,
+	[LEICAEFI_REG_MOD_ERR] = LEICAEFI_REG_PRECIOUS,
+	[LEICAEFI_REG_KEY_DATA] = LEICAEFI_REG_PRECIOUS,
+	[LEICAEFI_REG_PWR_SETTINGS] = LEICAEFI_REG_HOST_OWNED,
+	[LEICAEFI_REG_LED_CTRL1] = LEICAEFI_REG_HOST_OWNED,
+	[LEICAEFI_REG_LED_CTRL2] = LEICAEFI_REG_HOST_OWNED,
+	[LEICAEFI_REG_DBG_LOG] = LEICAEFI_REG_PRECIOUS,
 };
 
 struct leicaefi_chip {
-	struct i2c_client *i2c;
+	struct device *dev;
+	const struct leicaefi_transport_ops *transport;
+	void *transport_context;
+	struct regmap *regmap;
+
+	/*
+	 * Last value of the cached set/clear registers seen on the bus, so
+	 * a register write sends only the changed bits. Used by the regmap
+	 * bus callbacks, which are serialized by the regmap lock.
+	 */
+	u16 sc_values[LEICAEFI_REG_COUNT];
+	DECLARE_BITMAP(sc_valid, LEICAEFI_REG_COUNT);
 
 	unsigned int complete_irq;
 	unsigned int error_irq;
 
+	/* protects the queue and the command being executed */
 	struct mutex gencmd_lock;
-	atomic_t gencmd_state;
-	wait_queue_head_t gencmd_wq;
+	struct list_head gencmd_queue;
+	struct leicaefi_gencmd_request *gencmd_current;
+	/* number of the current command and time it is considered lost */
+	unsigned int gencmd_seq;
+	unsigned long gencmd_deadline;
+	struct delayed_work gencmd_watchdog;
+	/* timed out command may still complete, next one is held back */
+	bool gencmd_draining;
+	/* output of the current command read by the IRQ thread */
+	bool gencmd_prefetch_valid;
+	unsigned int gencmd_prefetch_seq;
+	u16 gencmd_prefetch_data;
+	ktime_t gencmd_start_time;
+	struct leicaefi_gencmd_class_stats
+		gencmd_classes[LEICAEFI_GENCMD_CLASS_COUNT];
+
+	struct leicaefi_irq_chip *irqchip;
+
+	atomic_t gencmd_timeouts;
+	atomic_t gencmd_recoveries;
+
+	struct leicaefi_stats *stats;
 };
 
-static int leicaefi_chip_gencmd_exclusive_lock(struct leicaefi_chip *efichip)
+static bool leicaefi_chip_is_valid_register_number(u8 reg_no)
+{
+	// bits other than register number must not be set
+	return (reg_no & ~LEICAEFI_REGNO_MASK) == 0;
+}
+
+static u8 leicaefi_chip_make_command(u8 reg_no, u8 rwbit, u8 scbit)
+{
+	return (reg_no & LEICAEFI_REGNO_MASK) | rwbit | scbit;
+}
+
+static bool leicaefi_chip_regmap_volatile_reg(struct device *dev,
+					      unsigned int reg)
+{
+	if (reg >= LEICAEFI_REG_COUNT) {
+		return true;
+	}
+
+	switch (leicaefi_reg_cache_classes[reg]) {
+	case LEICAEFI_REG_STATIC:
+	case LEICAEFI_REG_HOST_OWNED:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static bool leicaefi_chip_regmap_precious_reg(struct device *dev,
+					      unsigned int reg)
+{
+	if (reg >= LEICAEFI_REG_COUNT) {
+		return false;
+	}
+
+	return leicaefi_reg_cache_classes[reg] == LEICAEFI_REG_PRECIOUS;
+}
+
+static bool leicaefi_chip_is_sc_cached_reg(unsigned int reg)
 {
-	return mutex_lock_interruptible(&efichip->gencmd_lock);
+	return (reg < LEICAEFI_REG_COUNT) &&
+	       (leicaefi_reg_cache_classes[reg] == LEICAEFI_REG_HOST_OWNED);
 }
 
-static void leicaefi_chip_gencmd_exclusive_unlock(struct leicaefi_chip *efichip)
+/*
+ * The chip supports setting and clearing bits natively (SC bit of the
+ * command), so no read-modify-write cycle is needed. Regmap uses it only
+ * for volatile registers.
+ */
+static int leicaefi_chip_bus_reg_update_bits(void *context, unsigned int reg,
+					     unsigned int mask,
+					     unsigned int val)
 {
-	return mutex_unlock(&efichip->gencmd_lock);
+	struct leicaefi_chip *efichip = context;
+	u16 set_mask = (u16)(mask & val);
+	u16 clear_mask = (u16)(mask & ~val);
+	int rc = 0;
+
+	if (clear_mask) {
+		rc = efichip->transport->write_word(
+			efichip->transport_context,
+			leicaefi_chip_make_command(reg, LEICAEFI_RWBIT_WRITE,
+						   LEICAEFI_SCBIT_CLEAR),
+			clear_mask);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	if (set_mask) {
+		rc = efichip->transport->write_word(
+			efichip->transport_context,
+			leicaefi_chip_make_command(reg, LEICAEFI_RWBIT_WRITE,
+						   LEICAEFI_SCBIT_SET),
+			set_mask);
+	}
+
+	return rc;
+}
+
+/*
+ * A plain write clears the given bits of a set/clear register. Cached
+ * set/clear registers are written by regmap (also in its read-modify-write
+ * cycle of update_bits) with the full register value, which is sent as the
+ * clear and set commands of the bits that differ from the last value.
+ */
+static int leicaefi_chip_bus_reg_write(void *context, unsigned int reg,
+				       unsigned int val)
+{
+	struct leicaefi_chip *efichip = context;
+	u16 value = (u16)val;
+	u16 set_mask = value;
+	u16 clear_mask = (u16)~value;
+	int rc = 0;
+
+	if (!leicaefi_chip_is_sc_cached_reg(reg)) {
+		u8 cmd = leicaefi_chip_make_command(reg, LEICAEFI_RWBIT_WRITE,
+						    LEICAEFI_SCBIT_UNUSED);
+
+		return efichip->transport->write_word(
+			efichip->transport_context, cmd, value);
+	}
+
+	if (test_bit(reg, efichip->sc_valid)) {
+		set_mask &= ~efichip->sc_values[reg];
+		clear_mask &= efichip->sc_values[reg];
+	}
+
+	/* state is unknown until both commands succeed */
+	clear_bit(reg, efichip->sc_valid);
+
+	rc = leicaefi_chip_bus_reg_update_bits(context, reg,
+					       set_mask | clear_mask, value);
+	if (rc == 0) {
+		efichip->sc_values[reg] = value;
+		set_bit(reg, efichip->sc_valid);
+	}
+
+	return rc;
 }
 
-static int leicaefi_chip_set_gencmd_state(struct leicaefi_chip *efichip,
-					  const char *op_info,
-					  int expected_state, int next_state)
+static int leicaefi_chip_bus_reg_read(void *context, unsigned int reg,
+				      unsigned int *val)
 {
-	int prev_value = atomic_cmpxchg(&efichip->gencmd_state, expected_state,
-					next_state);
-	if (prev_value != expected_state) {
-		dev_err(&efichip->i2c->dev,
-			"%s - cannot set operation state for %s (state: %d, target: %d)\n",
-			__func__, op_info, prev_value, next_state);
-		return -LEICAEFI_EINTERNAL;
+	struct leicaefi_chip *efichip = context;
+	u8 cmd = leicaefi_chip_make_command(reg, LEICAEFI_RWBIT_READ,
+					    LEICAEFI_SCBIT_UNUSED);
+	u16 value = 0;
+	int rc = 0;
+
+	rc = efichip->transport->read_word(efichip->transport_context, cmd,
+					   &value);
+	if (rc != 0) {
+		return rc;
+	}
+
+	*val = value;
+
+	if (leicaefi_chip_is_sc_cached_reg(reg)) {
+		efichip->sc_values[reg] = value;
+		set_bit(reg, efichip->sc_valid);
 	}
 
 	return 0;
 }
 
-static bool leicaefi_chip_is_valid_register_number(u8 reg_no)
+static const struct regmap_bus leicaefi_chip_regmap_bus = {
+	.reg_write = leicaefi_chip_bus_reg_write,
+	.reg_read = leicaefi_chip_bus_reg_read,
+	.reg_update_bits = leicaefi_chip_bus_reg_update_bits,
+};
+
+static const struct regmap_config leicaefi_chip_regmap_config = {
+	.name = "leicaefi",
+	.reg_bits = 8,
+	.val_bits = 16,
+	.max_register = LEICAEFI_REGNO_MASK,
+	.volatile_reg = leicaefi_chip_regmap_volatile_reg,
+	.precious_reg = leicaefi_chip_regmap_precious_reg,
+	/* flat cache cannot tell missing entries from zero values */
+	.cache_type = REGCACHE_RBTREE,
+};
+
+void leicaefi_chip_invalidate_cache(struct leicaefi_chip *efichip)
 {
-	// bits other than register number must not be set
-	return (reg_no & ~LEICAEFI_REGNO_MASK) == 0;
+	int rc = 0;
+
+	dev_dbg(efichip->dev, "%s\n", __func__);
+
+	rc = regcache_drop_region(efichip->regmap, 0, LEICAEFI_REGNO_MASK);
+	bitmap_zero(efichip->sc_valid, LEICAEFI_REG_COUNT);
+	if (rc != 0) {
+		dev_warn(efichip->dev,
+			 "%s - dropping register cache failed: %d\n", __func__,
+			 rc);
+	}
+}
+EXPORT_SYMBOL(leicaefi_chip_invalidate_cache);
+
+/*
+ * Regmap updates the cache before the bus write, so after a failed write
+ * the cached value of a set/clear register may not match the chip. It is
+ * dropped and read again on the next access.
+ */
+static void leicaefi_chip_sc_write_failed(struct leicaefi_chip *efichip,
+					  u8 reg_no)
+{
+	if (leicaefi_chip_is_sc_cached_reg(reg_no)) {
+		regcache_drop_region(efichip->regmap, reg_no, reg_no);
+	}
 }
 
-static u8 leicaefi_chip_make_command(u8 reg_no, u8 rwbit, u8 scbit)
+struct regmap *leicaefi_chip_get_regmap(struct leicaefi_chip *efichip)
 {
-	return (reg_no & LEICAEFI_REGNO_MASK) | rwbit | scbit;
+	return efichip->regmap;
 }
+EXPORT_SYMBOL(leicaefi_chip_get_regmap);
 
 int leicaefi_chip_set_bits(struct leicaefi_chip *efichip, u8 reg_no, u16 mask)
 {
-	struct device *dev = &efichip->i2c->dev;
+	struct device *dev = efichip->dev;
+	ktime_t start = ktime_get();
 	int rc = 0;
-	u8 reg = leicaefi_chip_make_command(reg_no, LEICAEFI_RWBIT_WRITE,
-					    LEICAEFI_SCBIT_SET);
 
 	if (!leicaefi_chip_is_valid_register_number(reg_no)) {
 		return -EINVAL;
 	}
 
-	rc = i2c_smbus_write_word_data(efichip->i2c, reg, mask);
+	rc = regmap_update_bits(efichip->regmap, reg_no, mask, mask);
+	if (rc != 0) {
+		leicaefi_chip_sc_write_failed(efichip, reg_no);
+	}
+	leicaefi_stats_record(efichip->stats, LEICAEFI_STATS_OP_SET_BITS, start,
+			      rc, sizeof(mask));
+	trace_leicaefi_reg_set_bits(reg_no, mask, rc, start);
 
 	dev_dbg(dev, "%s - reg=0x%02X val=0x%04X - rc=%d\n", __func__,
 		(unsigned)(reg_no), (unsigned)mask, rc);
 
+	/* mode switch restarts the chip software, forget what we know */
+	if ((rc == 0) && (reg_no == LEICAEFI_REG_FLASH_CTRL) &&
+	    (mask & LEICAEFI_FLASHCTRLBIT_SWITCH)) {
+		leicaefi_chip_invalidate_cache(efichip);
+	}
+
 	return rc;
 }
 EXPORT_SYMBOL(leicaefi_chip_set_bits);
 
 int leicaefi_chip_clear_bits(struct leicaefi_chip *efichip, u8 reg_no, u16 mask)
 {
-	struct device *dev = &efichip->i2c->dev;
+	struct device *dev = efichip->dev;
+	ktime_t start = ktime_get();
 	int rc = 0;
-	u8 reg = leicaefi_chip_make_command(reg_no, LEICAEFI_RWBIT_WRITE,
-					    LEICAEFI_SCBIT_CLEAR);
 
 	if (!leicaefi_chip_is_valid_register_number(reg_no)) {
 		return -EINVAL;
 	}
 
-	rc = i2c_smbus_write_word_data(efichip->i2c, reg, mask);
+	rc = regmap_update_bits(efichip->regmap, reg_no, mask, 0);
+	if (rc != 0) {
+		leicaefi_chip_sc_write_failed(efichip, reg_no);
+	}
+	leicaefi_stats_record(efichip->stats, LEICAEFI_STATS_OP_CLEAR_BITS,
+			      start, rc, sizeof(mask));
+	trace_leicaefi_reg_clear_bits(reg_no, mask, rc, start);
 
 	dev_dbg(dev, "%s - reg=0x%02X val=0x%04X - rc=%d\n", __func__,
 		(unsigned)(reg_no), (unsigned)mask, rc);
@@ -106,18 +403,60 @@ int leicaefi_chip_clear_bits(struct leicaefi_chip *efichip, u8 reg_no, u16 mask)
 }
 EXPORT_SYMBOL(leicaefi_chip_clear_bits);
 
+int leicaefi_chip_update_bits(struct leicaefi_chip *efichip, u8 reg_no,
+			      u16 mask, u16 value)
+{
+	struct device *dev = efichip->dev;
+	ktime_t start = ktime_get();
+	int rc = 0;
+
+	if (!leicaefi_chip_is_valid_register_number(reg_no)) {
+		return -EINVAL;
+	}
+
+	rc = regmap_update_bits(efichip->regmap, reg_no, mask, value);
+	if (rc != 0) {
+		leicaefi_chip_sc_write_failed(efichip, reg_no);
+	}
+	leicaefi_stats_record(efichip->stats, LEICAEFI_STATS_OP_UPDATE_BITS,
+			      start, rc, sizeof(value));
+	trace_leicaefi_reg_update_bits(reg_no, value, rc, start);
+
+	dev_dbg(dev, "%s - reg=0x%02X mask=0x%04X val=0x%04X - rc=%d\n",
+		__func__, (unsigned)(reg_no), (unsigned)mask, (unsigned)value,
+		rc);
+
+	return rc;
+}
+EXPORT_SYMBOL(leicaefi_chip_update_bits);
+
 int leicaefi_chip_write(struct leicaefi_chip *efichip, u8 reg_no, u16 value)
 {
-	struct device *dev = &efichip->i2c->dev;
+	struct device *dev = efichip->dev;
+	ktime_t start = ktime_get();
 	int rc = 0;
-	u8 reg = leicaefi_chip_make_command(reg_no, LEICAEFI_RWBIT_WRITE,
-					    LEICAEFI_SCBIT_UNUSED);
 
 	if (!leicaefi_chip_is_valid_register_number(reg_no)) {
 		return -EINVAL;
 	}
 
-	rc = i2c_smbus_write_word_data(efichip->i2c, reg, value);
+	if (leicaefi_chip_is_sc_cached_reg(reg_no)) {
+		/* plain write to a set/clear register clears the given bits */
+		rc = regmap_update_bits(efichip->regmap, reg_no, value, 0);
+		if (rc != 0) {
+			leicaefi_chip_sc_write_failed(efichip, reg_no);
+		}
+	} else {
+		rc = regmap_write(efichip->regmap, reg_no, value);
+	}
+	leicaefi_stats_record(efichip->stats, LEICAEFI_STATS_OP_WRITE, start,
+			      rc, sizeof(value));
+	trace_leicaefi_reg_write(reg_no, value, rc, start);
+
+	/* chip may not accept the value, reread it next time */
+	if (leicaefi_reg_cache_classes[reg_no] == LEICAEFI_REG_STATIC) {
+		regcache_drop_region(efichip->regmap, reg_no, reg_no);
+	}
 
 	dev_dbg(dev, "%s - reg=0x%02X val=0x%04X - rc=%d\n", __func__,
 		(unsigned)(reg_no), (unsigned)value, rc);
@@ -126,13 +465,27 @@ int leicaefi_chip_write(struct leicaefi_chip *efichip, u8 reg_no, u16 value)
 }
 EXPORT_SYMBOL(leicaefi_chip_write);
 
+static int leicaefi_chip_do_read(struct leicaefi_chip *efichip, u8 reg_no,
+				 u16 *value_ptr)
+{
+	unsigned int value = 0;
+	int rc = 0;
+
+	rc = regmap_read(efichip->regmap, reg_no, &value);
+	if (rc == 0) {
+		*value_ptr = (u16)value;
+	} else {
+		*value_ptr = 0;
+	}
+
+	return rc;
+}
+
 int leicaefi_chip_read(struct leicaefi_chip *efichip, u8 reg_no, u16 *value_ptr)
 {
-	struct device *dev = &efichip->i2c->dev;
+	struct device *dev = efichip->dev;
+	ktime_t start = ktime_get();
 	int rc = 0;
-	s32 value = 0;
-	u8 reg = leicaefi_chip_make_command(reg_no, LEICAEFI_RWBIT_READ,
-					    LEICAEFI_SCBIT_UNUSED);
 
 	if (!leicaefi_chip_is_valid_register_number(reg_no)) {
 		return -EINVAL;
@@ -142,14 +495,10 @@ int leicaefi_chip_read(struct leicaefi_chip *efichip, u8 reg_no, u16 *value_ptr)
 		return -EINVAL;
 	}
 
-	value = i2c_smbus_read_word_data(efichip->i2c, reg);
-	if (value >= 0) {
-		*value_ptr = (u16)value;
-		rc = 0;
-	} else {
-		*value_ptr = 0;
-		rc = (int)value;
-	}
+	rc = leicaefi_chip_do_read(efichip, reg_no, value_ptr);
+	leicaefi_stats_record(efichip->stats, LEICAEFI_STATS_OP_READ, start, rc,
+			      sizeof(*value_ptr));
+	trace_leicaefi_reg_read(reg_no, *value_ptr, rc, start);
 
 	dev_dbg(dev, "%s - reg=0x%02X - rc=%d (val=0x%04X)\n", __func__,
 		(unsigned)(reg_no), rc, (unsigned)*value_ptr);
@@ -158,102 +507,670 @@ int leicaefi_chip_read(struct leicaefi_chip *efichip, u8 reg_no, u16 *value_ptr)
 }
 EXPORT_SYMBOL(leicaefi_chip_read);
 
-static int leicaefi_chip_gencmd_request(struct leicaefi_chip *efichip, u16 cmd,
-					u16 input_data, u16 *output_data_ptr)
+static int leicaefi_chip_read_multi_transfer(struct leicaefi_chip *efichip,
+					     const u8 *regs, u16 *vals,
+					     unsigned int count)
 {
+	u8 cmds[LEICAEFI_CHIP_READ_MULTI_MAX];
+	ktime_t start = ktime_get();
+	unsigned int i = 0;
 	int rc = 0;
-	int state_value = 0;
 
-	rc = leicaefi_chip_set_gencmd_state(efichip, "gencmd_start",
-					    LEICAEFI_GENCMD_IDLE,
-					    LEICAEFI_GENCMD_PENDING);
-	if (rc) {
-		return rc;
+	if (!efichip->transport->read_words) {
+		return -EOPNOTSUPP;
 	}
 
-	if ((leicaefi_chip_write(efichip, LEICAEFI_REG_CMD_DATA, input_data) !=
-	     0) ||
-	    (leicaefi_chip_write(efichip, LEICAEFI_REG_CMD_CTRL, cmd) != 0)) {
-		dev_warn(&efichip->i2c->dev, "%s - request failed\n", __func__);
+	for (i = 0; i < count; ++i) {
+		cmds[i] = leicaefi_chip_make_command(
+			regs[i], LEICAEFI_RWBIT_READ, LEICAEFI_SCBIT_UNUSED);
+	}
+
+	rc = efichip->transport->read_words(efichip->transport_context, cmds,
+					    vals, count);
+
+	/* one event per register, as for separate reads */
+	for (i = 0; i < count; ++i) {
+		trace_leicaefi_reg_read(regs[i], (rc == 0) ? vals[i] : 0, rc,
+					start);
+	}
+
+	return rc;
+}
+
+static int leicaefi_chip_do_read_multi(struct leicaefi_chip *efichip,
+				       const u8 *regs, u16 *vals,
+				       unsigned int count)
+{
+	struct device *dev = efichip->dev;
+	u8 bus_regs[LEICAEFI_CHIP_READ_MULTI_MAX];
+	u16 bus_vals[LEICAEFI_CHIP_READ_MULTI_MAX];
+	unsigned int bus_count = 0;
+	unsigned int i = 0;
+	int rc = 0;
+
+	if (!regs || !vals || (count == 0) ||
+	    (count > LEICAEFI_CHIP_READ_MULTI_MAX)) {
+		return -EINVAL;
+	}
 
-		rc = leicaefi_chip_set_gencmd_state(efichip, "gencmd_reqfail",
-						    LEICAEFI_GENCMD_PENDING,
-						    LEICAEFI_GENCMD_IDLE);
-		if (rc) {
+	for (i = 0; i < count; ++i) {
+		if (!leicaefi_chip_is_valid_register_number(regs[i])) {
+			return -EINVAL;
+		}
+	}
+
+	/* cached registers do not need the bus */
+	for (i = 0; i < count; ++i) {
+		if (leicaefi_chip_regmap_volatile_reg(dev, regs[i])) {
+			bus_regs[bus_count++] = regs[i];
+			continue;
+		}
+
+		rc = leicaefi_chip_do_read(efichip, regs[i], &vals[i]);
+		if (rc != 0) {
 			return rc;
 		}
+	}
 
+	if (bus_count == 0) {
+		return 0;
+	}
+
+	rc = leicaefi_chip_read_multi_transfer(efichip, bus_regs, bus_vals,
+					       bus_count);
+	if (rc == -EOPNOTSUPP) {
+		/* bus cannot combine messages, read one by one */
+		for (i = 0; i < bus_count; ++i) {
+			rc = leicaefi_chip_do_read(efichip, bus_regs[i],
+						   &bus_vals[i]);
+			if (rc != 0) {
+				break;
+			}
+		}
+	}
+
+	dev_dbg(dev, "%s - count=%u bus_count=%u - rc=%d\n", __func__, count,
+		bus_count, rc);
+
+	if (rc != 0) {
+		return rc;
+	}
+
+	bus_count = 0;
+	for (i = 0; i < count; ++i) {
+		if (leicaefi_chip_regmap_volatile_reg(dev, regs[i])) {
+			vals[i] = bus_vals[bus_count++];
+		}
+	}
+
+	return 0;
+}
+
+int leicaefi_chip_read_multi(struct leicaefi_chip *efichip, const u8 *regs,
+			     u16 *vals, unsigned int count)
+{
+	ktime_t start = ktime_get();
+	int rc = 0;
+
+	rc = leicaefi_chip_do_read_multi(efichip, regs, vals, count);
+	if (rc != -EINVAL) {
+		leicaefi_stats_record(efichip->stats,
+				      LEICAEFI_STATS_OP_READ_MULTI, start, rc,
+				      count * sizeof(*vals));
+	}
+
+	return rc;
+}
+EXPORT_SYMBOL(leicaefi_chip_read_multi);
+
+static unsigned int leicaefi_chip_gencmd_class(u16 cmd)
+{
+	return (cmd >> LEICAEFI_CMD_SUBSYSTEM_SHIFT) &
+	       LEICAEFI_CMD_SUBSYSTEM_MASK;
+}
+
+static struct leicaefi_gencmd_class_stats *
+leicaefi_chip_gencmd_stats(struct leicaefi_chip *efichip, u16 cmd)
+{
+	return &efichip->gencmd_classes[leicaefi_chip_gencmd_class(cmd)];
+}
+
+/*
+ * Checks if waiting for the command should start with polling. This is
+ * done only for selected classes of commands known to be fast.
+ */
+static bool leicaefi_chip_gencmd_should_poll(struct leicaefi_chip *efichip,
+					     u16 cmd)
+{
+	struct leicaefi_gencmd_class_stats *stats =
+		leicaefi_chip_gencmd_stats(efichip, cmd);
+	unsigned int threshold_us = gencmd_poll_threshold_us;
+	unsigned int cmd_class = leicaefi_chip_gencmd_class(cmd);
+	unsigned int i = 0;
+
+	if ((threshold_us == 0) || (gencmd_poll_window_us == 0)) {
+		return false;
+	}
+
+	for (i = 0; i < gencmd_poll_classes_count; ++i) {
+		if (gencmd_poll_classes[i] == cmd_class) {
+			/* no samples yet reads as 0 - try polling */
+			return ewma_gencmd_latency_read(&stats->latency) <
+			       threshold_us;
+		}
+	}
+
+	return false;
+}
+
+static int leicaefi_chip_gencmd_start(struct leicaefi_chip *efichip,
+				      struct leicaefi_gencmd_request *req)
+{
+	if ((leicaefi_chip_write(efichip, LEICAEFI_REG_CMD_DATA,
+				 req->input_data) != 0) ||
+	    (leicaefi_chip_write(efichip, LEICAEFI_REG_CMD_CTRL, req->cmd) !=
+	     0)) {
+		dev_warn(efichip->dev, "%s - request failed\n", __func__);
 		return -EIO;
 	}
 
-	/* non-interruptible - it must be finished */
-	wait_event(efichip->gencmd_wq, atomic_read(&efichip->gencmd_state) !=
-					       LEICAEFI_GENCMD_PENDING);
+	return 0;
+}
 
-	state_value = atomic_read(&efichip->gencmd_state);
-	if (state_value == LEICAEFI_GENCMD_DONE) {
-		rc = leicaefi_chip_set_gencmd_state(efichip, "gencmd_done",
-						    LEICAEFI_GENCMD_DONE,
-						    LEICAEFI_GENCMD_IDLE);
-		if (rc) {
-			return rc;
+/*
+ * Starts queued commands until one is accepted by the chip. Requests that
+ * could not be started are moved to the done list.
+ *
+ * Must be called with gencmd_lock held.
+ */
+static void leicaefi_chip_gencmd_start_next(struct leicaefi_chip *efichip,
+					    struct list_head *done)
+{
+	struct leicaefi_gencmd_request *req = NULL;
+
+	while (!efichip->gencmd_current && !efichip->gencmd_draining &&
+	       !list_empty(&efichip->gencmd_queue)) {
+		req = list_first_entry(&efichip->gencmd_queue,
+				       struct leicaefi_gencmd_request, node);
+		list_del_init(&req->node);
+
+		req->result = leicaefi_chip_gencmd_start(efichip, req);
+		if (req->result != 0) {
+			list_add_tail(&req->node, done);
+			continue;
 		}
 
-		if (output_data_ptr != NULL) {
-			if (leicaefi_chip_read(efichip, LEICAEFI_REG_CMD_DATA,
-					       output_data_ptr) != 0) {
-				dev_warn(&efichip->i2c->dev,
-					 "%s - read failed\n", __func__);
-				return -EIO;
-			}
+		efichip->gencmd_current = req;
+		efichip->gencmd_seq++;
+		efichip->gencmd_start_time = ktime_get();
+
+		if (gencmd_timeout_ms > 0) {
+			unsigned long timeout =
+				msecs_to_jiffies(gencmd_timeout_ms);
+
+			efichip->gencmd_deadline = jiffies + timeout;
+			mod_delayed_work(system_wq, &efichip->gencmd_watchdog,
+					 timeout);
 		}
+	}
+}
 
-		return 0;
-	} else if (state_value == LEICAEFI_GENCMD_FAILED) {
-		rc = leicaefi_chip_set_gencmd_state(efichip, "gencmd_fail",
-						    LEICAEFI_GENCMD_FAILED,
-						    LEICAEFI_GENCMD_IDLE);
-		if (rc) {
-			return rc;
+static void leicaefi_chip_gencmd_record(struct leicaefi_chip *efichip,
+					struct leicaefi_gencmd_request *req,
+					unsigned int bytes)
+{
+	leicaefi_stats_record(efichip->stats, LEICAEFI_STATS_OP_GENCMD,
+			      req->submit_time, req->result, bytes);
+
+	if (req->result == 0) {
+		trace_leicaefi_gencmd_complete(req->cmd, req->output_data,
+					       req->result, req->submit_time);
+	} else {
+		trace_leicaefi_gencmd_fail(req->cmd, req->output_data,
+					   req->result, req->submit_time);
+	}
+}
+
+/* Calls completion callbacks, must be called without gencmd_lock held. */
+static void leicaefi_chip_gencmd_notify(struct leicaefi_chip *efichip,
+					struct list_head *done)
+{
+	struct leicaefi_gencmd_request *req = NULL;
+	struct leicaefi_gencmd_request *tmp = NULL;
+	struct leicaefi_gencmd_request *follower = NULL;
+	struct leicaefi_gencmd_request *follower_tmp = NULL;
+
+	list_for_each_entry_safe(req, tmp, done, node) {
+		list_del_init(&req->node);
+
+		/* request may be gone after its callback, followers first */
+		list_for_each_entry_safe(follower, follower_tmp,
+					 &req->followers, node) {
+			list_del_init(&follower->node);
+			follower->result = req->result;
+			follower->output_data = req->output_data;
+			leicaefi_chip_gencmd_record(efichip, follower, 0);
+			follower->complete(follower);
+		}
+
+		/* command, input and output words */
+		leicaefi_chip_gencmd_record(efichip, req,
+					    req->no_output ? 4 : 6);
+		req->complete(req);
+	}
+}
+
+static bool
+leicaefi_chip_gencmd_is_same_read(struct leicaefi_gencmd_request *a,
+				  struct leicaefi_gencmd_request *b)
+{
+	return (a->cmd & LEICAEFI_CMD_READ_FLAG) && (a->cmd == b->cmd) &&
+	       (a->input_data == b->input_data);
+}
+
+/*
+ * Finds queued or executing request the given one could share the result
+ * with. Must be called with gencmd_lock held.
+ */
+static struct leicaefi_gencmd_request *
+leicaefi_chip_gencmd_find_leader(struct leicaefi_chip *efichip,
+				 struct leicaefi_gencmd_request *req)
+{
+	struct leicaefi_gencmd_request *leader = NULL;
+
+	if (efichip->gencmd_current &&
+	    leicaefi_chip_gencmd_is_same_read(efichip->gencmd_current, req)) {
+		return efichip->gencmd_current;
+	}
+
+	list_for_each_entry(leader, &efichip->gencmd_queue, node) {
+		if (leicaefi_chip_gencmd_is_same_read(leader, req)) {
+			return leader;
+		}
+	}
+
+	return NULL;
+}
+
+VISIBLE_IF_KUNIT void
+leicaefi_chip_gencmd_finish(struct leicaefi_chip *efichip, int result)
+{
+	struct leicaefi_gencmd_request *req = NULL;
+	LIST_HEAD(done);
+
+	mutex_lock(&efichip->gencmd_lock);
+
+	req = efichip->gencmd_current;
+	if (!req && efichip->gencmd_draining) {
+		/* late completion of the timed out command, chip is idle now */
+		efichip->gencmd_draining = false;
+		efichip->gencmd_prefetch_valid = false;
+
+		dev_warn(efichip->dev,
+			 "%s - dropped late completion (result: %d)\n",
+			 __func__, result);
+
+		leicaefi_chip_gencmd_start_next(efichip, &done);
+
+		mutex_unlock(&efichip->gencmd_lock);
+
+		leicaefi_chip_gencmd_notify(efichip, &done);
+		return;
+	}
+	if (!req) {
+		mutex_unlock(&efichip->gencmd_lock);
+		dev_err(efichip->dev,
+			"%s - no command in progress (result: %d)\n", __func__,
+			result);
+		return;
+	}
+
+	efichip->gencmd_current = NULL;
+
+	/* output must be read before the next command is started */
+	if ((result == 0) && !req->no_output) {
+		if (efichip->gencmd_prefetch_valid &&
+		    (efichip->gencmd_prefetch_seq == efichip->gencmd_seq)) {
+			req->output_data = efichip->gencmd_prefetch_data;
+		} else if (leicaefi_chip_read(efichip, LEICAEFI_REG_CMD_DATA,
+					      &req->output_data) != 0) {
+			dev_warn(efichip->dev, "%s - read failed\n",
+				 __func__);
+			result = -EIO;
 		}
+	}
+	efichip->gencmd_prefetch_valid = false;
+
+	if (result == 0) {
+		s64 latency_us = ktime_us_delta(ktime_get(),
+						efichip->gencmd_start_time);
+
+		ewma_gencmd_latency_add(
+			&leicaefi_chip_gencmd_stats(efichip, req->cmd)->latency,
+			latency_us > 0 ? latency_us : 1);
+	}
+
+	req->result = result;
+	list_add_tail(&req->node, &done);
+
+	leicaefi_chip_gencmd_start_next(efichip, &done);
+
+	mutex_unlock(&efichip->gencmd_lock);
+
+	leicaefi_chip_gencmd_notify(efichip, &done);
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_chip_gencmd_finish);
+
+bool leicaefi_chip_gencmd_in_progress(struct leicaefi_chip *efichip)
+{
+	return READ_ONCE(efichip->gencmd_current) != NULL;
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_chip_gencmd_in_progress);
+
+void leicaefi_chip_gencmd_prefetched(struct leicaefi_chip *efichip,
+				     u16 output_data)
+{
+	mutex_lock(&efichip->gencmd_lock);
+
+	if (efichip->gencmd_current) {
+		efichip->gencmd_prefetch_valid = true;
+		efichip->gencmd_prefetch_seq = efichip->gencmd_seq;
+		efichip->gencmd_prefetch_data = output_data;
+	}
+
+	mutex_unlock(&efichip->gencmd_lock);
+}
+
+/*
+ * Called when the current command did not finish in time. The completion
+ * interrupt may have been lost so the pending interrupts are processed
+ * first, if the command is still not finished it is aborted.
+ *
+ * The chip may still complete the aborted command and overwrite CMD_DATA,
+ * so the engine is kept draining: the late completion is dropped and only
+ * then (or after gencmd_drain_ms) the next queued command is started.
+ */
+static void leicaefi_chip_gencmd_recover(struct leicaefi_chip *efichip,
+					 unsigned int seq)
+{
+	struct leicaefi_gencmd_request *req = NULL;
+	LIST_HEAD(done);
+
+	if (efichip->irqchip) {
+		leicaefi_irq_poll(efichip->irqchip);
+	}
+
+	mutex_lock(&efichip->gencmd_lock);
+
+	req = efichip->gencmd_current;
+	if (!req || (efichip->gencmd_seq != seq)) {
+		/* finished by the interrupts found pending */
+		mutex_unlock(&efichip->gencmd_lock);
+
+		atomic_inc(&efichip->gencmd_recoveries);
+		dev_warn(efichip->dev,
+			 "%s - recovered lost command interrupt\n", __func__);
+		return;
+	}
 
-		return -LEICAEFI_EGENCMDFAIL;
+	efichip->gencmd_current = NULL;
+	efichip->gencmd_prefetch_valid = false;
+	req->result = -ETIMEDOUT;
+	list_add_tail(&req->node, &done);
+
+	dev_err(efichip->dev, "%s - cmd=0x%04X timed out\n", __func__,
+		(unsigned)req->cmd);
+
+	if (gencmd_drain_ms > 0) {
+		unsigned long timeout = msecs_to_jiffies(gencmd_drain_ms);
+
+		efichip->gencmd_draining = true;
+		efichip->gencmd_deadline = jiffies + timeout;
+		mod_delayed_work(system_wq, &efichip->gencmd_watchdog,
+				 timeout);
 	} else {
-		dev_err(&efichip->i2c->dev,
-			"%s - execution error (state: %d)\n", __func__,
-			state_value);
-		return -LEICAEFI_EINTERNAL;
+		leicaefi_chip_gencmd_start_next(efichip, &done);
+	}
+
+	mutex_unlock(&efichip->gencmd_lock);
+
+	atomic_inc(&efichip->gencmd_timeouts);
+
+	leicaefi_chip_gencmd_notify(efichip, &done);
+}
+
+/*
+ * Called when no late completion of the timed out command arrived within
+ * gencmd_drain_ms. Pending interrupts are processed first so a completion
+ * already signalled is dropped, then the next queued command is started.
+ */
+VISIBLE_IF_KUNIT void
+leicaefi_chip_gencmd_drain_end(struct leicaefi_chip *efichip)
+{
+	LIST_HEAD(done);
+
+	if (efichip->irqchip) {
+		leicaefi_irq_poll(efichip->irqchip);
+	}
+
+	mutex_lock(&efichip->gencmd_lock);
+
+	if (efichip->gencmd_draining) {
+		efichip->gencmd_draining = false;
+		leicaefi_chip_gencmd_start_next(efichip, &done);
+	}
+
+	mutex_unlock(&efichip->gencmd_lock);
+
+	leicaefi_chip_gencmd_notify(efichip, &done);
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_chip_gencmd_drain_end);
+
+static void leicaefi_chip_gencmd_watchdog(struct work_struct *work)
+{
+	struct leicaefi_chip *efichip = container_of(
+		to_delayed_work(work), struct leicaefi_chip, gencmd_watchdog);
+	bool expired = false;
+	bool drained = false;
+	unsigned int seq = 0;
+
+	mutex_lock(&efichip->gencmd_lock);
+
+	if (efichip->gencmd_draining) {
+		if (time_before(jiffies, efichip->gencmd_deadline)) {
+			mod_delayed_work(system_wq, &efichip->gencmd_watchdog,
+					 efichip->gencmd_deadline - jiffies);
+		} else {
+			drained = true;
+		}
+	} else if (efichip->gencmd_current) {
+		if (time_before(jiffies, efichip->gencmd_deadline)) {
+			/* another command was started meanwhile */
+			mod_delayed_work(system_wq, &efichip->gencmd_watchdog,
+					 efichip->gencmd_deadline - jiffies);
+		} else {
+			expired = true;
+			seq = efichip->gencmd_seq;
+		}
+	}
+
+	mutex_unlock(&efichip->gencmd_lock);
+
+	if (expired) {
+		leicaefi_chip_gencmd_recover(efichip, seq);
+	} else if (drained) {
+		leicaefi_chip_gencmd_drain_end(efichip);
 	}
 }
 
+#if IS_ENABLED(CONFIG_KUNIT)
+/* Handles the current command as the watchdog does after its deadline. */
+void leicaefi_chip_gencmd_expire(struct leicaefi_chip *efichip)
+{
+	unsigned int seq = 0;
+
+	mutex_lock(&efichip->gencmd_lock);
+	seq = efichip->gencmd_seq;
+	mutex_unlock(&efichip->gencmd_lock);
+
+	leicaefi_chip_gencmd_recover(efichip, seq);
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_chip_gencmd_expire);
+#endif /* CONFIG_KUNIT */
+
+int leicaefi_chip_gencmd_submit(struct leicaefi_chip *efichip,
+				struct leicaefi_gencmd_request *req)
+{
+	struct leicaefi_gencmd_request *leader = NULL;
+	LIST_HEAD(done);
+
+	if (!req || !req->complete) {
+		return -EINVAL;
+	}
+
+	req->result = 0;
+	req->output_data = 0;
+	req->submit_time = ktime_get();
+	INIT_LIST_HEAD(&req->node);
+	INIT_LIST_HEAD(&req->followers);
+
+	mutex_lock(&efichip->gencmd_lock);
+
+	leader = leicaefi_chip_gencmd_find_leader(efichip, req);
+
+	trace_leicaefi_gencmd_submit(req->cmd, req->input_data, leader != NULL);
+	if (leader) {
+		dev_dbg(efichip->dev,
+			"%s - cmd=0x%04X sharing result of earlier request\n",
+			__func__, (unsigned)req->cmd);
+
+		if (!req->no_output) {
+			leader->no_output = false;
+		}
+		list_add_tail(&req->node, &leader->followers);
+
+		mutex_unlock(&efichip->gencmd_lock);
+		return 0;
+	}
+
+	list_add_tail(&req->node, &efichip->gencmd_queue);
+	leicaefi_chip_gencmd_start_next(efichip, &done);
+
+	mutex_unlock(&efichip->gencmd_lock);
+
+	leicaefi_chip_gencmd_notify(efichip, &done);
+
+	return 0;
+}
+EXPORT_SYMBOL(leicaefi_chip_gencmd_submit);
+
+static void
+leicaefi_chip_gencmd_sync_complete(struct leicaefi_gencmd_request *req)
+{
+	complete((struct completion *)req->context);
+}
+
 int leicaefi_chip_gencmd(struct leicaefi_chip *efichip, u16 cmd, u16 input_data,
 			 u16 *output_data_ptr)
 {
+	struct leicaefi_gencmd_request req;
+	struct completion done;
 	int rc = 0;
 
-	rc = leicaefi_chip_gencmd_exclusive_lock(efichip);
-	if (rc == 0) {
-		rc = leicaefi_chip_gencmd_request(efichip, cmd, input_data,
-						  output_data_ptr);
+	init_completion(&done);
+
+	memset(&req, 0, sizeof(req));
+	req.cmd = cmd;
+	req.input_data = input_data;
+	req.no_output = (output_data_ptr == NULL);
+	req.complete = leicaefi_chip_gencmd_sync_complete;
+	req.context = &done;
 
-		leicaefi_chip_gencmd_exclusive_unlock(efichip);
+	rc = leicaefi_chip_gencmd_submit(efichip, &req);
+	if (rc != 0) {
+		return rc;
 	}
 
-	return rc;
+	if (leicaefi_chip_gencmd_should_poll(efichip, cmd)) {
+		struct leicaefi_gencmd_class_stats *stats =
+			leicaefi_chip_gencmd_stats(efichip, cmd);
+		ktime_t poll_end =
+			ktime_add_us(ktime_get(), gencmd_poll_window_us);
+		unsigned long delay_us = LEICAEFI_GENCMD_POLL_DELAY_MIN_US;
+		bool polled = false;
+
+		/* only IFG is read, other interrupts stay with the thread */
+		while (!completion_done(&done) && efichip->irqchip &&
+		       ktime_before(ktime_get(), poll_end)) {
+			if (leicaefi_irq_poll_gencmd(efichip->irqchip) != 0) {
+				break;
+			}
+			if (completion_done(&done)) {
+				break;
+			}
+
+			usleep_range(delay_us, delay_us * 2);
+			delay_us = min(delay_us * 2,
+				       LEICAEFI_GENCMD_POLL_DELAY_MAX_US);
+		}
+
+		polled = completion_done(&done);
+		if (polled) {
+			atomic_inc(&stats->polled);
+		} else {
+			atomic_inc(&stats->slept);
+		}
+
+		dev_dbg(efichip->dev, "%s - cmd=0x%04X %s\n", __func__,
+			(unsigned)cmd, polled ? "polled" : "waiting for irq");
+	}
+
+	/*
+	 * Non-interruptible, the request is on the stack. Bounded by the
+	 * command watchdog, with gencmd_timeout_ms=0 waits for the chip.
+	 */
+	wait_for_completion(&done);
+
+	if ((req.result == 0) && (output_data_ptr != NULL)) {
+		*output_data_ptr = req.output_data;
+	}
+
+	return req.result;
 }
 EXPORT_SYMBOL(leicaefi_chip_gencmd);
 
+void leicaefi_chip_stats_record(struct leicaefi_chip *efichip,
+				enum leicaefi_stats_op op, ktime_t start,
+				int result, unsigned int bytes)
+{
+	leicaefi_stats_record(efichip->stats, op, start, result, bytes);
+}
+EXPORT_SYMBOL(leicaefi_chip_stats_record);
+
+void leicaefi_chip_create_debugfs(struct leicaefi_chip *efichip,
+				  struct dentry *parent)
+{
+	leicaefi_stats_create_debugfs(efichip->stats, parent);
+}
+
+int leicaefi_chip_poll_irq(struct leicaefi_chip *efichip)
+{
+	if (!efichip->irqchip) {
+		return -ENODEV;
+	}
+
+	return leicaefi_irq_poll(efichip->irqchip);
+}
+EXPORT_SYMBOL(leicaefi_chip_poll_irq);
+
 static irqreturn_t leicaefi_chip_gencmd_complete_irq_handler(int irq,
 							     void *context)
 {
 	struct leicaefi_chip *efichip = context;
 
-	dev_dbg(&efichip->i2c->dev, "%s\n", __func__);
+	dev_dbg(efichip->dev, "%s\n", __func__);
 
-	leicaefi_chip_set_gencmd_state(efichip, "complete_irq",
-				       LEICAEFI_GENCMD_PENDING,
-				       LEICAEFI_GENCMD_DONE);
-	wake_up(&efichip->gencmd_wq);
+	leicaefi_chip_gencmd_finish(efichip, 0);
 
 	return IRQ_HANDLED;
 }
@@ -263,24 +1180,25 @@ static irqreturn_t leicaefi_chip_gencmd_error_irq_handler(int irq,
 {
 	struct leicaefi_chip *efichip = context;
 
-	dev_dbg(&efichip->i2c->dev, "%s\n", __func__);
+	dev_dbg(efichip->dev, "%s\n", __func__);
 
-	leicaefi_chip_set_gencmd_state(efichip, "error_irq",
-				       LEICAEFI_GENCMD_PENDING,
-				       LEICAEFI_GENCMD_FAILED);
-	wake_up(&efichip->gencmd_wq);
+	leicaefi_chip_gencmd_finish(efichip, -LEICAEFI_EGENCMDFAIL);
 
 	return IRQ_HANDLED;
 }
 
-static int leicaefi_add_chip(struct i2c_client *i2c,
+static int leicaefi_add_chip(struct device *dev,
+			     const struct leicaefi_transport_ops *transport,
+			     void *transport_context,
 			     struct leicaefi_chip **efichip)
 {
 	struct leicaefi_chip *chip = NULL;
+	unsigned int i = 0;
 
-	dev_dbg(&i2c->dev, "%s\n", __func__);
+	dev_dbg(dev, "%s\n", __func__);
 
-	if (!efichip) {
+	if (!efichip || !transport || !transport->write_word ||
+	    !transport->read_word) {
 		return -EINVAL;
 	}
 
@@ -289,11 +1207,40 @@ static int leicaefi_add_chip(struct i2c_client *i2c,
 		return -ENOMEM;
 	}
 
-	chip->i2c = i2c;
+	chip->dev = dev;
+	chip->transport = transport;
+	chip->transport_context = transport_context;
+
+	chip->regmap = regmap_init(dev, &leicaefi_chip_regmap_bus, chip,
+				   &leicaefi_chip_regmap_config);
+	if (IS_ERR(chip->regmap)) {
+		int rc = PTR_ERR(chip->regmap);
+
+		dev_err(dev, "%s - cannot create regmap: %d\n", __func__,
+			rc);
+		kfree(chip);
+		return rc;
+	}
+
+	/* statistics are optional */
+	chip->stats = leicaefi_stats_alloc();
+	if (!chip->stats) {
+		dev_warn(dev, "%s - statistics not available\n",
+			 __func__);
+	}
 
 	mutex_init(&chip->gencmd_lock);
-	atomic_set(&chip->gencmd_state, LEICAEFI_GENCMD_IDLE);
-	init_waitqueue_head(&chip->gencmd_wq);
+	INIT_LIST_HEAD(&chip->gencmd_queue);
+	chip->gencmd_current = NULL;
+	INIT_DELAYED_WORK(&chip->gencmd_watchdog,
+			  leicaefi_chip_gencmd_watchdog);
+	atomic_set(&chip->gencmd_timeouts, 0);
+	atomic_set(&chip->gencmd_recoveries, 0);
+	for (i = 0; i < LEICAEFI_GENCMD_CLASS_COUNT; ++i) {
+		ewma_gencmd_latency_init(&chip->gencmd_classes[i].latency);
+		atomic_set(&chip->gencmd_classes[i].polled, 0);
+		atomic_set(&chip->gencmd_classes[i].slept, 0);
+	}
 
 	*efichip = chip;
 
@@ -302,22 +1249,133 @@ static int leicaefi_add_chip(struct i2c_client *i2c,
 
 static int leicaefi_del_chip(struct leicaefi_chip *efichip)
 {
-	dev_dbg(&efichip->i2c->dev, "%s\n", __func__);
+	dev_dbg(efichip->dev, "%s\n", __func__);
 
 	// there should be no need to dispose irq mapping
 	// as irq chip will clean it up anyway
 
+	cancel_delayed_work_sync(&efichip->gencmd_watchdog);
+
+	regmap_exit(efichip->regmap);
+
+	leicaefi_stats_free(efichip->stats);
+
 	kfree(efichip);
 
 	return 0;
 }
 
+static void devm_leicaefi_chip_release(struct device *dev, void *res);
+
+static struct leicaefi_chip *leicaefi_chip_from_dev(struct device *dev)
+{
+	struct leicaefi_chip **res =
+		devres_find(dev, devm_leicaefi_chip_release, NULL, NULL);
+
+	return res ? *res : NULL;
+}
+
+static ssize_t gencmd_timeouts_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct leicaefi_chip *efichip = leicaefi_chip_from_dev(dev);
+
+	if (!efichip) {
+		return -ENODEV;
+	}
+
+	return sprintf(buf, "%d\n", atomic_read(&efichip->gencmd_timeouts));
+}
+static DEVICE_ATTR_RO(gencmd_timeouts);
+
+static ssize_t gencmd_recoveries_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct leicaefi_chip *efichip = leicaefi_chip_from_dev(dev);
+
+	if (!efichip) {
+		return -ENODEV;
+	}
+
+	return sprintf(buf, "%d\n", atomic_read(&efichip->gencmd_recoveries));
+}
+static DEVICE_ATTR_RO(gencmd_recoveries);
+
+/* Lists latency and completion path of the command classes used so far. */
+static ssize_t gencmd_classes_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct leicaefi_chip *efichip = leicaefi_chip_from_dev(dev);
+	struct leicaefi_gencmd_class_stats *stats = NULL;
+	ssize_t len = 0;
+	unsigned int i = 0;
+
+	if (!efichip) {
+		return -ENODEV;
+	}
+
+	for (i = 0; i < LEICAEFI_GENCMD_CLASS_COUNT; ++i) {
+		unsigned long latency_us = 0;
+
+		stats = &efichip->gencmd_classes[i];
+		latency_us = ewma_gencmd_latency_read(&stats->latency);
+		if (latency_us == 0) {
+			continue;
+		}
+
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "0x%02X latency_us=%lu polled=%d slept=%d\n",
+				 i, latency_us, atomic_read(&stats->polled),
+				 atomic_read(&stats->slept));
+	}
+
+	return len;
+}
+static DEVICE_ATTR_RO(gencmd_classes);
+
+static struct attribute *leicaefi_chip_attrs[] = {
+	&dev_attr_gencmd_timeouts.attr,
+	&dev_attr_gencmd_recoveries.attr,
+	&dev_attr_gencmd_classes.attr,
+	NULL,
+};
+
+static const struct attribute_group leicaefi_chip_attr_group = {
+	.attrs = leicaefi_chip_attrs,
+};
+
+/* Stops the watchdog before the IRQ chip it polls is removed. */
+static void leicaefi_chip_gencmd_shutdown(void *data)
+{
+	struct leicaefi_chip *efichip = data;
+
+	cancel_delayed_work_sync(&efichip->gencmd_watchdog);
+	efichip->irqchip = NULL;
+}
+
 int leicaefi_chip_init(struct leicaefi_chip *efichip,
 		       struct leicaefi_irq_chip *irqchip)
 {
-	struct device *dev = &efichip->i2c->dev;
+	struct device *dev = efichip->dev;
 	int rv = 0;
 
+	efichip->irqchip = irqchip;
+
+	rv = devm_add_action_or_reset(dev, leicaefi_chip_gencmd_shutdown,
+				      efichip);
+	if (rv < 0) {
+		dev_err(dev, "%s - cannot add shutdown action: %d\n", __func__,
+			rv);
+		return rv;
+	}
+
+	rv = devm_device_add_group(dev, &leicaefi_chip_attr_group);
+	if (rv < 0) {
+		dev_err(dev, "%s - cannot add sysfs attributes: %d\n",
+			__func__, rv);
+		return rv;
+	}
+
 	efichip->complete_irq =
 		irq_create_mapping(leicaefi_irq_get_domain(irqchip),
 				   LEICAEFI_IRQNO_GENCMD_COMPLETE);
@@ -380,10 +1438,11 @@ static int devm_leicaefi_chip_match(struct device *dev, void *res, void *data)
 	return *r == data;
 }
 
-int devm_leicaefi_add_chip(struct i2c_client *i2c,
+int devm_leicaefi_add_chip(struct device *dev,
+			   const struct leicaefi_transport_ops *transport,
+			   void *transport_context,
 			   struct leicaefi_chip **efichip)
 {
-	struct device *dev = &i2c->dev;
 	struct leicaefi_chip **res_ptr = NULL;
 	struct leicaefi_chip *chip = NULL;
 	int rc = 0;
@@ -402,7 +1461,7 @@ int devm_leicaefi_add_chip(struct i2c_client *i2c,
 		return -ENOMEM;
 	}
 
-	rc = leicaefi_add_chip(i2c, &chip);
+	rc = leicaefi_add_chip(dev, transport, transport_context, &chip);
 	if (rc != 0) {
 		dev_err(dev, "%s - adding chip failed: %d\n", __func__, rc);
 		devres_free(res_ptr);
@@ -416,6 +1475,7 @@ int devm_leicaefi_add_chip(struct i2c_client *i2c,
 
 	return 0;
 }
+EXPORT_SYMBOL_IF_KUNIT(devm_leicaefi_add_chip);
 
 void devm_leicaefi_del_chip(struct device *dev, struct leicaefi_chip *efichip)
 {
@@ -1,9 +1,11 @@
 #include <linux/i2c.h>
+#include <linux/spi/spi.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/mfd/core.h>
 #include <linux/interrupt.h>
 #include <linux/irq.h>
+#include <linux/debugfs.h>
 
 #include <leicaefi-defs.h>
 #include <common/leicaefi-device.h>
@@ -14,72 +16,115 @@ struct leicaefi_device {
 	struct device *dev;
 	struct leicaefi_chip *efichip;
 	struct leicaefi_irq_chip *irq_chip;
+	struct dentry *debugfs_dir;
 };
 
 //------------------------
 
-static const struct resource leicaefi_chr_resources[] = {
-	DEFINE_RES_IRQ_NAMED(LEICAEFI_IRQNO_FLASH, "LEICAEFI_FLASH"),
-	DEFINE_RES_IRQ_NAMED(LEICAEFI_IRQNO_ERR_FLASH, "LEICAEFI_FLASH_ERROR"),
+struct leicaefi_irq_resource {
+	struct resource res;
+	unsigned int users;
 };
 
-static const struct resource leicaefi_keys_resources[] = {
-	DEFINE_RES_IRQ_NAMED(LEICAEFI_IRQNO_KEY, "LEICAEFI_KEY"),
+#define LEICAEFI_IRQ_RESOURCE(id, name, bit, is_error, irq_users)              \
+	{                                                                      \
+		.res = DEFINE_RES_IRQ_NAMED(LEICAEFI_IRQNO_##id, name),        \
+		.users = (irq_users),                                          \
+	},
+
+static const struct leicaefi_irq_resource leicaefi_irq_resources[] = {
+	LEICAEFI_IRQ_TABLE(LEICAEFI_IRQ_RESOURCE)
+};
+
+struct leicaefi_cell_desc {
+	struct mfd_cell cell;
+	/* LEICAEFI_IRQ_USER_* bit, the cell gets only its interrupts */
+	unsigned int irq_user;
 };
 
-static const struct mfd_cell leicaefi_mfd_cells[] = {
+static const struct leicaefi_cell_desc leicaefi_mfd_cells[] = {
 	{
-		.name = "leica-efi-chr",
-		.of_compatible = "leica,efi-chr",
-		.resources = leicaefi_chr_resources,
-		.num_resources = ARRAY_SIZE(leicaefi_chr_resources),
+		.cell = {
+			.name = "leica-efi-chr",
+			.of_compatible = "leica,efi-chr",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_CHR,
 	},
 	{
-		.name = "leica-efi-reboothook",
-		.of_compatible = "leica,efi-reboothook",
+		.cell = {
+			.name = "leica-efi-reboothook",
+			.of_compatible = "leica,efi-reboothook",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_NONE,
 	},
 	{
-		.name = "leica-efi-leds",
-		.of_compatible = "leica,efi-leds",
+		.cell = {
+			.name = "leica-efi-leds",
+			.of_compatible = "leica,efi-leds",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_NONE,
 	},
 	{
-		.name = "leica-efi-keys",
-		.of_compatible = "leica,efi-keys",
-		.resources = leicaefi_keys_resources,
-		.num_resources = ARRAY_SIZE(leicaefi_keys_resources),
+		.cell = {
+			.name = "leica-efi-keys",
+			.of_compatible = "leica,efi-keys",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_KEYS,
+	},
+	{
+		.cell = {
+			.name = "leica-efi-power",
+			.of_compatible = "leica,efi-power",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_POWER,
 	},
 	{
-		.name = "leica-efi-power",
-		.of_compatible = "leica,efi-power",
+		.cell = {
+			.name = "leica-efi-adc",
+			.of_compatible = "leica,efi-adc",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_NONE,
+	},
+	{
+		.cell = {
+			.name = "leica-efi-thermal",
+			.of_compatible = "leica,efi-thermal",
+		},
+		.irq_user = LEICAEFI_IRQ_USER_THERMAL,
 	},
 };
 
-static int leicaefi_i2c_hwcheck(struct i2c_client *i2c)
+static int leicaefi_hwcheck(struct device *dev,
+			    const struct leicaefi_transport_ops *transport,
+			    void *transport_context)
 {
 	u8 mode;
 	u16 platform;
 	u16 project;
 	u16 processor;
-	s32 mod_id;
+	u16 mod_id;
+	int rc;
 
-	dev_dbg(&i2c->dev, "%s\n", __func__);
+	dev_dbg(dev, "%s\n", __func__);
 
-	mod_id = i2c_smbus_read_word_data(i2c, LEICAEFI_REG_MOD_ID);
-	if (mod_id < 0) {
-		return mod_id;
+	rc = transport->read_word(transport_context,
+				  LEICAEFI_REG_MOD_ID | LEICAEFI_RWBIT_READ,
+				  &mod_id);
+	if (rc != 0) {
+		return rc;
 	}
 
 	mode = (mod_id >> LEICAEFI_MODID_MODE_SHIFT) & LEICAEFI_MODID_MODE_MASK;
-	dev_info(&i2c->dev, "Current software mode: %s\n",
+	dev_info(dev, "Current software mode: %s\n",
 		 (mode == LEICAEFI_MODID_MODE_FIRMWARE) ? "Firmware" :
 							  "Loader");
 
 	platform = (mod_id >> LEICAEFI_MODID_PLATFORM_SHIFT) &
 		   LEICAEFI_MODID_PLATFORM_MASK;
 	if (platform == LEICAEFI_MODID_PLATFORM_SYSTEM1500) {
-		dev_info(&i2c->dev, "Detected platform: System1500\n");
+		dev_info(dev, "Detected platform: System1500\n");
 	} else {
-		dev_info(&i2c->dev, "Unsupported platform: %d\n",
+		dev_info(dev, "Unsupported platform: %d\n",
 			 (int)platform);
 		return -EINVAL;
 	}
@@ -87,18 +132,18 @@ static int leicaefi_i2c_hwcheck(struct i2c_client *i2c)
 	project = (mod_id >> LEICAEFI_MODID_PROJECT_SHIFT) &
 		  LEICAEFI_MODID_PROJECT_MASK;
 	if (project == LEICAEFI_MODID_PROJECT_SKYMASTER) {
-		dev_info(&i2c->dev, "Detected project: Skymaster\n");
+		dev_info(dev, "Detected project: Skymaster\n");
 	} else {
-		dev_info(&i2c->dev, "Unsupported project: %d\n", (int)project);
+		dev_info(dev, "Unsupported project: %d\n", (int)project);
 		return -EINVAL;
 	}
 
 	processor = (mod_id >> LEICAEFI_MODID_PROCESSOR_SHIFT) &
 		    LEICAEFI_MODID_PROCESSOR_MASK;
 	if (processor == LEICAEFI_MODID_PROCESSOR_EFI) {
-		dev_info(&i2c->dev, "Detected processor: EFI\n");
+		dev_info(dev, "Detected processor: EFI\n");
 	} else {
-		dev_info(&i2c->dev, "Unsupported processor: %d\n",
+		dev_info(dev, "Unsupported processor: %d\n",
 			 (int)processor);
 		return -EINVAL;
 	}
@@ -168,6 +213,30 @@ static int leicaefi_print_info(struct leicaefi_device *efidev)
 	return 0;
 }
 
+/* Fills the resources of the interrupts used by the cell. */
+static unsigned int
+leicaefi_cell_resources(const struct leicaefi_cell_desc *desc,
+			struct resource *resources)
+{
+	const struct leicaefi_irq_resource *irq_res = NULL;
+	unsigned int count = 0;
+	int i = 0;
+
+	for (i = 0; i < ARRAY_SIZE(leicaefi_irq_resources); ++i) {
+		irq_res = &leicaefi_irq_resources[i];
+		if (!(irq_res->users & desc->irq_user)) {
+			continue;
+		}
+
+		if (resources) {
+			resources[count] = irq_res->res;
+		}
+		++count;
+	}
+
+	return count;
+}
+
 static int leicaefi_add_mfd_devices(struct leicaefi_device *efidev)
 {
 	// TODO: the logic below is to pass the efichip to child devices
@@ -179,20 +248,37 @@ static int leicaefi_add_mfd_devices(struct leicaefi_device *efidev)
 		leicaefi_irq_get_domain(efidev->irq_chip);
 	const int cells_count = ARRAY_SIZE(leicaefi_mfd_cells);
 	struct mfd_cell *cells = NULL;
+	struct resource *resources = NULL;
+	unsigned int resources_count = 0;
 	struct leicaefi_platform_data pdata;
 
 	memset(&pdata, 0, sizeof(pdata));
 	pdata.efichip = efidev->efichip;
 
-	/* copying as the original is const */
-	cells = devm_kzalloc(efidev->dev, sizeof(leicaefi_mfd_cells),
+	for (i = 0; i < cells_count; ++i) {
+		resources_count +=
+			leicaefi_cell_resources(&leicaefi_mfd_cells[i], NULL);
+	}
+
+	/* the cells and resources are copied when the devices are added */
+	cells = devm_kcalloc(efidev->dev, cells_count, sizeof(*cells),
 			     GFP_KERNEL);
-	if (cells == NULL) {
+	resources = devm_kcalloc(efidev->dev, max(resources_count, 1U),
+				 sizeof(*resources), GFP_KERNEL);
+	if ((cells == NULL) || (resources == NULL)) {
+		devm_kfree(efidev->dev, cells);
+		devm_kfree(efidev->dev, resources);
 		return -ENOMEM;
 	}
 
-	memcpy(cells, leicaefi_mfd_cells, sizeof(leicaefi_mfd_cells));
+	resources_count = 0;
 	for (i = 0; i < cells_count; ++i) {
+		cells[i] = leicaefi_mfd_cells[i].cell;
+		cells[i].resources = &resources[resources_count];
+		cells[i].num_resources = leicaefi_cell_resources(
+			&leicaefi_mfd_cells[i], &resources[resources_count]);
+		resources_count += cells[i].num_resources;
+
 		/* assigning local variable as this memory will be copied */
 		cells[i].platform_data = &pdata;
 		cells[i].pdata_size = sizeof(pdata);
@@ -203,49 +289,72 @@ static int leicaefi_add_mfd_devices(struct leicaefi_device *efidev)
 				   0, /* irq_base */
 				   irq_domain);
 
+	devm_kfree(efidev->dev, resources);
 	devm_kfree(efidev->dev, cells);
 
 	return ret;
 }
 
-static int leicaefi_i2c_probe(struct i2c_client *i2c)
+static void leicaefi_remove_debugfs(void *data)
+{
+	struct leicaefi_device *efidev = data;
+
+	debugfs_remove_recursive(efidev->debugfs_dir);
+	efidev->debugfs_dir = NULL;
+}
+
+static int leicaefi_add_debugfs(struct leicaefi_device *efidev)
+{
+	/* debugfs errors are not fatal, the functions accept error values */
+	efidev->debugfs_dir = debugfs_create_dir(dev_name(efidev->dev), NULL);
+
+	leicaefi_chip_create_debugfs(efidev->efichip, efidev->debugfs_dir);
+
+	return devm_add_action_or_reset(efidev->dev, leicaefi_remove_debugfs,
+					efidev);
+}
+
+static int leicaefi_probe(struct device *dev, int irq,
+			  const struct leicaefi_transport_ops *transport,
+			  void *transport_context)
 {
 	struct leicaefi_device *efidev = NULL;
 	int ret = 0;
 
-	dev_dbg(&i2c->dev, "%s\n", __func__);
+	dev_dbg(dev, "%s\n", __func__);
 
-	ret = leicaefi_i2c_hwcheck(i2c);
+	ret = leicaefi_hwcheck(dev, transport, transport_context);
 	if (ret != 0) {
-		dev_err(&i2c->dev, "HW check failed: %d\n", ret);
+		dev_err(dev, "HW check failed: %d\n", ret);
 		return ret;
 	}
 
-	if (!i2c->irq) {
-		dev_err(&i2c->dev, "No IRQ configured\n");
+	if (!irq) {
+		dev_err(dev, "No IRQ configured\n");
 		return -EINVAL;
 	}
 
-	efidev = devm_kzalloc(&i2c->dev, sizeof(*efidev), GFP_KERNEL);
+	efidev = devm_kzalloc(dev, sizeof(*efidev), GFP_KERNEL);
 	if (efidev == NULL) {
-		dev_err(&i2c->dev, "Cannot allocate memory for the driver\n");
+		dev_err(dev, "Cannot allocate memory for the driver\n");
 		return -ENOMEM;
 	}
 
-	i2c_set_clientdata(i2c, efidev);
-	efidev->dev = &i2c->dev;
+	dev_set_drvdata(dev, efidev);
+	efidev->dev = dev;
 
-	ret = devm_leicaefi_add_chip(i2c, &efidev->efichip);
+	ret = devm_leicaefi_add_chip(efidev->dev, transport, transport_context,
+				     &efidev->efichip);
 	if (ret) {
 		dev_err(efidev->dev, "Failed to add EFI chip: %d\n", ret);
 		return ret;
 	}
 
-	ret = devm_leicaefi_add_irq_chip(efidev->dev, i2c->irq, efidev->efichip,
+	ret = devm_leicaefi_add_irq_chip(efidev->dev, irq, efidev->efichip,
 					 &efidev->irq_chip);
 	if (ret) {
 		dev_err(efidev->dev, "Failed to add IRQ chip for irq %d: %d\n",
-			i2c->irq, ret);
+			irq, ret);
 		return ret;
 	}
 
@@ -255,6 +364,13 @@ static int leicaefi_i2c_probe(struct i2c_client *i2c)
 		return ret;
 	}
 
+	ret = leicaefi_add_debugfs(efidev);
+	if (ret) {
+		dev_err(efidev->dev, "Failed to add debugfs entries: %d\n",
+			ret);
+		return ret;
+	}
+
 	ret = leicaefi_add_mfd_devices(efidev);
 	if (ret) {
 		dev_err(efidev->dev, "Failed to add mfd devices: %d\n", ret);
@@ -270,6 +386,12 @@ static int leicaefi_i2c_probe(struct i2c_client *i2c)
 	return 0;
 }
 
+static int leicaefi_i2c_probe(struct i2c_client *i2c)
+{
+	return leicaefi_probe(&i2c->dev, i2c->irq,
+			      &leicaefi_transport_smbus_ops, i2c);
+}
+
 static int leicaefi_i2c_remove(struct i2c_client *i2c)
 {
 	dev_dbg(&i2c->dev, "%s\n", __func__);
@@ -292,6 +414,14 @@ static const struct of_device_id leicaefi_of_match[] = {
 
 MODULE_DEVICE_TABLE(of, leicaefi_of_match);
 
+// Used when instantiated without device tree (e.g. by the emulator)
+static const struct i2c_device_id leicaefi_i2c_id[] = {
+	{ "leica-efi", 0 },
+	{},
+};
+
+MODULE_DEVICE_TABLE(i2c, leicaefi_i2c_id);
+
 // I2C driver definition
 static struct i2c_driver leicaefi_i2c_driver = {
 	.driver =
@@ -301,9 +431,88 @@ static struct i2c_driver leicaefi_i2c_driver = {
 		},
 	.probe_new = leicaefi_i2c_probe,
 	.remove = leicaefi_i2c_remove,
+	.id_table = leicaefi_i2c_id,
 };
 
-module_i2c_driver(leicaefi_i2c_driver);
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+
+static int leicaefi_spi_probe(struct spi_device *spi)
+{
+	int ret = 0;
+
+	dev_dbg(&spi->dev, "%s\n", __func__);
+
+	spi->bits_per_word = 8;
+	ret = spi_setup(spi);
+	if (ret != 0) {
+		dev_err(&spi->dev, "SPI setup failed: %d\n", ret);
+		return ret;
+	}
+
+	return leicaefi_probe(&spi->dev, spi->irq, &leicaefi_transport_spi_ops,
+			      spi);
+}
+
+static int leicaefi_spi_remove(struct spi_device *spi)
+{
+	dev_dbg(&spi->dev, "%s\n", __func__);
+
+	// nothing to do now, devm used to handle resources
+
+	return 0;
+}
+
+static const struct spi_device_id leicaefi_spi_id[] = {
+	{ "leica-efi", 0 },
+	{},
+};
+
+MODULE_DEVICE_TABLE(spi, leicaefi_spi_id);
+
+// SPI driver definition
+static struct spi_driver leicaefi_spi_driver = {
+	.driver =
+		{
+			.name = "leica-efi",
+			.of_match_table = leicaefi_of_match,
+		},
+	.probe = leicaefi_spi_probe,
+	.remove = leicaefi_spi_remove,
+	.id_table = leicaefi_spi_id,
+};
+
+#endif
+
+static int __init leicaefi_init(void)
+{
+	int ret = 0;
+
+	ret = i2c_add_driver(&leicaefi_i2c_driver);
+	if (ret != 0) {
+		return ret;
+	}
+
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+	ret = spi_register_driver(&leicaefi_spi_driver);
+	if (ret != 0) {
+		i2c_del_driver(&leicaefi_i2c_driver);
+		return ret;
+	}
+#endif
+
+	return 0;
+}
+
+static void __exit leicaefi_exit(void)
+{
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+	spi_unregister_driver(&leicaefi_spi_driver);
+#endif
+	i2c_del_driver(&leicaefi_i2c_driver);
+}
+
+module_init(leicaefi_init);
+module_exit(leicaefi_exit);
 
 // Module information
 MODULE_DESCRIPTION("Leica EFI Driver");
@@ -1,43 +1,29 @@
 #include <linux/irq.h>
 #include <linux/irqdomain.h>
 #include <linux/interrupt.h>
+#include <kunit/visibility.h>
 
 #include <core/leicaefi-irq.h>
-#include <common/leicaefi-chip.h>
+#include <core/leicaefi-chip-internal.h>
 #include <leicaefi-defs.h>
 
+#include <trace/events/leicaefi.h>
+
 struct leicaefi_irq_descriptor {
 	u16 reg_mask;
 	bool is_error;
 };
 
-static struct leicaefi_irq_descriptor leicaefi_irq_descriptors[LEICAEFI_TOTAL_IRQ_COUNT] = {
-    [LEICAEFI_IRQNO_FLASH] =
-    {
-		.is_error = false,
-		.reg_mask = LEICAEFI_IRQBIT_FLASH,
-	},
-	[LEICAEFI_IRQNO_ERR_FLASH] =
-	{
-		.is_error = true,
-        .reg_mask = LEICAEFI_ERRBIT_FLASH,
+#define LEICAEFI_IRQ_DESCRIPTOR(id, name, bit, error, users)                   \
+	[LEICAEFI_IRQNO_##id] = {                                              \
+		.reg_mask = (bit),                                             \
+		.is_error = (error),                                           \
 	},
-    [LEICAEFI_IRQNO_KEY] =
-    {
-        .is_error = false,
-        .reg_mask = LEICAEFI_IRQBIT_KEY,
-    },
-    [LEICAEFI_IRQNO_GENCMD_COMPLETE] =
-    {
-        .is_error = false,
-        .reg_mask = LEICAEFI_IRQBIT_GCC,
-    },
-    [LEICAEFI_IRQNO_GENCMD_ERROR] =
-    {
-        .is_error = true,
-        .reg_mask = LEICAEFI_IRQBIT_GCC,
-    },
-};
+
+static const struct leicaefi_irq_descriptor
+	leicaefi_irq_descriptors[LEICAEFI_TOTAL_IRQ_COUNT] = {
+		LEICAEFI_IRQ_TABLE(LEICAEFI_IRQ_DESCRIPTOR)
+	};
 
 struct leicaefi_irq_chip {
 	struct device *dev;
@@ -45,6 +31,10 @@ struct leicaefi_irq_chip {
 	struct leicaefi_chip *efichip;
 
 	struct mutex lock;
+	/* serializes reading IFG/ERR and dispatching the interrupts */
+	struct mutex dispatch_lock;
+	/* IFG flags read by a command poll, left for the IRQ thread */
+	u16 ifg_pending;
 
 	struct irq_domain *domain;
 	bool irq_requested;
@@ -63,34 +53,55 @@ static void leicaefi_irq_chip_lock(struct irq_data *data)
 	mutex_lock(&chip->lock);
 }
 
-static void leicaefi_irq_chip_sync_unlock(struct irq_data *data)
+/*
+ * Applies the requested interrupt states to the current ones and returns
+ * the MOD_IE bits to set and to clear. Interrupts of the ERR register have
+ * no enable bits, they are filtered when dispatched.
+ */
+VISIBLE_IF_KUNIT void leicaefi_irq_mask_changes(bool *mask_current,
+						const bool *mask_requested,
+						u16 *enable_mask,
+						u16 *disable_mask)
 {
-	struct leicaefi_irq_chip *chip = irq_data_get_irq_chip_data(data);
 	int i = 0;
-	u16 ie_enable_mask = 0;
-	u16 ie_disable_mask = 0;
-	int rc = 0;
 
-	dev_dbg(chip->dev, "%s\n", __func__);
+	*enable_mask = 0;
+	*disable_mask = 0;
 
-	/* process changes */
 	for (i = 0; i < LEICAEFI_TOTAL_IRQ_COUNT; ++i) {
-		if (chip->irq_mask_current[i] == chip->irq_mask_requested[i]) {
+		if (mask_current[i] == mask_requested[i]) {
 			continue;
 		}
 
-		chip->irq_mask_current[i] = chip->irq_mask_requested[i];
+		mask_current[i] = mask_requested[i];
 
 		if (leicaefi_irq_descriptors[i].is_error) {
 			continue;
 		}
 
-		if (chip->irq_mask_current[i]) {
-			ie_enable_mask |= leicaefi_irq_descriptors[i].reg_mask;
+		if (mask_current[i]) {
+			*enable_mask |= leicaefi_irq_descriptors[i].reg_mask;
 		} else {
-			ie_disable_mask |= leicaefi_irq_descriptors[i].reg_mask;
+			*disable_mask |= leicaefi_irq_descriptors[i].reg_mask;
 		}
 	}
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_irq_mask_changes);
+
+static void leicaefi_irq_chip_sync_unlock(struct irq_data *data)
+{
+	struct leicaefi_irq_chip *chip = irq_data_get_irq_chip_data(data);
+	int i = 0;
+	u16 ie_enable_mask = 0;
+	u16 ie_disable_mask = 0;
+	int rc = 0;
+
+	dev_dbg(chip->dev, "%s\n", __func__);
+
+	/* process changes */
+	leicaefi_irq_mask_changes(chip->irq_mask_current,
+				  chip->irq_mask_requested, &ie_enable_mask,
+				  &ie_disable_mask);
 
 	/* update interrupt regiter */
 	dev_dbg(chip->dev,
@@ -212,9 +223,12 @@ static const struct irq_domain_ops leicaefi_irq_domain_ops = {
 	.xlate = irq_domain_xlate_onetwocell,
 };
 
-static irqreturn_t leicaefi_irq_thread(int irq, void *cookie)
+static int leicaefi_irq_dispatch(struct leicaefi_irq_chip *chip)
 {
-	struct leicaefi_irq_chip *chip = cookie;
+	static const u8 regs[] = { LEICAEFI_REG_MOD_IFG, LEICAEFI_REG_MOD_ERR,
+				   LEICAEFI_REG_CMD_DATA };
+	u16 values[ARRAY_SIZE(regs)] = { 0 };
+	unsigned int count = ARRAY_SIZE(regs);
 	u16 ifg_value = 0;
 	u16 err_value = 0;
 	int rc = 0;
@@ -222,24 +236,32 @@ static irqreturn_t leicaefi_irq_thread(int irq, void *cookie)
 
 	dev_dbg(chip->dev, "%s\n", __func__);
 
-	/* read the interrupts */
-	rc = leicaefi_chip_read(chip->efichip, LEICAEFI_REG_MOD_IFG,
-				&ifg_value);
+	mutex_lock(&chip->dispatch_lock);
+
+	/* command output is fetched only if a command is executed */
+	if (!leicaefi_chip_gencmd_in_progress(chip->efichip)) {
+		--count;
+	}
+
+	/* read the interrupts, errors and command output in one transfer */
+	rc = leicaefi_chip_read_multi(chip->efichip, regs, values, count);
+	trace_leicaefi_irq_dispatch(values[0], values[1], rc);
 	if (rc != 0) {
-		dev_err(chip->dev, "%s - failed to read IFG register: %d\n",
+		mutex_unlock(&chip->dispatch_lock);
+		dev_err(chip->dev,
+			"%s - failed to read IFG/ERR registers: %d\n",
 			__func__, rc);
-		return IRQ_HANDLED;
+		return rc;
 	}
 
-	if (ifg_value & LEICAEFI_IRQBIT_ERR) {
-		rc = leicaefi_chip_read(chip->efichip, LEICAEFI_REG_MOD_ERR,
-					&err_value);
-		if (rc != 0) {
-			dev_err(chip->dev,
-				"%s - failed to read ERR register: %d\n",
-				__func__, rc);
-			return IRQ_HANDLED;
-		}
+	/* flags consumed by a command poll are processed now */
+	ifg_value = values[0] | chip->ifg_pending;
+	err_value = values[1];
+	chip->ifg_pending = 0;
+
+	/* output is valid if the command was complete before it was read */
+	if ((count == ARRAY_SIZE(regs)) && (ifg_value & LEICAEFI_IRQBIT_GCC)) {
+		leicaefi_chip_gencmd_prefetched(chip->efichip, values[2]);
 	}
 
 	/* process interrupts */
@@ -261,9 +283,77 @@ static irqreturn_t leicaefi_irq_thread(int irq, void *cookie)
 		}
 	}
 
+	mutex_unlock(&chip->dispatch_lock);
+
+	return 0;
+}
+
+static irqreturn_t leicaefi_irq_thread(int irq, void *cookie)
+{
+	struct leicaefi_irq_chip *chip = cookie;
+
+	leicaefi_irq_dispatch(chip);
+
 	return IRQ_HANDLED;
 }
 
+int leicaefi_irq_poll(struct leicaefi_irq_chip *irqchip)
+{
+	dev_dbg(irqchip->dev, "%s\n", __func__);
+
+	return leicaefi_irq_dispatch(irqchip);
+}
+
+int leicaefi_irq_poll_gencmd(struct leicaefi_irq_chip *irqchip)
+{
+	static const u8 regs[] = { LEICAEFI_REG_MOD_IFG,
+				   LEICAEFI_REG_CMD_DATA };
+	u16 values[ARRAY_SIZE(regs)] = { 0 };
+	unsigned int count = ARRAY_SIZE(regs);
+	u16 ifg_value = 0;
+	bool wake = false;
+	int rc = 0;
+
+	mutex_lock(&irqchip->dispatch_lock);
+
+	if (!leicaefi_chip_gencmd_in_progress(irqchip->efichip)) {
+		--count;
+	}
+
+	rc = leicaefi_chip_read_multi(irqchip->efichip, regs, values, count);
+	if (rc != 0) {
+		mutex_unlock(&irqchip->dispatch_lock);
+		return rc;
+	}
+
+	ifg_value = values[0] | irqchip->ifg_pending;
+
+	if (ifg_value & LEICAEFI_IRQBIT_GCC) {
+		if (count == ARRAY_SIZE(regs)) {
+			leicaefi_chip_gencmd_prefetched(irqchip->efichip,
+							values[1]);
+		}
+		if (irqchip->irq_mask_current[LEICAEFI_IRQNO_GENCMD_COMPLETE]) {
+			handle_nested_irq(irq_find_mapping(
+				irqchip->domain,
+				LEICAEFI_IRQNO_GENCMD_COMPLETE));
+		}
+		ifg_value &= ~LEICAEFI_IRQBIT_GCC;
+	}
+
+	/* IFG is cleared on read, the other flags are left for the thread */
+	irqchip->ifg_pending = ifg_value;
+	wake = (ifg_value != 0) && irqchip->irq_requested;
+
+	mutex_unlock(&irqchip->dispatch_lock);
+
+	if (wake) {
+		irq_wake_thread(irqchip->irq, irqchip);
+	}
+
+	return 0;
+}
+
 static int leicaefi_irq_chip_init(struct leicaefi_irq_chip *chip)
 {
 	int rc = 0;
@@ -272,6 +362,7 @@ static int leicaefi_irq_chip_init(struct leicaefi_irq_chip *chip)
 		LEICAEFI_TOTAL_IRQ_COUNT);
 
 	mutex_init(&chip->lock);
+	mutex_init(&chip->dispatch_lock);
 
 	chip->domain = irq_domain_add_linear(chip->dev->of_node,
 					     LEICAEFI_TOTAL_IRQ_COUNT,
@@ -294,7 +385,9 @@ static int leicaefi_irq_chip_init(struct leicaefi_irq_chip *chip)
 
 	/* initialize the IRQs */
 	{
-		u16 value;
+		static const u8 regs[] = { LEICAEFI_REG_MOD_IFG,
+					   LEICAEFI_REG_MOD_ERR };
+		u16 values[ARRAY_SIZE(regs)];
 
 		/* - clear all interrupts */
 		rc = leicaefi_chip_clear_bits(chip->efichip,
@@ -307,19 +400,11 @@ static int leicaefi_irq_chip_init(struct leicaefi_irq_chip *chip)
 		}
 
 		/* - clear pending interrupts */
-		rc = leicaefi_chip_read(chip->efichip, LEICAEFI_REG_MOD_IFG,
-					&value);
-		if (rc != 0) {
-			dev_err(chip->dev,
-				"%s - failed to clear IFG register: %d\n",
-				__func__, rc);
-			return rc;
-		}
-		rc = leicaefi_chip_read(chip->efichip, LEICAEFI_REG_MOD_ERR,
-					&value);
+		rc = leicaefi_chip_read_multi(chip->efichip, regs, values,
+					      ARRAY_SIZE(regs));
 		if (rc != 0) {
 			dev_err(chip->dev,
-				"%s - failed to clear ERR register: %d\n",
+				"%s - failed to clear IFG/ERR registers: %d\n",
 				__func__, rc);
 			return rc;
 		}
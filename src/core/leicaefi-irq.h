@@ -5,13 +5,7 @@
 #include <linux/irqdomain.h>
 
 #include <common/leicaefi-chip.h>
-
-#define LEICAEFI_IRQNO_FLASH (0)
-#define LEICAEFI_IRQNO_ERR_FLASH (1)
-#define LEICAEFI_IRQNO_KEY (2)
-#define LEICAEFI_IRQNO_GENCMD_COMPLETE (3)
-#define LEICAEFI_IRQNO_GENCMD_ERROR (4)
-#define LEICAEFI_TOTAL_IRQ_COUNT (5)
+#include <common/leicaefi-irqs.h>
 
 struct leicaefi_irq_chip;
 
@@ -23,6 +17,18 @@ int leicaefi_del_irq_chip(struct leicaefi_irq_chip *irqchip);
 
 struct irq_domain *leicaefi_irq_get_domain(struct leicaefi_irq_chip *irqchip);
 
+/*
+ * Reads the pending interrupts and dispatches them as the IRQ thread does.
+ * Used to recover from interrupts lost on the way to the host.
+ */
+int leicaefi_irq_poll(struct leicaefi_irq_chip *irqchip);
+
+/*
+ * Reads only IFG and handles the command completion. The other interrupts
+ * found are dispatched by the IRQ thread.
+ */
+int leicaefi_irq_poll_gencmd(struct leicaefi_irq_chip *irqchip);
+
 int devm_leicaefi_add_irq_chip(struct device *dev, int irq,
 			       struct leicaefi_chip *efichip,
 			       struct leicaefi_irq_chip **irqchip);
@@ -30,4 +36,9 @@ int devm_leicaefi_add_irq_chip(struct device *dev, int irq,
 void devm_leicaefi_del_irq_chip(struct device *dev, int irq,
 				struct leicaefi_irq_chip *irqchip);
 
+#if IS_ENABLED(CONFIG_KUNIT)
+void leicaefi_irq_mask_changes(bool *mask_current, const bool *mask_requested,
+			       u16 *enable_mask, u16 *disable_mask);
+#endif /* CONFIG_KUNIT */
+
 #endif /*_LINUX_LEICAEFI_IRQ_H*/
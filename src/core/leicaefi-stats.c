@@ -0,0 +1,193 @@
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+
+#include <core/leicaefi-stats.h>
+
+/* bucket 0 is below 1us, bucket N is [2^(N-1), 2^N) us */
+#define LEICAEFI_STATS_BUCKETS (24)
+
+struct leicaefi_stats_cpu {
+	unsigned long count[LEICAEFI_STATS_OP_COUNT];
+	unsigned long errors[LEICAEFI_STATS_OP_COUNT];
+	unsigned long bytes[LEICAEFI_STATS_OP_COUNT];
+	unsigned long hist[LEICAEFI_STATS_OP_COUNT][LEICAEFI_STATS_BUCKETS];
+};
+
+struct leicaefi_stats {
+	struct leicaefi_stats_cpu __percpu *cpu;
+};
+
+static const char *const leicaefi_stats_op_names[LEICAEFI_STATS_OP_COUNT] = {
+	[LEICAEFI_STATS_OP_READ] = "read",
+	[LEICAEFI_STATS_OP_READ_MULTI] = "read_multi",
+	[LEICAEFI_STATS_OP_WRITE] = "write",
+	[LEICAEFI_STATS_OP_SET_BITS] = "set_bits",
+	[LEICAEFI_STATS_OP_CLEAR_BITS] = "clear_bits",
+	[LEICAEFI_STATS_OP_UPDATE_BITS] = "update_bits",
+	[LEICAEFI_STATS_OP_GENCMD] = "gencmd",
+	[LEICAEFI_STATS_OP_FLASH] = "flash",
+};
+
+struct leicaefi_stats *leicaefi_stats_alloc(void)
+{
+	struct leicaefi_stats *stats = NULL;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats) {
+		return NULL;
+	}
+
+	stats->cpu = alloc_percpu(struct leicaefi_stats_cpu);
+	if (!stats->cpu) {
+		kfree(stats);
+		return NULL;
+	}
+
+	return stats;
+}
+
+void leicaefi_stats_free(struct leicaefi_stats *stats)
+{
+	if (!stats) {
+		return;
+	}
+
+	free_percpu(stats->cpu);
+	kfree(stats);
+}
+
+void leicaefi_stats_record(struct leicaefi_stats *stats,
+			   enum leicaefi_stats_op op, ktime_t start, int result,
+			   unsigned int bytes)
+{
+	s64 elapsed_us = 0;
+	unsigned int bucket = 0;
+
+	if (!stats || (op >= LEICAEFI_STATS_OP_COUNT)) {
+		return;
+	}
+
+	elapsed_us = ktime_us_delta(ktime_get(), start);
+	if (elapsed_us > 0) {
+		bucket = min_t(unsigned int, ilog2(elapsed_us) + 1,
+			       LEICAEFI_STATS_BUCKETS - 1);
+	}
+
+	this_cpu_inc(stats->cpu->count[op]);
+	this_cpu_inc(stats->cpu->hist[op][bucket]);
+	if (result != 0) {
+		this_cpu_inc(stats->cpu->errors[op]);
+	} else {
+		this_cpu_add(stats->cpu->bytes[op], bytes);
+	}
+}
+
+static int leicaefi_stats_show(struct seq_file *s, void *data)
+{
+	struct leicaefi_stats *stats = s->private;
+	struct leicaefi_stats_cpu *sum = NULL;
+	struct leicaefi_stats_cpu *cpu_stats = NULL;
+	unsigned int op = 0;
+	unsigned int bucket = 0;
+	int cpu = 0;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum) {
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		cpu_stats = per_cpu_ptr(stats->cpu, cpu);
+
+		for (op = 0; op < LEICAEFI_STATS_OP_COUNT; ++op) {
+			sum->count[op] += READ_ONCE(cpu_stats->count[op]);
+			sum->errors[op] += READ_ONCE(cpu_stats->errors[op]);
+			sum->bytes[op] += READ_ONCE(cpu_stats->bytes[op]);
+			for (bucket = 0; bucket < LEICAEFI_STATS_BUCKETS;
+			     ++bucket) {
+				sum->hist[op][bucket] +=
+					READ_ONCE(cpu_stats->hist[op][bucket]);
+			}
+		}
+	}
+
+	for (op = 0; op < LEICAEFI_STATS_OP_COUNT; ++op) {
+		seq_printf(s, "%s: count=%lu errors=%lu bytes=%lu\n",
+			   leicaefi_stats_op_names[op], sum->count[op],
+			   sum->errors[op], sum->bytes[op]);
+
+		for (bucket = 0; bucket < LEICAEFI_STATS_BUCKETS;
+		     ++bucket) {
+			if (sum->hist[op][bucket] == 0) {
+				continue;
+			}
+
+			if (bucket == 0) {
+				seq_printf(s, "  <1us: %lu\n",
+					   sum->hist[op][bucket]);
+			} else {
+				seq_printf(s, "  >=%luus: %lu\n",
+					   1UL << (bucket - 1),
+					   sum->hist[op][bucket]);
+			}
+		}
+	}
+
+	kfree(sum);
+
+	return 0;
+}
+
+static int leicaefi_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, leicaefi_stats_show, inode->i_private);
+}
+
+static const struct file_operations leicaefi_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = leicaefi_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static ssize_t leicaefi_stats_reset_write(struct file *file,
+					  const char __user *buffer,
+					  size_t length, loff_t *offset)
+{
+	struct leicaefi_stats *stats = file->private_data;
+	int cpu = 0;
+
+	/* not atomic with updates, good enough for diagnostics */
+	for_each_possible_cpu(cpu) {
+		memset(per_cpu_ptr(stats->cpu, cpu), 0,
+		       sizeof(struct leicaefi_stats_cpu));
+	}
+
+	return length;
+}
+
+static const struct file_operations leicaefi_stats_reset_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = leicaefi_stats_reset_write,
+	.llseek = noop_llseek,
+};
+
+void leicaefi_stats_create_debugfs(struct leicaefi_stats *stats,
+				   struct dentry *parent)
+{
+	if (!stats) {
+		return;
+	}
+
+	debugfs_create_file("stats", 0444, parent, stats,
+			    &leicaefi_stats_fops);
+	debugfs_create_file("reset", 0200, parent, stats,
+			    &leicaefi_stats_reset_fops);
+}
@@ -0,0 +1,24 @@
+#ifndef _LINUX_LEICAEFI_STATS_H
+#define _LINUX_LEICAEFI_STATS_H
+
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+
+#include <common/leicaefi-chip.h>
+
+struct leicaefi_stats;
+
+struct leicaefi_stats *leicaefi_stats_alloc(void);
+
+void leicaefi_stats_free(struct leicaefi_stats *stats);
+
+/* Records operation started at given time, lock-free (per-CPU counters). */
+void leicaefi_stats_record(struct leicaefi_stats *stats,
+			   enum leicaefi_stats_op op, ktime_t start, int result,
+			   unsigned int bytes);
+
+/* Creates 'stats' and 'reset' files in the given directory. */
+void leicaefi_stats_create_debugfs(struct leicaefi_stats *stats,
+				   struct dentry *parent);
+
+#endif /*_LINUX_LEICAEFI_STATS_H*/
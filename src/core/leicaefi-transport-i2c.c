@@ -0,0 +1,84 @@
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/i2c.h>
+
+#include <core/leicaefi-transport.h>
+#include <common/leicaefi-chip.h>
+
+static int leicaefi_transport_smbus_write_word(void *context, u8 cmd,
+					       u16 value)
+{
+	struct i2c_client *i2c = context;
+
+	return i2c_smbus_write_word_data(i2c, cmd, value);
+}
+
+static int leicaefi_transport_smbus_read_word(void *context, u8 cmd,
+					      u16 *value)
+{
+	struct i2c_client *i2c = context;
+	s32 rc = i2c_smbus_read_word_data(i2c, cmd);
+
+	if (rc < 0) {
+		return (int)rc;
+	}
+
+	*value = (u16)rc;
+
+	return 0;
+}
+
+static int leicaefi_transport_smbus_read_words(void *context, const u8 *cmds,
+					       u16 *values, unsigned int count)
+{
+	struct i2c_client *i2c = context;
+	struct i2c_msg msgs[2 * LEICAEFI_CHIP_READ_MULTI_MAX];
+	u8 cmd_buf[LEICAEFI_CHIP_READ_MULTI_MAX];
+	u8 data[2 * LEICAEFI_CHIP_READ_MULTI_MAX];
+	unsigned int i = 0;
+	int rc = 0;
+
+	if (count > LEICAEFI_CHIP_READ_MULTI_MAX) {
+		return -EINVAL;
+	}
+
+	if (!i2c_check_functionality(i2c->adapter, I2C_FUNC_I2C)) {
+		return -EOPNOTSUPP;
+	}
+
+	for (i = 0; i < count; ++i) {
+		cmd_buf[i] = cmds[i];
+
+		msgs[2 * i].addr = i2c->addr;
+		msgs[2 * i].flags = 0;
+		msgs[2 * i].len = 1;
+		msgs[2 * i].buf = &cmd_buf[i];
+
+		msgs[2 * i + 1].addr = i2c->addr;
+		msgs[2 * i + 1].flags = I2C_M_RD;
+		msgs[2 * i + 1].len = 2;
+		msgs[2 * i + 1].buf = &data[2 * i];
+	}
+
+	/* single transfer - one bus lock, repeated start between registers */
+	rc = i2c_transfer(i2c->adapter, msgs, 2 * count);
+	if (rc < 0) {
+		return rc;
+	}
+	if (rc != (int)(2 * count)) {
+		return -EIO;
+	}
+
+	/* SMBus words are transferred LSB first */
+	for (i = 0; i < count; ++i) {
+		values[i] = (u16)data[2 * i] | ((u16)data[2 * i + 1] << 8);
+	}
+
+	return 0;
+}
+
+const struct leicaefi_transport_ops leicaefi_transport_smbus_ops = {
+	.write_word = leicaefi_transport_smbus_write_word,
+	.read_word = leicaefi_transport_smbus_read_word,
+	.read_words = leicaefi_transport_smbus_read_words,
+};
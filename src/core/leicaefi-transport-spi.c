@@ -0,0 +1,112 @@
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/spi/spi.h>
+
+#include <core/leicaefi-transport.h>
+#include <common/leicaefi-chip.h>
+
+/*
+ * SPI framing: command byte followed by the data word, LSB first (same
+ * byte order as the SMBus words). Reads are half duplex, the word is
+ * clocked out after the command byte. Chip select is released after each
+ * register.
+ */
+
+#define LEICAEFI_SPI_FRAME_SIZE (3)
+
+static int leicaefi_transport_spi_write_word(void *context, u8 cmd, u16 value)
+{
+	struct spi_device *spi = context;
+	u8 buf[LEICAEFI_SPI_FRAME_SIZE];
+
+	buf[0] = cmd;
+	buf[1] = (u8)(value & 0xFF);
+	buf[2] = (u8)(value >> 8);
+
+	/* spi_write_then_read() bounces the buffers, stack memory is fine */
+	return spi_write_then_read(spi, buf, sizeof(buf), NULL, 0);
+}
+
+static int leicaefi_transport_spi_read_word(void *context, u8 cmd,
+					    u16 *value)
+{
+	struct spi_device *spi = context;
+	u8 data[2];
+	int rc = 0;
+
+	rc = spi_write_then_read(spi, &cmd, 1, data, sizeof(data));
+	if (rc != 0) {
+		return rc;
+	}
+
+	*value = (u16)data[0] | ((u16)data[1] << 8);
+
+	return 0;
+}
+
+static int leicaefi_transport_spi_read_words(void *context, const u8 *cmds,
+					     u16 *values, unsigned int count)
+{
+	struct spi_device *spi = context;
+	struct spi_transfer *xfers = NULL;
+	struct spi_message msg;
+	unsigned int i = 0;
+	u8 *buf = NULL;
+	int rc = 0;
+
+	if (count == 0 || count > LEICAEFI_CHIP_READ_MULTI_MAX) {
+		return -EINVAL;
+	}
+
+	xfers = kcalloc(2 * count, sizeof(*xfers), GFP_KERNEL);
+	if (!xfers) {
+		return -ENOMEM;
+	}
+
+	/* transfers need DMA safe memory */
+	buf = kmalloc(LEICAEFI_SPI_FRAME_SIZE * count, GFP_KERNEL);
+	if (!buf) {
+		kfree(xfers);
+		return -ENOMEM;
+	}
+
+	spi_message_init(&msg);
+
+	for (i = 0; i < count; ++i) {
+		u8 *frame = &buf[LEICAEFI_SPI_FRAME_SIZE * i];
+
+		frame[0] = cmds[i];
+
+		xfers[2 * i].tx_buf = &frame[0];
+		xfers[2 * i].len = 1;
+		spi_message_add_tail(&xfers[2 * i], &msg);
+
+		xfers[2 * i + 1].rx_buf = &frame[1];
+		xfers[2 * i + 1].len = 2;
+		/* end of register frame, the last one is ended by the core */
+		xfers[2 * i + 1].cs_change = (i + 1 < count) ? 1 : 0;
+		spi_message_add_tail(&xfers[2 * i + 1], &msg);
+	}
+
+	/* single message - one bus lock for all the registers */
+	rc = spi_sync(spi, &msg);
+	if (rc == 0) {
+		for (i = 0; i < count; ++i) {
+			u8 *frame = &buf[LEICAEFI_SPI_FRAME_SIZE * i];
+
+			values[i] = (u16)frame[1] | ((u16)frame[2] << 8);
+		}
+	}
+
+	kfree(buf);
+	kfree(xfers);
+
+	return rc;
+}
+
+const struct leicaefi_transport_ops leicaefi_transport_spi_ops = {
+	.write_word = leicaefi_transport_spi_write_word,
+	.read_word = leicaefi_transport_spi_read_word,
+	.read_words = leicaefi_transport_spi_read_words,
+};
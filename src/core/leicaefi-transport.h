@@ -0,0 +1,28 @@
+#ifndef _LINUX_LEICAEFI_TRANSPORT_H
+#define _LINUX_LEICAEFI_TRANSPORT_H
+
+#include <linux/types.h>
+
+/*
+ * Bus access used by the chip. Commands are the register number with the
+ * RW and SC bits (see leicaefi-defs.h), the context is the one given when
+ * the chip was added.
+ */
+struct leicaefi_transport_ops {
+	int (*write_word)(void *context, u8 cmd, u16 value);
+	int (*read_word)(void *context, u8 cmd, u16 *value);
+	/*
+	 * Optional, reads several registers in one bus transaction. Returns
+	 * -EOPNOTSUPP if not possible, the registers are read one by one then.
+	 */
+	int (*read_words)(void *context, const u8 *cmds, u16 *values,
+			  unsigned int count);
+};
+
+/* SMBus transport, context is the struct i2c_client. */
+extern const struct leicaefi_transport_ops leicaefi_transport_smbus_ops;
+
+/* SPI transport, context is the struct spi_device. */
+extern const struct leicaefi_transport_ops leicaefi_transport_spi_ops;
+
+#endif /*_LINUX_LEICAEFI_TRANSPORT_H*/
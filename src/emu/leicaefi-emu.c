@@ -0,0 +1,751 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/i2c.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/delay.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+
+#include <leicaefi-defs.h>
+
+/*
+ * Software model of the EFI chip on a stub I2C adapter. The driver stack
+ * (leicaefi-core and the children) probes on it as on the real hardware,
+ * which allows testing and benchmarking without the device.
+ *
+ * The interrupt line is emulated using the interrupt simulator, so the
+ * kernel must be built with CONFIG_IRQ_SIM.
+ */
+
+static unsigned short i2c_address = 0x30;
+module_param(i2c_address, ushort, 0444);
+MODULE_PARM_DESC(i2c_address, "Address of the emulated chip");
+
+static unsigned int bus_latency_us = 0;
+module_param(bus_latency_us, uint, 0644);
+MODULE_PARM_DESC(bus_latency_us, "Extra time of each register access in us");
+
+static unsigned int gencmd_latency_us = 200;
+module_param(gencmd_latency_us, uint, 0644);
+MODULE_PARM_DESC(gencmd_latency_us, "General command execution time in us");
+
+static unsigned int flash_write_latency_us = 50;
+module_param(flash_write_latency_us, uint, 0644);
+MODULE_PARM_DESC(flash_write_latency_us, "Flash word write time in us");
+
+static unsigned int flash_erase_latency_ms = 20;
+module_param(flash_erase_latency_ms, uint, 0644);
+MODULE_PARM_DESC(flash_erase_latency_ms, "Flash segment erase time in ms");
+
+static unsigned int flash_check_latency_ms = 100;
+module_param(flash_check_latency_ms, uint, 0644);
+MODULE_PARM_DESC(flash_check_latency_ms, "Partition checksum time in ms");
+
+static unsigned int switch_latency_ms = 50;
+module_param(switch_latency_ms, uint, 0644);
+MODULE_PARM_DESC(switch_latency_ms, "Software mode switch time in ms");
+
+/* flash layout, words are addressed */
+#define LEICAEFI_EMU_FLASH_WORDS (0x10000)
+#define LEICAEFI_EMU_LOADER_START (0x0000)
+#define LEICAEFI_EMU_FIRMWARE_START (0x4000)
+#define LEICAEFI_EMU_SEGMENT_WORDS (256)
+#define LEICAEFI_EMU_IFLASH_WORDS (64)
+
+#define LEICAEFI_EMU_REG_COUNT (LEICAEFI_REGNO_MASK + 1)
+
+/* bits of FLASH_CTRL starting an operation, cleared when it is finished */
+#define LEICAEFI_EMU_FLASH_OP_BITS                                             \
+	(LEICAEFI_FLASHCTRLBIT_FWCHK | LEICAEFI_FLASHCTRLBIT_LDRCHK |          \
+	 LEICAEFI_FLASHCTRLBIT_SWITCH | LEICAEFI_FLASHCTRLBIT_ESEC)
+
+enum leicaefi_emu_reg_type {
+	/* plain read/write register */
+	LEICAEFI_EMU_REG_RW = 0,
+	/* writes are ignored */
+	LEICAEFI_EMU_REG_RO,
+	/* writes set (SC=1) or clear (SC=0) the given bits */
+	LEICAEFI_EMU_REG_SC,
+	/* cleared when read */
+	LEICAEFI_EMU_REG_RC,
+};
+
+static const u8 leicaefi_emu_reg_types[LEICAEFI_EMU_REG_COUNT] = {
+	[LEICAEFI_REG_MOD_ID] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_MOD_REGV] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_MOD_FWV] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_MOD_LDRV] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_FLASH_CTRL] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_MOD_IE] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_MOD_IFG] = LEICAEFI_EMU_REG_RC,
+	[LEICAEFI_REG_MOD_ERR] = LEICAEFI_EMU_REG_RC,
+	[LEICAEFI_REG_MOD_HW] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_KEY_DATA] = LEICAEFI_EMU_REG_RC,
+	[LEICAEFI_REG_PWR_SRC_STATUS] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_STATUS] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_CTRL] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_PWR_SETTINGS] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_PWR_SRC_STATUS2] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_VPOE1] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_VEXT1] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_VEXT2] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_VBAT1] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_PWR_VLINE] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_TEMP_DATA] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_DEV_STATUS0] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_DEV_STATUS1] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_DEV_STATUS] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_DEV_CTRL] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_LED_STATUS] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_LED_CTRL1] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_LED_CTRL2] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_DBG_LOG] = LEICAEFI_EMU_REG_RC,
+	[LEICAEFI_REG_BAT_1_STATUS] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_BAT_1_RSOC] = LEICAEFI_EMU_REG_RO,
+	[LEICAEFI_REG_SMB_CTRL] = LEICAEFI_EMU_REG_SC,
+	[LEICAEFI_REG_SOB_CTRL] = LEICAEFI_EMU_REG_SC,
+};
+
+/* register values after reset */
+static const u16 leicaefi_emu_reg_defaults[LEICAEFI_EMU_REG_COUNT] = {
+	[LEICAEFI_REG_MOD_ID] =
+		(LEICAEFI_MODID_MODE_FIRMWARE << LEICAEFI_MODID_MODE_SHIFT) |
+		(LEICAEFI_MODID_PLATFORM_SYSTEM1500
+		 << LEICAEFI_MODID_PLATFORM_SHIFT) |
+		(LEICAEFI_MODID_PROJECT_SKYMASTER
+		 << LEICAEFI_MODID_PROJECT_SHIFT) |
+		(LEICAEFI_MODID_PROCESSOR_EFI
+		 << LEICAEFI_MODID_PROCESSOR_SHIFT),
+	[LEICAEFI_REG_MOD_REGV] = 0x0001,
+	[LEICAEFI_REG_MOD_FWV] = 0x1203,
+	[LEICAEFI_REG_MOD_LDRV] = 0x1001,
+	[LEICAEFI_REG_MOD_HW] = 0x0011,
+	[LEICAEFI_REG_PWR_SRC_STATUS] =
+		LEICAEFI_POWERSRCBIT_BAT1VAL | LEICAEFI_POWERSRCBIT_EXT1VAL |
+		LEICAEFI_POWERSRCBIT_EXT1ACT,
+	/* 10-bit ADC values, about 12V on the inputs */
+	[LEICAEFI_REG_PWR_VEXT1] = 0x01E0,
+	[LEICAEFI_REG_PWR_VBAT1] = 0x01C0,
+	[LEICAEFI_REG_PWR_VLINE] = 0x01D0,
+	[LEICAEFI_REG_TEMP_DATA] = 0x0BA5,
+	[LEICAEFI_REG_BAT_1_RSOC] = 80,
+};
+
+/* battery messages available through the general command */
+static const struct {
+	u8 msg;
+	u16 value;
+} leicaefi_emu_battery_msgs[] = {
+	{ LEICAEFI_BAT_MSG_TEMPERATURE, 2981 },
+	{ LEICAEFI_BAT_MSG_VOLTAGE, 12150 },
+	{ LEICAEFI_BAT_MSG_CURRENT, (u16)-350 },
+	{ LEICAEFI_BAT_MSG_AVERAGE_CURRENT, (u16)-340 },
+	{ LEICAEFI_BAT_MSG_RUN_TIME_TO_EMPTY, 310 },
+	{ LEICAEFI_BAT_MSG_AVERAGE_TIME_TO_EMPTY, 300 },
+	{ LEICAEFI_BAT_MSG_AVERAGE_TIME_TO_FULL, 0xFFFF },
+	{ LEICAEFI_BAT_MSG_CYCLE_COUNT, 42 },
+};
+
+struct leicaefi_emu {
+	struct i2c_adapter adapter;
+	struct i2c_client *client;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	struct irq_domain *irq_domain;
+#else
+	struct irq_sim irq_sim;
+#endif
+	int irq;
+
+	/* protects the chip state */
+	struct mutex lock;
+	u16 regs[LEICAEFI_EMU_REG_COUNT];
+	u16 *flash;
+	u16 iflash[LEICAEFI_EMU_IFLASH_WORDS];
+
+	/* command and flash operations in progress */
+	bool gencmd_busy;
+	struct delayed_work gencmd_work;
+	bool flash_busy;
+	u16 flash_op;
+	u16 flash_op_addr;
+	u16 flash_op_data;
+	struct delayed_work flash_work;
+
+	struct dentry *debugfs_dir;
+};
+
+static struct leicaefi_emu *leicaefi_emu_instance = NULL;
+
+static void leicaefi_emu_fire_irq(struct leicaefi_emu *emu)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	irq_set_irqchip_state(emu->irq, IRQCHIP_STATE_PENDING, true);
+#else
+	irq_sim_fire(&emu->irq_sim, 0);
+#endif
+}
+
+/*
+ * Sets interrupt and error flags. The line is driven (falling edge on the
+ * real chip) when a newly set flag is enabled in IE.
+ *
+ * Must be called with the lock held.
+ */
+static void leicaefi_emu_raise(struct leicaefi_emu *emu, u16 ifg_bits,
+			       u16 err_bits)
+{
+	u16 prev_pending = emu->regs[LEICAEFI_REG_MOD_IFG] &
+			   emu->regs[LEICAEFI_REG_MOD_IE];
+
+	if (err_bits) {
+		emu->regs[LEICAEFI_REG_MOD_ERR] |= err_bits;
+		ifg_bits |= LEICAEFI_IRQBIT_ERR;
+	}
+	emu->regs[LEICAEFI_REG_MOD_IFG] |= ifg_bits;
+
+	if ((emu->regs[LEICAEFI_REG_MOD_IFG] & emu->regs[LEICAEFI_REG_MOD_IE]) &
+	    ~prev_pending) {
+		leicaefi_emu_fire_irq(emu);
+	}
+}
+
+static bool leicaefi_emu_partition_valid(struct leicaefi_emu *emu,
+					 unsigned int start, unsigned int end)
+{
+	u16 sum = 0;
+	unsigned int i = 0;
+
+	/* valid image sums up to zero */
+	for (i = start; i < end; ++i) {
+		sum += emu->flash[i];
+	}
+
+	return sum == 0;
+}
+
+static void leicaefi_emu_gencmd_work(struct work_struct *work)
+{
+	struct leicaefi_emu *emu = container_of(
+		to_delayed_work(work), struct leicaefi_emu, gencmd_work);
+	u16 cmd = 0;
+	u16 subsystem = 0;
+	bool ok = false;
+	unsigned int i = 0;
+
+	mutex_lock(&emu->lock);
+
+	cmd = emu->regs[LEICAEFI_REG_CMD_CTRL];
+	subsystem = cmd & 0xFF00;
+
+	if (subsystem == LEICAEFI_CMD_LED_TEST_MODE_WRITE) {
+		emu->regs[LEICAEFI_REG_CMD_DATA] = 0;
+		ok = true;
+	} else if (subsystem == LEICAEFI_CMD_BATTERY1_READMSG_MASK) {
+		if (emu->regs[LEICAEFI_REG_PWR_SRC_STATUS] &
+		    LEICAEFI_POWERSRCBIT_BAT1VAL) {
+			for (i = 0; i < ARRAY_SIZE(leicaefi_emu_battery_msgs);
+			     ++i) {
+				if (leicaefi_emu_battery_msgs[i].msg ==
+				    (cmd & 0xFF)) {
+					emu->regs[LEICAEFI_REG_CMD_DATA] =
+						leicaefi_emu_battery_msgs[i]
+							.value;
+					ok = true;
+					break;
+				}
+			}
+		}
+	}
+
+	emu->gencmd_busy = false;
+
+	if (ok) {
+		leicaefi_emu_raise(emu, LEICAEFI_IRQBIT_GCC, 0);
+	} else {
+		leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_GCE);
+	}
+
+	mutex_unlock(&emu->lock);
+}
+
+static void leicaefi_emu_flash_work(struct work_struct *work)
+{
+	struct leicaefi_emu *emu = container_of(
+		to_delayed_work(work), struct leicaefi_emu, flash_work);
+	u16 mode_bit = LEICAEFI_MODID_MODE_LOADER << LEICAEFI_MODID_MODE_SHIFT;
+	bool ok = true;
+	unsigned int i = 0;
+
+	mutex_lock(&emu->lock);
+
+	switch (emu->flash_op) {
+	case LEICAEFI_FLASHCTRLBIT_ESEC: {
+		unsigned int start = emu->flash_op_addr &
+				     ~(LEICAEFI_EMU_SEGMENT_WORDS - 1);
+
+		for (i = 0; i < LEICAEFI_EMU_SEGMENT_WORDS; ++i) {
+			emu->flash[start + i] = 0xFFFF;
+		}
+		break;
+	}
+	case 0:
+		/* NOR flash, programming can only clear bits */
+		emu->flash[emu->flash_op_addr] &= emu->flash_op_data;
+		ok = (emu->flash[emu->flash_op_addr] == emu->flash_op_data);
+		break;
+	case LEICAEFI_FLASHCTRLBIT_FWCHK:
+		ok = leicaefi_emu_partition_valid(emu,
+						  LEICAEFI_EMU_FIRMWARE_START,
+						  LEICAEFI_EMU_FLASH_WORDS);
+		break;
+	case LEICAEFI_FLASHCTRLBIT_LDRCHK:
+		ok = leicaefi_emu_partition_valid(emu,
+						  LEICAEFI_EMU_LOADER_START,
+						  LEICAEFI_EMU_FIRMWARE_START);
+		break;
+	case LEICAEFI_FLASHCTRLBIT_SWITCH:
+		/* switching to firmware requires a valid image */
+		if (emu->regs[LEICAEFI_REG_MOD_ID] & mode_bit) {
+			ok = leicaefi_emu_partition_valid(
+				emu, LEICAEFI_EMU_FIRMWARE_START,
+				LEICAEFI_EMU_FLASH_WORDS);
+		}
+		if (ok) {
+			emu->regs[LEICAEFI_REG_MOD_ID] ^= mode_bit;
+		}
+		break;
+	default:
+		ok = false;
+		break;
+	}
+
+	emu->regs[LEICAEFI_REG_FLASH_CTRL] &= ~emu->flash_op;
+	emu->flash_busy = false;
+
+	if (ok) {
+		leicaefi_emu_raise(emu, LEICAEFI_IRQBIT_FLASH, 0);
+	} else {
+		leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_FLASH);
+	}
+
+	mutex_unlock(&emu->lock);
+}
+
+/* Must be called with the lock held. */
+static void leicaefi_emu_start_flash_op(struct leicaefi_emu *emu, u16 op,
+					unsigned long delay)
+{
+	if (emu->flash_busy) {
+		emu->regs[LEICAEFI_REG_FLASH_CTRL] &= ~op;
+		leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_FLASH);
+		return;
+	}
+
+	emu->flash_busy = true;
+	emu->flash_op = op;
+	emu->flash_op_addr = emu->regs[LEICAEFI_REG_FLASH_ADDR];
+	emu->flash_op_data = emu->regs[LEICAEFI_REG_FLASH_DATA];
+	schedule_delayed_work(&emu->flash_work, delay);
+}
+
+/* Must be called with the lock held. */
+static void leicaefi_emu_flash_ctrl_set(struct leicaefi_emu *emu, u16 bits)
+{
+	u16 op = bits & LEICAEFI_EMU_FLASH_OP_BITS;
+
+	/* one operation at a time */
+	if (hweight16(op) > 1) {
+		emu->regs[LEICAEFI_REG_FLASH_CTRL] &= ~op;
+		leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_FLASH);
+		return;
+	}
+
+	if (op == LEICAEFI_FLASHCTRLBIT_ESEC) {
+		if (!(emu->regs[LEICAEFI_REG_FLASH_CTRL] &
+		      LEICAEFI_FLASHCTRLBIT_WREN)) {
+			emu->regs[LEICAEFI_REG_FLASH_CTRL] &= ~op;
+			leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_FLASH);
+			return;
+		}
+		leicaefi_emu_start_flash_op(
+			emu, op, msecs_to_jiffies(flash_erase_latency_ms));
+	} else if (op == LEICAEFI_FLASHCTRLBIT_SWITCH) {
+		leicaefi_emu_start_flash_op(
+			emu, op, msecs_to_jiffies(switch_latency_ms));
+	} else if (op) {
+		leicaefi_emu_start_flash_op(
+			emu, op, msecs_to_jiffies(flash_check_latency_ms));
+	}
+}
+
+/* Must be called with the lock held. */
+static u16 leicaefi_emu_read_reg(struct leicaefi_emu *emu, u8 reg)
+{
+	u16 value = 0;
+
+	switch (reg) {
+	case LEICAEFI_REG_FLASH_DATA:
+		return emu->flash[emu->regs[LEICAEFI_REG_FLASH_ADDR]];
+	case LEICAEFI_REG_IFLASH_DATA:
+		return emu->iflash[emu->regs[LEICAEFI_REG_IFLASH_ADDR] %
+				   LEICAEFI_EMU_IFLASH_WORDS];
+	default:
+		break;
+	}
+
+	value = emu->regs[reg];
+	if (leicaefi_emu_reg_types[reg] == LEICAEFI_EMU_REG_RC) {
+		emu->regs[reg] = 0;
+	}
+
+	return value;
+}
+
+/* Must be called with the lock held. */
+static void leicaefi_emu_write_reg(struct leicaefi_emu *emu, u8 reg, bool sc,
+				   u16 value)
+{
+	switch (leicaefi_emu_reg_types[reg]) {
+	case LEICAEFI_EMU_REG_RO:
+	case LEICAEFI_EMU_REG_RC:
+		return;
+	case LEICAEFI_EMU_REG_SC:
+		if (!sc) {
+			emu->regs[reg] &= ~value;
+			return;
+		}
+		emu->regs[reg] |= value;
+		break;
+	default:
+		emu->regs[reg] = value;
+		break;
+	}
+
+	switch (reg) {
+	case LEICAEFI_REG_MOD_IE:
+		/* flags already pending are signalled when enabled */
+		if (emu->regs[LEICAEFI_REG_MOD_IFG] & value) {
+			leicaefi_emu_fire_irq(emu);
+		}
+		break;
+	case LEICAEFI_REG_FLASH_CTRL:
+		leicaefi_emu_flash_ctrl_set(emu, value);
+		break;
+	case LEICAEFI_REG_FLASH_DATA:
+		if (!(emu->regs[LEICAEFI_REG_FLASH_CTRL] &
+		      LEICAEFI_FLASHCTRLBIT_WREN)) {
+			leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_FLASH);
+			break;
+		}
+		leicaefi_emu_start_flash_op(
+			emu, 0, usecs_to_jiffies(flash_write_latency_us));
+		break;
+	case LEICAEFI_REG_CMD_CTRL:
+		if (emu->gencmd_busy) {
+			leicaefi_emu_raise(emu, 0, LEICAEFI_ERRBIT_GCE);
+			break;
+		}
+		emu->gencmd_busy = true;
+		schedule_delayed_work(&emu->gencmd_work,
+				      usecs_to_jiffies(gencmd_latency_us));
+		break;
+	default:
+		break;
+	}
+}
+
+static void leicaefi_emu_bus_delay(void)
+{
+	unsigned int delay_us = bus_latency_us;
+
+	if (delay_us > 0) {
+		usleep_range(delay_us, delay_us + delay_us / 4 + 1);
+	}
+}
+
+/*
+ * Supported transfers are the SMBus word write (command and two data
+ * bytes) and word read (command followed by two bytes read), several of
+ * them could be combined in one transfer.
+ */
+static int leicaefi_emu_master_xfer(struct i2c_adapter *adapter,
+				    struct i2c_msg *msgs, int num)
+{
+	struct leicaefi_emu *emu = i2c_get_adapdata(adapter);
+	int i = 0;
+
+	for (i = 0; i < num; ++i) {
+		if (msgs[i].addr != i2c_address) {
+			return -ENXIO;
+		}
+	}
+
+	mutex_lock(&emu->lock);
+
+	for (i = 0; i < num; ++i) {
+		struct i2c_msg *msg = &msgs[i];
+		u8 cmd = 0;
+		u8 reg = 0;
+
+		leicaefi_emu_bus_delay();
+
+		if ((msg->flags & I2C_M_RD) || (msg->len < 1)) {
+			break;
+		}
+
+		cmd = msg->buf[0];
+		reg = cmd & LEICAEFI_REGNO_MASK;
+
+		if ((msg->len == 3) &&
+		    ((cmd & LEICAEFI_RWBIT_MASK) == LEICAEFI_RWBIT_WRITE)) {
+			bool sc = (cmd & LEICAEFI_SCBIT_MASK) ==
+				  LEICAEFI_SCBIT_SET;
+			u16 value = msg->buf[1] | (msg->buf[2] << 8);
+
+			leicaefi_emu_write_reg(emu, reg, sc, value);
+			continue;
+		}
+
+		if ((msg->len == 1) && (i + 1 < num) &&
+		    (msgs[i + 1].flags & I2C_M_RD) && (msgs[i + 1].len == 2) &&
+		    ((cmd & LEICAEFI_RWBIT_MASK) == LEICAEFI_RWBIT_READ)) {
+			u16 value = leicaefi_emu_read_reg(emu, reg);
+
+			msgs[i + 1].buf[0] = value & 0xFF;
+			msgs[i + 1].buf[1] = value >> 8;
+			++i;
+			continue;
+		}
+
+		break;
+	}
+
+	mutex_unlock(&emu->lock);
+
+	if (i != num) {
+		dev_warn(&adapter->dev, "%s - unsupported message %d\n",
+			 __func__, i);
+		return -EOPNOTSUPP;
+	}
+
+	return num;
+}
+
+static u32 leicaefi_emu_functionality(struct i2c_adapter *adapter)
+{
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm leicaefi_emu_algorithm = {
+	.master_xfer = leicaefi_emu_master_xfer,
+	.functionality = leicaefi_emu_functionality,
+};
+
+/*
+ * Debugfs 'event' file, takes "<ifg> <err>" to raise interrupts or
+ * "<reg> = <value>" to change register contents (e.g. power status).
+ */
+static ssize_t leicaefi_emu_event_write(struct file *file,
+					const char __user *buffer,
+					size_t length, loff_t *offset)
+{
+	struct leicaefi_emu *emu = file->private_data;
+	char kbuf[32];
+	unsigned int a = 0;
+	unsigned int b = 0;
+	ssize_t rc = length;
+
+	if (length >= sizeof(kbuf)) {
+		return -EINVAL;
+	}
+
+	if (copy_from_user(kbuf, buffer, length)) {
+		return -EFAULT;
+	}
+	kbuf[length] = '\0';
+
+	mutex_lock(&emu->lock);
+
+	if ((sscanf(kbuf, "%x = %x", &a, &b) == 2) &&
+	    (a < LEICAEFI_EMU_REG_COUNT)) {
+		emu->regs[a] = (u16)b;
+	} else if (sscanf(kbuf, "%x %x", &a, &b) == 2) {
+		leicaefi_emu_raise(emu, (u16)a, (u16)b);
+	} else {
+		rc = -EINVAL;
+	}
+
+	mutex_unlock(&emu->lock);
+
+	return rc;
+}
+
+static const struct file_operations leicaefi_emu_event_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = leicaefi_emu_event_write,
+	.llseek = noop_llseek,
+};
+
+static int leicaefi_emu_init_irq(struct leicaefi_emu *emu)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	emu->irq_domain = irq_domain_create_sim(NULL, 1);
+	if (IS_ERR(emu->irq_domain)) {
+		return PTR_ERR(emu->irq_domain);
+	}
+
+	emu->irq = irq_create_mapping(emu->irq_domain, 0);
+	if (emu->irq <= 0) {
+		irq_domain_remove_sim(emu->irq_domain);
+		return -ENXIO;
+	}
+#else
+	int rc = irq_sim_init(&emu->irq_sim, 1);
+
+	if (rc < 0) {
+		return rc;
+	}
+
+	emu->irq = irq_sim_irqnum(&emu->irq_sim, 0);
+#endif
+
+	return 0;
+}
+
+static void leicaefi_emu_free_irq(struct leicaefi_emu *emu)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	irq_dispose_mapping(emu->irq);
+	irq_domain_remove_sim(emu->irq_domain);
+#else
+	irq_sim_fini(&emu->irq_sim);
+#endif
+}
+
+static void leicaefi_emu_reset(struct leicaefi_emu *emu)
+{
+	unsigned int i = 0;
+
+	memcpy(emu->regs, leicaefi_emu_reg_defaults, sizeof(emu->regs));
+
+	/* both partitions hold valid (all zero) images */
+	memset(emu->flash, 0, LEICAEFI_EMU_FLASH_WORDS * sizeof(u16));
+
+	for (i = 0; i < LEICAEFI_EMU_IFLASH_WORDS; ++i) {
+		emu->iflash[i] = (u16)(0xEF00 | i);
+	}
+}
+
+static int __init leicaefi_emu_init(void)
+{
+	struct leicaefi_emu *emu = NULL;
+	struct i2c_board_info info;
+	int rc = 0;
+
+	emu = kzalloc(sizeof(*emu), GFP_KERNEL);
+	if (!emu) {
+		return -ENOMEM;
+	}
+
+	emu->flash = kvzalloc(LEICAEFI_EMU_FLASH_WORDS * sizeof(u16),
+			      GFP_KERNEL);
+	if (!emu->flash) {
+		kfree(emu);
+		return -ENOMEM;
+	}
+
+	mutex_init(&emu->lock);
+	INIT_DELAYED_WORK(&emu->gencmd_work, leicaefi_emu_gencmd_work);
+	INIT_DELAYED_WORK(&emu->flash_work, leicaefi_emu_flash_work);
+	leicaefi_emu_reset(emu);
+
+	rc = leicaefi_emu_init_irq(emu);
+	if (rc != 0) {
+		pr_err("%s - cannot create interrupt: %d\n", __func__, rc);
+		goto err_free;
+	}
+
+	emu->adapter.owner = THIS_MODULE;
+	emu->adapter.algo = &leicaefi_emu_algorithm;
+	strscpy(emu->adapter.name, "leicaefi-emu", sizeof(emu->adapter.name));
+	i2c_set_adapdata(&emu->adapter, emu);
+
+	rc = i2c_add_adapter(&emu->adapter);
+	if (rc != 0) {
+		pr_err("%s - cannot add adapter: %d\n", __func__, rc);
+		goto err_irq;
+	}
+
+	memset(&info, 0, sizeof(info));
+	strscpy(info.type, "leica-efi", sizeof(info.type));
+	info.addr = i2c_address;
+	info.irq = emu->irq;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	emu->client = i2c_new_client_device(&emu->adapter, &info);
+#else
+	emu->client = i2c_new_device(&emu->adapter, &info);
+	if (!emu->client) {
+		emu->client = ERR_PTR(-ENODEV);
+	}
+#endif
+	if (IS_ERR(emu->client)) {
+		rc = PTR_ERR(emu->client);
+		pr_err("%s - cannot add client: %d\n", __func__, rc);
+		goto err_adapter;
+	}
+
+	emu->debugfs_dir = debugfs_create_dir("leicaefi-emu", NULL);
+	debugfs_create_file("event", 0200, emu->debugfs_dir, emu,
+			    &leicaefi_emu_event_fops);
+
+	leicaefi_emu_instance = emu;
+
+	return 0;
+
+err_adapter:
+	i2c_del_adapter(&emu->adapter);
+err_irq:
+	leicaefi_emu_free_irq(emu);
+err_free:
+	kvfree(emu->flash);
+	kfree(emu);
+	return rc;
+}
+
+static void __exit leicaefi_emu_exit(void)
+{
+	struct leicaefi_emu *emu = leicaefi_emu_instance;
+
+	debugfs_remove_recursive(emu->debugfs_dir);
+
+	i2c_unregister_device(emu->client);
+	i2c_del_adapter(&emu->adapter);
+
+	cancel_delayed_work_sync(&emu->gencmd_work);
+	cancel_delayed_work_sync(&emu->flash_work);
+
+	leicaefi_emu_free_irq(emu);
+
+	kvfree(emu->flash);
+	kfree(emu);
+}
+
+module_init(leicaefi_emu_init);
+module_exit(leicaefi_emu_exit);
+
+// Module information
+MODULE_DESCRIPTION("Leica EFI chip emulator");
+MODULE_AUTHOR(
+	"Krzysztof Kapuscik <krzysztof.kapuscik-ext@leica-geosystems.com>");
+MODULE_VERSION("0.1");
+MODULE_LICENSE("GPL v2");
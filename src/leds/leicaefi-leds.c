@@ -1,68 +1,68 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/leds.h>
-#include <linux/delay.h>
-#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/ctype.h>
+#include <linux/string.h>
+#include <linux/regmap.h>
+#include <kunit/visibility.h>
 
 #include <leicaefi.h>
 #include <common/leicaefi-chip.h>
 #include <common/leicaefi-device.h>
 
-#define LEICAEFI_LED_VALUE_BIT_MASK 0x3 // two bits
-#define LEICAEFI_LED_VALUE_OFF 0
-#define LEICAEFI_LED_VALUE_FULLY_ON 1
-#define LEICAEFI_LED_VALUE_DIMMED 2
-#define LEICAEFI_LED_VALUE_DIMMED_BLINKING 3
+#include "leicaefi-leds.h"
 
 #define MAX_PATTERN_STEP 64
 
-struct leicaefi_leds_device;
-
-struct leicaefi_led_desc {
-	const char *name;
-	u8 efi_reg_no;
-	u16 efi_reg_offset;
-	int initial_brightness;
-};
-
-struct leicaefi_led {
-	struct leicaefi_leds_device *efidev;
-	const struct leicaefi_led_desc *desc;
-	struct led_classdev lc;
-	int id;
-
-	unsigned long delay_on_intervals;
-	unsigned long delay_off_intervals;
-	unsigned long current_interval;
-	bool prev_state_on;
-
-#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+static const unsigned long STATE_REFRESH_INTERVAL_MS =
+	LEICAEFI_LED_SYNC_REFRESH_RATE_MS;
+static const unsigned long MAX_INTERVAL_COUNT =
+	(60 * 1000) / STATE_REFRESH_INTERVAL_MS;
 
-	u64 trigger_pattern;
+static LIST_HEAD(leicaefi_leds_devices);
+static DEFINE_MUTEX(leicaefi_leds_devices_lock);
 
-#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
-};
+static void leicaefi_leds_restart(struct leicaefi_leds_device *efidev);
 
-struct leicaefi_leds_device {
-	struct platform_device *pdev;
-	struct leicaefi_chip *efichip;
+static unsigned int hw_blink_delay_ms;
 
-	struct leicaefi_led *leds;
+static int leicaefi_leds_hw_blink_delay_set(const char *val,
+					    const struct kernel_param *kp)
+{
+	struct leicaefi_leds_device *efidev = NULL;
+	int rv = param_set_uint(val, kp);
 
-	struct mutex lock;
-	struct task_struct *worker_tsk;
+	if (rv != 0) {
+		return rv;
+	}
 
-#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+	/* leds may switch between firmware and host blinking */
+	mutex_lock(&leicaefi_leds_devices_lock);
+	list_for_each_entry(efidev, &leicaefi_leds_devices, node) {
+		leicaefi_leds_restart(efidev);
+	}
+	mutex_unlock(&leicaefi_leds_devices_lock);
 
-	int current_pattern_step;
+	return 0;
+}
 
-#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
+static const struct kernel_param_ops leicaefi_leds_hw_blink_delay_ops = {
+	.set = leicaefi_leds_hw_blink_delay_set,
+	.get = param_get_uint,
 };
 
-static const unsigned long STATE_REFRESH_INTERVAL_MS =
-	LEICAEFI_LED_SYNC_REFRESH_RATE_MS;
-static const unsigned long MAX_INTERVAL_COUNT =
-	(60 * 1000) / STATE_REFRESH_INTERVAL_MS;
+module_param_cb(hw_blink_delay_ms, &leicaefi_leds_hw_blink_delay_ops,
+		&hw_blink_delay_ms, 0644);
+MODULE_PARM_DESC(hw_blink_delay_ms,
+		 "On and off time of the firmware blinking mode in ms (0 - blink from the host only)");
+
+static bool brightness_resync;
+module_param(brightness_resync, bool, 0644);
+MODULE_PARM_DESC(brightness_resync,
+		 "Read led state from the chip and resync the register shadow (debug)");
 
 // Following EFI specification user application shall not control the battery LED
 // but it is registered for test purposes
@@ -95,18 +95,36 @@ static struct leicaefi_led *leicaefi_led_cast(struct led_classdev *led_cdev)
 
 static int leicaefi_led_brightness_get_unlocked(struct leicaefi_led *led)
 {
+	struct leicaefi_leds_device *efidev = led->efidev;
+	size_t idx = led->desc->efi_reg_no - LEICAEFI_REG_LED_CTRL1;
 	int rv = 0;
 	u16 int_value_efi = 0;
 
-	rv = leicaefi_chip_read(led->efidev->efichip, led->desc->efi_reg_no,
+	/* the register is cached, drop it so the chip itself is read */
+	regcache_drop_region(leicaefi_chip_get_regmap(efidev->efichip),
+			     led->desc->efi_reg_no, led->desc->efi_reg_no);
+
+	rv = leicaefi_chip_read(efidev->efichip, led->desc->efi_reg_no,
 				&int_value_efi);
 	if (rv != 0) {
-		dev_warn(&led->efidev->pdev->dev,
+		dev_warn(&efidev->pdev->dev,
 			 "%s - getting brightness failed id=%d rv=%d\n",
 			 __func__, led->id, rv);
 		return 0;
 	}
 
+	if (efidev->reg_shadow_valid[idx] &&
+	    (efidev->reg_shadow[idx] != int_value_efi)) {
+		dev_dbg(&efidev->pdev->dev,
+			"%s - register shadow out of sync reg=0x%02X shadow=0x%04X chip=0x%04X\n",
+			__func__, (unsigned)led->desc->efi_reg_no,
+			(unsigned)efidev->reg_shadow[idx],
+			(unsigned)int_value_efi);
+	}
+
+	WRITE_ONCE(efidev->reg_shadow[idx], int_value_efi);
+	WRITE_ONCE(efidev->reg_shadow_valid[idx], true);
+
 	int_value_efi >>= led->desc->efi_reg_offset;
 	int_value_efi &= LEICAEFI_LED_VALUE_BIT_MASK;
 
@@ -117,19 +135,54 @@ static enum led_brightness
 leicaefi_led_brightness_get(struct led_classdev *led_cdev)
 {
 	struct leicaefi_led *led = leicaefi_led_cast(led_cdev);
+	struct leicaefi_leds_device *efidev = led->efidev;
+	size_t idx = led->desc->efi_reg_no - LEICAEFI_REG_LED_CTRL1;
+	u16 mask = LEICAEFI_LED_VALUE_BIT_MASK << led->desc->efi_reg_offset;
 	int int_value_kernel = 0;
 
-	dev_dbg(&led->efidev->pdev->dev, "%s id=%d\n", __func__, led->id);
+	dev_dbg(&efidev->pdev->dev, "%s id=%d\n", __func__, led->id);
 
-	mutex_lock(&led->efidev->lock);
+	/*
+	 * The shadow holds the state of the led including the current blink
+	 * phase, read the chip only if the state is not known.
+	 */
+	if (!READ_ONCE(brightness_resync) &&
+	    READ_ONCE(efidev->reg_shadow_valid[idx])) {
+		return (READ_ONCE(efidev->reg_shadow[idx]) & mask) ? 1 : 0;
+	}
+
+	mutex_lock(&efidev->lock);
 
 	int_value_kernel = leicaefi_led_brightness_get_unlocked(led);
 
-	mutex_unlock(&led->efidev->lock);
+	mutex_unlock(&efidev->lock);
 
 	return (enum led_brightness)int_value_kernel;
 }
 
+/*
+ * Copies the register value after a write. It is served from the chip
+ * layer cache, after a failed write the cache is dropped and the chip read.
+ */
+static void
+leicaefi_leds_copy_register_unlocked(struct leicaefi_leds_device *efidev,
+				     u16 efi_reg_no)
+{
+	size_t idx = efi_reg_no - LEICAEFI_REG_LED_CTRL1;
+	u16 value_efi = 0;
+	int rv = 0;
+
+	rv = leicaefi_chip_read(efidev->efichip, efi_reg_no, &value_efi);
+	if (rv != 0) {
+		dev_warn(&efidev->pdev->dev,
+			 "%s - reading reg=0x%02X failed rv=%d\n", __func__,
+			 (unsigned)efi_reg_no, rv);
+	}
+
+	WRITE_ONCE(efidev->reg_shadow[idx], value_efi);
+	WRITE_ONCE(efidev->reg_shadow_valid[idx], rv == 0);
+}
+
 static int
 leicaefi_led_set_register_unlocked(struct leicaefi_leds_device *efidev,
 				   u16 efi_reg_no, u16 new_value_efi,
@@ -142,33 +195,355 @@ leicaefi_led_set_register_unlocked(struct leicaefi_leds_device *efidev,
 		return 0;
 	}
 
-	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
+	dev_dbg(&efidev->pdev->dev,
+		"%s - reg=0x%02X value=0x%04X mask=0x%04X\n", __func__,
+		(unsigned)efi_reg_no, (unsigned)new_value_efi,
+		(unsigned)mask_value_efi);
 
-	rv = leicaefi_chip_clear_bits(efidev->efichip, efi_reg_no,
-				      mask_value_efi);
+	/* unchanged bits are not sent, cleared bits are sent before set */
+	rv = leicaefi_chip_update_bits(efidev->efichip, efi_reg_no,
+				       mask_value_efi, new_value_efi);
 	if (rv != 0) {
 		dev_warn(&efidev->pdev->dev,
-			 "%s - clearing bits failed rv=%d\n", __func__, rv);
-		return rv;
+			 "%s - updating bits failed rv=%d\n", __func__, rv);
 	}
 
-	/* sleep for a moment, sending clear then set too fast results in an ugly gap when blinking */
-	mdelay(1);
+	leicaefi_leds_copy_register_unlocked(efidev, efi_reg_no);
 
-	rv = leicaefi_chip_set_bits(efidev->efichip, efi_reg_no,
-				    new_value_efi & mask_value_efi);
-	if (rv != 0) {
-		dev_warn(&efidev->pdev->dev, "%s - setting bits failed rv=%d\n",
-			 __func__, rv);
-		return rv;
+	dev_dbg(&efidev->pdev->dev, "%s - done\n", __func__);
+
+	return rv;
+}
+
+static void leicaefi_leds_frame_add(struct leicaefi_leds_frame *frame,
+				    const struct leicaefi_led *led,
+				    u16 value_efi)
+{
+	size_t idx = led->desc->efi_reg_no - LEICAEFI_REG_LED_CTRL1;
+
+	frame->values[idx] |= value_efi << led->desc->efi_reg_offset;
+	frame->masks[idx] |= LEICAEFI_LED_VALUE_BIT_MASK
+			     << led->desc->efi_reg_offset;
+}
+
+static int
+leicaefi_leds_frame_commit_unlocked(struct leicaefi_leds_device *efidev,
+				    const struct leicaefi_leds_frame *frame)
+{
+	int rv = 0;
+	int rv2 = 0;
+
+	rv = leicaefi_led_set_register_unlocked(efidev, LEICAEFI_REG_LED_CTRL1,
+						frame->values[0],
+						frame->masks[0]);
+	rv2 = leicaefi_led_set_register_unlocked(efidev, LEICAEFI_REG_LED_CTRL2,
+						 frame->values[1],
+						 frame->masks[1]);
+
+	return (rv != 0) ? rv : rv2;
+}
+
+static bool leicaefi_led_is_blinking(const struct leicaefi_led *led)
+{
+	return (led->delay_on_intervals != 0) &&
+	       (led->delay_off_intervals != 0);
+}
+
+static bool leicaefi_led_is_active(const struct leicaefi_led *led)
+{
+#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+	if (led->trigger_pattern != 0) {
+		return true;
 	}
+#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
 
-	/* sleep for a moment, sending clear then set too fast results in an ugly gap when blinking */
-	mdelay(1);
+	return leicaefi_led_is_blinking(led);
+}
 
-	dev_dbg(&efidev->pdev->dev, "%s - done\n", __func__);
+/*
+ * Logic to synchronize blinking the two LEDs under one front panel icon
+ * - they should blink in inverted cycle (if same parameters are set) so
+ *   it will look e.g. like red/green/red/green and not yellow/blank/yellow
+ */
+static bool
+leicaefi_led_is_blink_inverted(const struct leicaefi_leds_device *efidev,
+			       size_t i)
+{
+	const struct leicaefi_led *led = &efidev->leds[i];
+	const struct leicaefi_led *other_led = NULL;
 
-	return 0;
+	if ((i & 0x1) == 0) {
+		return false;
+	}
+
+	other_led = &efidev->leds[i - 1];
+
+	/* same rate, same on/off time */
+	return leicaefi_led_is_blinking(other_led) &&
+	       (led->delay_off_intervals == led->delay_on_intervals) &&
+	       (led->delay_off_intervals == other_led->delay_off_intervals) &&
+	       (led->delay_on_intervals == other_led->delay_on_intervals);
+}
+
+/*
+ * Blinking with the firmware timing is left to the firmware, unless the
+ * other led of the icon blinks the same way - the firmware cannot blink
+ * them in inverted cycle.
+ */
+static bool leicaefi_led_is_hw_blink(const struct leicaefi_leds_device *efidev,
+				     size_t i)
+{
+	const struct leicaefi_led *led = &efidev->leds[i];
+	const struct leicaefi_led *other_led = &efidev->leds[i ^ 0x1];
+	unsigned long hw_intervals =
+		DIV_ROUND_UP(READ_ONCE(hw_blink_delay_ms),
+			     STATE_REFRESH_INTERVAL_MS);
+
+	if ((hw_intervals == 0) || (led->delay_on_intervals != hw_intervals) ||
+	    (led->delay_off_intervals != hw_intervals)) {
+		return false;
+	}
+
+	return (other_led->delay_on_intervals != led->delay_on_intervals) ||
+	       (other_led->delay_off_intervals != led->delay_off_intervals);
+}
+
+/*
+ * Returns the blink state in the given step and stores the number of steps
+ * until the state changes.
+ */
+VISIBLE_IF_KUNIT bool leicaefi_led_blink_state(const struct leicaefi_led *led,
+					       unsigned long step,
+					       unsigned long *steps_left)
+{
+	unsigned long period =
+		led->delay_on_intervals + led->delay_off_intervals;
+	unsigned long position = 0;
+
+	if (step < led->blink_start_step) {
+		*steps_left = led->blink_start_step - step;
+		return false;
+	}
+
+	position = (step - led->blink_start_step) % period;
+	if (position < led->delay_on_intervals) {
+		*steps_left = led->delay_on_intervals - position;
+		return true;
+	}
+
+	*steps_left = period - position;
+	return false;
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_led_blink_state);
+
+#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+
+/*
+ * Returns the pattern state in the given step and stores the number of
+ * steps until the state changes (ULONG_MAX if it never changes).
+ */
+static bool leicaefi_led_pattern_state(const struct leicaefi_led *led,
+				       unsigned long step,
+				       unsigned long *steps_left)
+{
+	u64 current_bit_mask = BIT_ULL(step % MAX_PATTERN_STEP);
+	bool state_on = (led->trigger_pattern & current_bit_mask);
+	unsigned long i = 0;
+
+	*steps_left = ULONG_MAX;
+
+	for (i = 1; i < MAX_PATTERN_STEP; ++i) {
+		u64 bit = BIT_ULL((step + i) % MAX_PATTERN_STEP);
+
+		if (!!(led->trigger_pattern & bit) != state_on) {
+			*steps_left = i;
+			break;
+		}
+	}
+
+	return state_on;
+}
+
+#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
+
+/*
+ * Returns the current scheduler step. The worker may run slightly before
+ * the requested step due to jiffies rounding, so round to the nearest one.
+ */
+static unsigned long
+leicaefi_leds_current_step(const struct leicaefi_leds_device *efidev)
+{
+	s64 elapsed_ms = ktime_ms_delta(ktime_get(), efidev->epoch);
+
+	if (elapsed_ms < 0) {
+		return 0;
+	}
+
+	return (unsigned long)div_u64(
+		elapsed_ms + STATE_REFRESH_INTERVAL_MS / 2,
+		STATE_REFRESH_INTERVAL_MS);
+}
+
+/*
+ * Applies the states of blinking leds for the given step and returns the
+ * step of the next state transition (ULONG_MAX if there is none).
+ */
+VISIBLE_IF_KUNIT unsigned long
+leicaefi_leds_update_unlocked(struct leicaefi_leds_device *efidev,
+			      unsigned long step)
+{
+	size_t i = 0;
+	struct leicaefi_leds_frame frame = {};
+	unsigned long next_step = ULONG_MAX;
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		struct leicaefi_led *led = &efidev->leds[i];
+		unsigned long steps_left = ULONG_MAX;
+		bool state_on = false;
+		u16 value_efi = LEICAEFI_LED_VALUE_OFF;
+
+		if (!leicaefi_led_is_active(led)) {
+			continue;
+		}
+
+		if (leicaefi_led_is_hw_blink(efidev, i)) {
+			/* firmware blinks it, nothing to schedule */
+			value_efi = LEICAEFI_LED_VALUE_DIMMED_BLINKING;
+		} else {
+			if (leicaefi_led_is_blink_inverted(efidev, i)) {
+				/* state is opposite to the other led */
+				state_on = !leicaefi_led_blink_state(
+					&efidev->leds[i - 1], step,
+					&steps_left);
+			} else if (leicaefi_led_is_blinking(led)) {
+				state_on = leicaefi_led_blink_state(
+					led, step, &steps_left);
+			}
+
+			value_efi = (state_on) ? LEICAEFI_LED_VALUE_DIMMED :
+						 LEICAEFI_LED_VALUE_OFF;
+		}
+
+#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+		if (led->trigger_pattern != 0) {
+			state_on = leicaefi_led_pattern_state(led, step,
+							      &steps_left);
+			value_efi = (state_on) ? LEICAEFI_LED_VALUE_DIMMED :
+						 LEICAEFI_LED_VALUE_OFF;
+		}
+#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
+
+		if ((steps_left != ULONG_MAX) &&
+		    (step + steps_left < next_step)) {
+			next_step = step + steps_left;
+		}
+
+		if (value_efi != led->prev_value_efi) {
+			leicaefi_leds_frame_add(&frame, led, value_efi);
+			led->prev_value_efi = value_efi;
+		}
+	}
+
+	leicaefi_leds_frame_commit_unlocked(efidev, &frame);
+
+	return next_step;
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_leds_update_unlocked);
+
+static void leicaefi_leds_worker(struct work_struct *work)
+{
+	struct leicaefi_leds_device *efidev = container_of(
+		to_delayed_work(work), struct leicaefi_leds_device, worker);
+	unsigned long step = 0;
+	unsigned long next_step = 0;
+
+	mutex_lock(&efidev->lock);
+
+	step = leicaefi_leds_current_step(efidev);
+	next_step = leicaefi_leds_update_unlocked(efidev, step);
+
+	if ((next_step != ULONG_MAX) && !efidev->removing) {
+		s64 delay_ms = (s64)next_step * STATE_REFRESH_INTERVAL_MS -
+			       ktime_ms_delta(ktime_get(), efidev->epoch);
+
+		queue_delayed_work(system_power_efficient_wq, &efidev->worker,
+				   msecs_to_jiffies(max_t(s64, delay_ms, 0)));
+	} else {
+		efidev->worker_armed = false;
+	}
+
+	mutex_unlock(&efidev->lock);
+}
+
+/*
+ * Arms the worker to apply new blink settings and returns the current step.
+ * Must be called with the lock held.
+ */
+static unsigned long
+leicaefi_leds_start_unlocked(struct leicaefi_leds_device *efidev)
+{
+	if (efidev->removing) {
+		return 0;
+	}
+
+	if (!efidev->worker_armed) {
+		efidev->epoch = ktime_get();
+		efidev->worker_armed = true;
+	}
+
+	mod_delayed_work(system_power_efficient_wq, &efidev->worker, 0);
+
+	return leicaefi_leds_current_step(efidev);
+}
+
+/*
+ * Runs the worker to apply the blink settings again, e.g. when blinking
+ * moves between the firmware and the host. A worker that was disarmed
+ * starts a new epoch, the blink cycles start again from its first step.
+ */
+static void leicaefi_leds_restart(struct leicaefi_leds_device *efidev)
+{
+	bool rebase = false;
+	unsigned long step = 0;
+	size_t i = 0;
+
+	mutex_lock(&efidev->lock);
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		if (leicaefi_led_is_active(&efidev->leds[i])) {
+			break;
+		}
+	}
+
+	if (i < EFI_LED_COUNT) {
+		rebase = !efidev->worker_armed;
+		step = leicaefi_leds_start_unlocked(efidev);
+
+		for (i = 0; rebase && (i < EFI_LED_COUNT); i++) {
+			efidev->leds[i].blink_start_step = step;
+		}
+	}
+
+	mutex_unlock(&efidev->lock);
+}
+
+/*
+ * Disarms the worker if no led needs it anymore.
+ * Must be called with the lock held.
+ */
+static void leicaefi_leds_stop_unlocked(struct leicaefi_leds_device *efidev)
+{
+	size_t i = 0;
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		if (leicaefi_led_is_active(&efidev->leds[i])) {
+			return;
+		}
+	}
+
+	/* a worker already running finds nothing to do and stops itself */
+	cancel_delayed_work(&efidev->worker);
+	efidev->worker_armed = false;
 }
 
 static int leicaefi_led_brightness_set_unlocked(struct leicaefi_led *led,
@@ -179,7 +554,7 @@ static int leicaefi_led_brightness_set_unlocked(struct leicaefi_led *led,
 	u16 mask_value_efi = LEICAEFI_LED_VALUE_BIT_MASK;
 
 	/* workaround - do not change battery led status on device removal */
-	if ((led->desc->initial_brightness < 0) && (!led->efidev->worker_tsk)) {
+	if ((led->desc->initial_brightness < 0) && led->efidev->removing) {
 		return 0;
 	}
 
@@ -208,8 +583,8 @@ static int leicaefi_led_brightness_set(struct led_classdev *led_cdev,
 		__func__, led->id, int_value_kernel);
 
 	if (int_value_kernel == 0) {
-		led->delay_on_intervals = led->delay_off_intervals =
-			led->current_interval = 0;
+		led->delay_on_intervals = led->delay_off_intervals = 0;
+		leicaefi_leds_stop_unlocked(led->efidev);
 	}
 
 	rv = leicaefi_led_brightness_set_unlocked(led, int_value_kernel);
@@ -222,91 +597,6 @@ static int leicaefi_led_brightness_set(struct led_classdev *led_cdev,
 	return rv;
 }
 
-static void
-leicaefi_led_update_blink_state_unlocked(struct leicaefi_leds_device *efidev)
-{
-	size_t i = 0;
-	u16 reg_value_1 = 0;
-	u16 reg_value_2 = 0;
-	u16 reg_mask_1 = 0;
-	u16 reg_mask_2 = 0;
-
-	for (i = 0; i < EFI_LED_COUNT; i++) {
-		struct leicaefi_led *led = &efidev->leds[i];
-
-		bool state_on = true;
-
-		/* skip non-blinking LEDs */
-		if ((led->delay_off_intervals == 0) ||
-		    (led->delay_on_intervals == 0)) {
-			continue;
-		}
-
-		/* extra handling for 'opposite blinking' of two-color LEDs */
-		state_on = (led->current_interval < led->delay_on_intervals);
-
-		/* logic to synchronize blinking the two LEDs under one front panel icon
-		 * - they should blink in inverted cycle (if same parameters are set) so
-		 *   it will look e.g. like red/green/red/green and not yellow/blank/yellow */
-		if (i & 0x1) {
-			struct leicaefi_led *other_led = &efidev->leds[i - 1];
-
-			/* same rate, same on/off time */
-			if ((led->delay_off_intervals ==
-			     led->delay_on_intervals) &&
-			    (led->delay_off_intervals ==
-			     other_led->delay_off_intervals) &&
-			    (led->delay_on_intervals ==
-			     other_led->delay_on_intervals)) {
-				/* state is opposite to the other led */
-				state_on = (other_led->current_interval >=
-					    other_led->delay_on_intervals);
-			}
-		}
-
-		if (state_on != led->prev_state_on) {
-			u16 new_value_efi = (state_on) ?
-						    LEICAEFI_LED_VALUE_DIMMED :
-						    LEICAEFI_LED_VALUE_OFF;
-			u16 mask_value_efi = LEICAEFI_LED_VALUE_BIT_MASK;
-
-			new_value_efi <<= led->desc->efi_reg_offset;
-			mask_value_efi <<= led->desc->efi_reg_offset;
-
-			if (led->desc->efi_reg_no == LEICAEFI_REG_LED_CTRL1) {
-				reg_value_1 |= new_value_efi;
-				reg_mask_1 |= mask_value_efi;
-			} else {
-				reg_value_2 |= new_value_efi;
-				reg_mask_2 |= mask_value_efi;
-			}
-
-			led->prev_state_on = state_on;
-		}
-	}
-
-	leicaefi_led_set_register_unlocked(efidev, LEICAEFI_REG_LED_CTRL1,
-					   reg_value_1, reg_mask_1);
-	leicaefi_led_set_register_unlocked(efidev, LEICAEFI_REG_LED_CTRL2,
-					   reg_value_2, reg_mask_2);
-
-	for (i = 0; i < EFI_LED_COUNT; i++) {
-		struct leicaefi_led *led = &efidev->leds[i];
-
-		/* skip non-blinking LEDs */
-		if ((led->delay_off_intervals == 0) ||
-		    (led->delay_on_intervals == 0)) {
-			continue;
-		}
-
-		/* cycle interval */
-		if (++led->current_interval >=
-		    led->delay_on_intervals + led->delay_off_intervals) {
-			led->current_interval = 0;
-		}
-	}
-}
-
 static int leicaefi_led_blink_set(struct led_classdev *led_cdev,
 				  unsigned long *delay_on,
 				  unsigned long *delay_off)
@@ -345,13 +635,13 @@ static int leicaefi_led_blink_set(struct led_classdev *led_cdev,
 
 	mutex_lock(&led->efidev->lock);
 
-	/* store the settings */
+	/* store the settings, the cycle starts with the next step */
 	led->delay_on_intervals = *delay_on;
 	led->delay_off_intervals = *delay_off;
-	led->current_interval = 0;
+	led->blink_start_step = leicaefi_leds_start_unlocked(led->efidev) + 1;
 
-	/* turn the led off, timer will turn it on if needed */
-	led->prev_state_on = false;
+	/* turn the led off, worker will turn it on if needed */
+	led->prev_value_efi = LEICAEFI_LED_VALUE_OFF;
 	rv = leicaefi_led_brightness_set_unlocked(led, 0);
 
 	mutex_unlock(&led->efidev->lock);
@@ -369,92 +659,6 @@ static int leicaefi_led_blink_set(struct led_classdev *led_cdev,
 
 #ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
 
-static void
-leicaefi_led_update_pattern_unlocked(struct leicaefi_leds_device *efidev)
-{
-	size_t i = 0;
-	u16 reg_value_1 = 0;
-	u16 reg_value_2 = 0;
-	u16 reg_mask_1 = 0;
-	u16 reg_mask_2 = 0;
-	u64 current_bit_mask = ((u64)1 << efidev->current_pattern_step);
-
-	for (i = 0; i < EFI_LED_COUNT; i++) {
-		struct leicaefi_led *led = &efidev->leds[i];
-
-		bool state_on = true;
-
-		/* skip non-blinking LEDs */
-		if (led->trigger_pattern == 0) {
-			continue;
-		}
-
-		state_on = (led->trigger_pattern & current_bit_mask);
-
-		if (state_on != led->prev_state_on) {
-			u16 new_value_efi = (state_on) ?
-						    LEICAEFI_LED_VALUE_DIMMED :
-						    LEICAEFI_LED_VALUE_OFF;
-			u16 mask_value_efi = LEICAEFI_LED_VALUE_BIT_MASK;
-
-			new_value_efi <<= led->desc->efi_reg_offset;
-			mask_value_efi <<= led->desc->efi_reg_offset;
-
-			if (led->desc->efi_reg_no == LEICAEFI_REG_LED_CTRL1) {
-				reg_value_1 |= new_value_efi;
-				reg_mask_1 |= mask_value_efi;
-			} else {
-				reg_value_2 |= new_value_efi;
-				reg_mask_2 |= mask_value_efi;
-			}
-
-			led->prev_state_on = state_on;
-		}
-	}
-
-	leicaefi_led_set_register_unlocked(efidev, LEICAEFI_REG_LED_CTRL1,
-					   reg_value_1, reg_mask_1);
-	leicaefi_led_set_register_unlocked(efidev, LEICAEFI_REG_LED_CTRL2,
-					   reg_value_2, reg_mask_2);
-
-	if (++efidev->current_pattern_step == MAX_PATTERN_STEP) {
-		efidev->current_pattern_step = 0;
-	}
-}
-
-#endif /*CONFIG_LEDS_TRIGGER_BITPATTERN*/
-
-static int leicaefi_leds_thread_loop(void *data)
-{
-	struct leicaefi_leds_device *efidev =
-		(struct leicaefi_leds_device *)data;
-
-	dev_dbg(&efidev->pdev->dev, "%s - started\n", __func__);
-
-	while (!kthread_should_stop()) {
-		mutex_lock(&efidev->lock);
-
-		// left for debugging purposes
-		// dev_dbg(&efidev->pdev->dev, "%s - working\n", __func__);
-
-		leicaefi_led_update_blink_state_unlocked(efidev);
-
-#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
-		leicaefi_led_update_pattern_unlocked(efidev);
-#endif /*CONFIG_LEDS_TRIGGER_BITPATTERN*/
-
-		mutex_unlock(&efidev->lock);
-
-		msleep(STATE_REFRESH_INTERVAL_MS);
-	}
-
-	dev_dbg(&efidev->pdev->dev, "%s - finished\n", __func__);
-
-	return 0;
-}
-
-#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
-
 static int leicaefi_led_bit_pattern_set(struct led_classdev *led_cdev,
 					unsigned long step_delay, u64 pattern,
 					int pattern_len)
@@ -505,8 +709,9 @@ static int leicaefi_led_bit_pattern_set(struct led_classdev *led_cdev,
 		__func__, pattern);
 
 	led->trigger_pattern = pattern;
-	led->prev_state_on = false;
+	led->prev_value_efi = LEICAEFI_LED_VALUE_OFF;
 	leicaefi_led_brightness_set_unlocked(led, 0);
+	leicaefi_leds_start_unlocked(led->efidev);
 
 	mutex_unlock(&led->efidev->lock);
 
@@ -527,8 +732,9 @@ void leicaefi_led_bit_pattern_clear(struct led_classdev *led_cdev)
 	dev_dbg(&led->efidev->pdev->dev, "%s - working\n", __func__);
 
 	led->trigger_pattern = 0;
-	led->prev_state_on = false;
+	led->prev_value_efi = LEICAEFI_LED_VALUE_OFF;
 	leicaefi_led_brightness_set_unlocked(led, 0);
+	leicaefi_leds_stop_unlocked(led->efidev);
 
 	mutex_unlock(&led->efidev->lock);
 
@@ -537,30 +743,230 @@ void leicaefi_led_bit_pattern_clear(struct led_classdev *led_cdev)
 
 #endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
 
-static int leicaefi_leds_probe(struct platform_device *pdev)
+/*
+ * The frame attribute holds the state of all leds, in the order of
+ * EFI_LED_DESCRIPTORS, as whitespace separated '0' (off), '1' (on) or
+ * '-' (unchanged / unknown). Writing it removes the triggers and stops
+ * blinking of the given leds, then applies their states with at most two
+ * writes per LED_CTRL register: the bits of the leds turned off are
+ * cleared first, then the bits of the leds turned on are set. Between the
+ * two writes all changed leds are off, e.g. swapping the red and green
+ * led of an icon blanks it for the duration of one bus transfer.
+ */
+static ssize_t frame_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
 {
-	struct leicaefi_leds_device *efidev = NULL;
-	struct leicaefi_platform_data *pdata = NULL;
+	struct leicaefi_leds_device *efidev = dev_get_drvdata(dev);
+	ssize_t len = 0;
 	size_t i = 0;
 
-	dev_dbg(&pdev->dev, "%s\n", __func__);
+	mutex_lock(&efidev->lock);
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		const struct leicaefi_led_desc *desc = efidev->leds[i].desc;
+		size_t idx = desc->efi_reg_no - LEICAEFI_REG_LED_CTRL1;
+		u16 mask = LEICAEFI_LED_VALUE_BIT_MASK << desc->efi_reg_offset;
+		char state = '-';
+
+		if (efidev->reg_shadow_valid[idx]) {
+			state = (efidev->reg_shadow[idx] & mask) ? '1' : '0';
+		}
+
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%c%c", state,
+				 (i + 1 < EFI_LED_COUNT) ? ' ' : '\n');
+	}
+
+	mutex_unlock(&efidev->lock);
+
+	return len;
+}
+
+static ssize_t frame_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct leicaefi_leds_device *efidev = dev_get_drvdata(dev);
+	struct leicaefi_leds_frame frame = {};
+	const char *pos = buf;
+	u32 given_mask = 0;
+	u32 on_mask = 0;
+	size_t i = 0;
+	int rv = 0;
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		pos = skip_spaces(pos);
+
+		switch (*pos) {
+		case '0':
+			given_mask |= BIT(i);
+			break;
+		case '1':
+			given_mask |= BIT(i);
+			on_mask |= BIT(i);
+			break;
+		case '-':
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		pos++;
+		if ((*pos != '\0') && !isspace(*pos)) {
+			return -EINVAL;
+		}
+	}
+
+	if (*skip_spaces(pos) != '\0') {
+		return -EINVAL;
+	}
+
+	dev_dbg(dev, "%s given=0x%04X on=0x%04X\n", __func__, given_mask,
+		on_mask);
+
+	/*
+	 * Stop the triggers and software blinking in the led core first,
+	 * they may set the brightness from a work which must not undo the
+	 * frame afterwards.
+	 */
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		struct led_classdev *lc = &efidev->leds[i].lc;
+
+		if (!(given_mask & BIT(i))) {
+			continue;
+		}
+
+		led_trigger_remove(lc);
+		led_stop_software_blink(lc);
+		flush_work(&lc->set_brightness_work);
+	}
+
+	mutex_lock(&efidev->lock);
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		struct leicaefi_led *led = &efidev->leds[i];
+		u16 value_efi = (on_mask & BIT(i)) ? LEICAEFI_LED_VALUE_DIMMED :
+						     LEICAEFI_LED_VALUE_OFF;
+
+		if (!(given_mask & BIT(i))) {
+			continue;
+		}
+
+		led->delay_on_intervals = led->delay_off_intervals = 0;
+#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+		led->trigger_pattern = 0;
+#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
+		led->prev_value_efi = value_efi;
+		led->lc.brightness =
+			(on_mask & BIT(i)) ? led->lc.max_brightness : LED_OFF;
+
+		leicaefi_leds_frame_add(&frame, led, value_efi);
+	}
+
+	leicaefi_leds_stop_unlocked(efidev);
+
+	rv = leicaefi_leds_frame_commit_unlocked(efidev, &frame);
+
+	mutex_unlock(&efidev->lock);
+
+	return (rv != 0) ? rv : count;
+}
+static DEVICE_ATTR_RW(frame);
+
+static struct attribute *leicaefi_leds_attrs[] = {
+	&dev_attr_frame.attr,
+	NULL,
+};
+
+static const struct attribute_group leicaefi_leds_attr_group = {
+	.attrs = leicaefi_leds_attrs,
+};
+
+/* Must be called with the lock held. */
+static void
+leicaefi_leds_init_shadow_unlocked(struct leicaefi_leds_device *efidev)
+{
+	static const u8 regs[LEICAEFI_LED_REG_COUNT] = {
+		LEICAEFI_REG_LED_CTRL1,
+		LEICAEFI_REG_LED_CTRL2,
+	};
+	size_t i = 0;
+	int rv = 0;
+
+	rv = leicaefi_chip_read_multi(efidev->efichip, regs,
+				      efidev->reg_shadow,
+				      LEICAEFI_LED_REG_COUNT);
+	if (rv != 0) {
+		/* brightness_get reads the chip until the first write */
+		dev_warn(&efidev->pdev->dev,
+			 "%s - reading led registers failed rv=%d\n",
+			 __func__, rv);
+	}
+
+	for (i = 0; i < LEICAEFI_LED_REG_COUNT; i++) {
+		WRITE_ONCE(efidev->reg_shadow_valid[i], rv == 0);
+	}
+}
+
+/* Allocates the device with its leds set up, but not registered. */
+VISIBLE_IF_KUNIT struct leicaefi_leds_device *
+leicaefi_leds_alloc(struct device *dev)
+{
+	struct leicaefi_leds_device *efidev = NULL;
+	size_t i = 0;
 
-	efidev = devm_kzalloc(&pdev->dev, sizeof(*efidev), GFP_KERNEL);
+	efidev = devm_kzalloc(dev, sizeof(*efidev), GFP_KERNEL);
 	if (efidev == NULL) {
-		dev_err(&pdev->dev, "Cannot allocate memory for device\n");
-		return -ENOMEM;
+		dev_err(dev, "Cannot allocate memory for device\n");
+		return NULL;
 	}
 
-	efidev->leds = devm_kzalloc(&pdev->dev,
+	efidev->leds = devm_kzalloc(dev,
 				    EFI_LED_COUNT * sizeof(struct leicaefi_led),
 				    GFP_KERNEL);
 	if (efidev->leds == NULL) {
-		dev_err(&pdev->dev,
-			"Cannot allocate memory for led instances\n");
-		return -ENOMEM;
+		dev_err(dev, "Cannot allocate memory for led instances\n");
+		return NULL;
 	}
 
 	mutex_init(&efidev->lock);
+	INIT_DELAYED_WORK(&efidev->worker, leicaefi_leds_worker);
+
+	for (i = 0; i < EFI_LED_COUNT; i++) {
+		struct leicaefi_led *led = &efidev->leds[i];
+
+		led->desc = &EFI_LED_DESCRIPTORS[i];
+		led->efidev = efidev;
+		led->id = (int)i;
+		led->lc.name = EFI_LED_DESCRIPTORS[i].name;
+		led->lc.max_brightness = 1;
+		led->lc.brightness_get = leicaefi_led_brightness_get;
+		led->lc.brightness_set_blocking = leicaefi_led_brightness_set;
+		led->lc.blink_set = leicaefi_led_blink_set;
+
+#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+
+		led->lc.bit_pattern_set = leicaefi_led_bit_pattern_set;
+		led->lc.bit_pattern_clear = leicaefi_led_bit_pattern_clear;
+
+#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
+	}
+
+	return efidev;
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_leds_alloc);
+
+static int leicaefi_leds_probe(struct platform_device *pdev)
+{
+	struct leicaefi_leds_device *efidev = NULL;
+	struct leicaefi_platform_data *pdata = NULL;
+	size_t i = 0;
+	int rv = 0;
+
+	dev_dbg(&pdev->dev, "%s\n", __func__);
+
+	efidev = leicaefi_leds_alloc(&pdev->dev);
+	if (efidev == NULL) {
+		return -ENOMEM;
+	}
 
 	platform_set_drvdata(pdev, efidev);
 	efidev->pdev = pdev;
@@ -581,29 +987,6 @@ static int leicaefi_leds_probe(struct platform_device *pdev)
 	for (i = 0; i < EFI_LED_COUNT; i++) {
 		int ret = 0;
 
-		memset(&efidev->leds[i], 0, sizeof(efidev->leds[i]));
-		efidev->leds[i].desc = &EFI_LED_DESCRIPTORS[i];
-		efidev->leds[i].efidev = efidev;
-		efidev->leds[i].id = (int)i;
-		efidev->leds[i].lc.name = EFI_LED_DESCRIPTORS[i].name;
-		efidev->leds[i].lc.max_brightness = 1;
-		efidev->leds[i].lc.brightness_get = leicaefi_led_brightness_get;
-		efidev->leds[i].lc.brightness_set_blocking =
-			leicaefi_led_brightness_set;
-		efidev->leds[i].lc.blink_set = leicaefi_led_blink_set;
-
-#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
-
-		efidev->leds[i].lc.bit_pattern_set =
-			leicaefi_led_bit_pattern_set;
-		efidev->leds[i].lc.bit_pattern_clear =
-			leicaefi_led_bit_pattern_clear;
-
-#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
-
-		efidev->leds[i].delay_on_intervals = 0;
-		efidev->leds[i].delay_off_intervals = 0;
-
 		ret = devm_led_classdev_register(&efidev->pdev->dev,
 						 &efidev->leds[i].lc);
 		if (ret) {
@@ -615,6 +998,8 @@ static int leicaefi_leds_probe(struct platform_device *pdev)
 
 	mutex_lock(&efidev->lock);
 
+	leicaefi_leds_init_shadow_unlocked(efidev);
+
 	/* init leds */
 	for (i = 0; i < EFI_LED_COUNT; i++) {
 		if (efidev->leds[i].desc->initial_brightness >= 0) {
@@ -626,20 +1011,16 @@ static int leicaefi_leds_probe(struct platform_device *pdev)
 
 	mutex_unlock(&efidev->lock);
 
-	efidev->worker_tsk = kthread_create(leicaefi_leds_thread_loop, efidev,
-					    "leicaefi_leds_worker");
-	if (IS_ERR(efidev->worker_tsk)) {
-		int rv = PTR_ERR(efidev->worker_tsk);
-
-		dev_err(&efidev->pdev->dev, "Failed to create thread\n");
-		efidev->worker_tsk = NULL;
-
+	rv = devm_device_add_group(&pdev->dev, &leicaefi_leds_attr_group);
+	if (rv) {
+		dev_err(&pdev->dev, "%s - cannot add sysfs attributes: %d\n",
+			__func__, rv);
 		return rv;
 	}
 
-	dev_dbg(&pdev->dev, "%s - starting thread %p\n", __func__,
-		efidev->worker_tsk);
-	wake_up_process(efidev->worker_tsk);
+	mutex_lock(&leicaefi_leds_devices_lock);
+	list_add_tail(&efidev->node, &leicaefi_leds_devices);
+	mutex_unlock(&leicaefi_leds_devices_lock);
 
 	dev_dbg(&pdev->dev, "%s - done\n", __func__);
 
@@ -653,13 +1034,15 @@ static int leicaefi_leds_remove(struct platform_device *pdev)
 
 	dev_dbg(&pdev->dev, "%s\n", __func__);
 
-	if (efidev->worker_tsk) {
-		dev_dbg(&pdev->dev, "%s - stopping thread %p\n", __func__,
-			efidev->worker_tsk);
+	mutex_lock(&leicaefi_leds_devices_lock);
+	list_del(&efidev->node);
+	mutex_unlock(&leicaefi_leds_devices_lock);
 
-		kthread_stop(efidev->worker_tsk);
-		efidev->worker_tsk = NULL;
-	}
+	mutex_lock(&efidev->lock);
+	efidev->removing = true;
+	mutex_unlock(&efidev->lock);
+
+	cancel_delayed_work_sync(&efidev->worker);
 
 	/* unregister leds */
 	for (i = 0; i < EFI_LED_COUNT; i++) {
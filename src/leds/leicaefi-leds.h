@@ -0,0 +1,96 @@
+#ifndef _LINUX_LEICAEFI_LEDS_H
+#define _LINUX_LEICAEFI_LEDS_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/leds.h>
+#include <linux/platform_device.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+
+#include <common/leicaefi-chip.h>
+
+#define LEICAEFI_LED_VALUE_BIT_MASK 0x3 // two bits
+#define LEICAEFI_LED_VALUE_OFF 0
+#define LEICAEFI_LED_VALUE_FULLY_ON 1
+#define LEICAEFI_LED_VALUE_DIMMED 2
+#define LEICAEFI_LED_VALUE_DIMMED_BLINKING 3
+
+/* LED_CTRL1 and LED_CTRL2 */
+#define LEICAEFI_LED_REG_COUNT 2
+
+struct leicaefi_leds_device;
+
+/* New values of the LED_CTRL registers, applied together. */
+struct leicaefi_leds_frame {
+	u16 values[LEICAEFI_LED_REG_COUNT];
+	u16 masks[LEICAEFI_LED_REG_COUNT];
+};
+
+struct leicaefi_led_desc {
+	const char *name;
+	u8 efi_reg_no;
+	u16 efi_reg_offset;
+	int initial_brightness;
+};
+
+struct leicaefi_led {
+	struct leicaefi_leds_device *efidev;
+	const struct leicaefi_led_desc *desc;
+	struct led_classdev lc;
+	int id;
+
+	unsigned long delay_on_intervals;
+	unsigned long delay_off_intervals;
+	/* scheduler step in which the current blink cycle started */
+	unsigned long blink_start_step;
+	/* value last programmed by the worker */
+	u16 prev_value_efi;
+
+#ifdef CONFIG_LEDS_TRIGGER_BITPATTERN
+
+	u64 trigger_pattern;
+
+#endif /* CONFIG_LEDS_TRIGGER_BITPATTERN */
+};
+
+struct leicaefi_leds_device {
+	struct platform_device *pdev;
+	struct leicaefi_chip *efichip;
+	/* entry in the list of devices updated on hw_blink_delay_ms change */
+	struct list_head node;
+
+	struct leicaefi_led *leds;
+
+	struct mutex lock;
+
+	/*
+	 * Copy of the LED_CTRL registers cached by the chip layer, which
+	 * sends only the changed bits. Modified with the lock held,
+	 * brightness_get reads it without the lock.
+	 */
+	u16 reg_shadow[LEICAEFI_LED_REG_COUNT];
+	bool reg_shadow_valid[LEICAEFI_LED_REG_COUNT];
+
+	/*
+	 * Applies blink and pattern state changes. It is armed only while
+	 * some led blinks or has a pattern set and runs at the next state
+	 * transition. Steps are counted in refresh intervals from the epoch.
+	 */
+	struct delayed_work worker;
+	ktime_t epoch;
+	bool worker_armed;
+	bool removing;
+};
+
+#if IS_ENABLED(CONFIG_KUNIT)
+struct leicaefi_leds_device *leicaefi_leds_alloc(struct device *dev);
+bool leicaefi_led_blink_state(const struct leicaefi_led *led,
+			      unsigned long step, unsigned long *steps_left);
+unsigned long
+leicaefi_leds_update_unlocked(struct leicaefi_leds_device *efidev,
+			      unsigned long step);
+#endif /* CONFIG_KUNIT */
+
+#endif /*_LINUX_LEICAEFI_LEDS_H*/
@@ -1,5 +1,54 @@
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
+#include <kunit/visibility.h>
+
 #include "leicaefi-power.h"
 
+static unsigned int battery_snapshot_max_age_ms = 1000;
+module_param(battery_snapshot_max_age_ms, uint, 0644);
+MODULE_PARM_DESC(battery_snapshot_max_age_ms,
+		 "Maximum age of cached battery data in ms (0 - no caching)");
+
+/* samplers of the registered batteries, restarted when the interval changes */
+static LIST_HEAD(leicaefi_battery_samplers);
+static DEFINE_MUTEX(leicaefi_battery_samplers_lock);
+
+static unsigned int battery_sample_interval_ms;
+
+static int leicaefi_battery_sample_interval_set(const char *val,
+						const struct kernel_param *kp)
+{
+	struct leicaefi_battery_sampler *sampler = NULL;
+	int rv = param_set_uint(val, kp);
+
+	if (rv != 0) {
+		return rv;
+	}
+
+	/* the work takes a sample and rearms itself, or stops if disabled */
+	mutex_lock(&leicaefi_battery_samplers_lock);
+	list_for_each_entry(sampler, &leicaefi_battery_samplers, node) {
+		mod_delayed_work(system_power_efficient_wq, &sampler->work, 0);
+	}
+	mutex_unlock(&leicaefi_battery_samplers_lock);
+
+	return 0;
+}
+
+static const struct kernel_param_ops leicaefi_battery_sample_interval_ops = {
+	.set = leicaefi_battery_sample_interval_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(battery_sample_interval_ms,
+		&leicaefi_battery_sample_interval_ops,
+		&battery_sample_interval_ms, 0644);
+MODULE_PARM_DESC(battery_sample_interval_ms,
+		 "Battery power sampling interval in ms (0 - disabled)");
+
 static int leicaefi_battery_get_property(struct power_supply *psy,
 					 enum power_supply_property psp,
 					 union power_supply_propval *val);
@@ -23,6 +72,7 @@ static enum power_supply_property leicaefi_power_battery_properties[] = {
 	POWER_SUPPLY_PROP_VOLTAGE_NOW,
 	POWER_SUPPLY_PROP_TEMP,
 	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_POWER_AVG,
 };
 
 static const struct leicaefi_battery_desc leicaefi_bat1_psy_desc = {
@@ -36,163 +86,540 @@ static const struct leicaefi_battery_desc leicaefi_bat1_psy_desc = {
         .property_is_writeable = leicaefi_battery_property_is_writeable,
     },
     .validity_bit = LEICAEFI_POWERSRCBIT_BAT1VAL,
+    .active_bit = LEICAEFI_POWERSRCBIT_BAT1ACT,
 };
 
-static int leicaefi_battery_is_present(struct leicaefi_battery *battery,
-				       int *val)
-{
-	u16 reg_value = 0;
-
-	int rv = leicaefi_chip_read(battery->efidev->efichip,
-				    LEICAEFI_REG_PWR_SRC_STATUS, &reg_value);
-	*val = (reg_value & battery->desc->validity_bit) ? 1 : 0;
+static const u8 leicaefi_battery_msg_cmds[LEICAEFI_BATTERY_MSG_COUNT] = {
+	[LEICAEFI_BATTERY_MSG_TEMPERATURE] = LEICAEFI_BAT_MSG_TEMPERATURE,
+	[LEICAEFI_BATTERY_MSG_VOLTAGE] = LEICAEFI_BAT_MSG_VOLTAGE,
+	[LEICAEFI_BATTERY_MSG_CURRENT] = LEICAEFI_BAT_MSG_CURRENT,
+	[LEICAEFI_BATTERY_MSG_AVERAGE_CURRENT] =
+		LEICAEFI_BAT_MSG_AVERAGE_CURRENT,
+	[LEICAEFI_BATTERY_MSG_RUN_TIME_TO_EMPTY] =
+		LEICAEFI_BAT_MSG_RUN_TIME_TO_EMPTY,
+	[LEICAEFI_BATTERY_MSG_AVERAGE_TIME_TO_EMPTY] =
+		LEICAEFI_BAT_MSG_AVERAGE_TIME_TO_EMPTY,
+	[LEICAEFI_BATTERY_MSG_AVERAGE_TIME_TO_FULL] =
+		LEICAEFI_BAT_MSG_AVERAGE_TIME_TO_FULL,
+	[LEICAEFI_BATTERY_MSG_CYCLE_COUNT] = LEICAEFI_BAT_MSG_CYCLE_COUNT,
+};
 
-	dev_dbg(&battery->supply->dev, "%s value=%d rv=%d\n", __func__, *val,
-		rv);
+static void
+leicaefi_battery_msgs_put(struct leicaefi_battery_snapshot *snapshot)
+{
+	if (atomic_dec_and_test(&snapshot->pending)) {
+		complete(&snapshot->done);
+	}
+}
 
-	return rv;
+static void leicaefi_battery_msg_complete(struct leicaefi_gencmd_request *req)
+{
+	leicaefi_battery_msgs_put(req->context);
 }
 
-static int leicaefi_battery_get_capacity(struct leicaefi_battery *battery,
-					 int *val)
+static void leicaefi_battery_read_msgs(struct leicaefi_battery *battery)
 {
-	u16 reg_value = 0;
+	struct leicaefi_battery_snapshot *snapshot = &battery->snapshot;
+	int i = 0;
+	int rv = 0;
 
-	int rv = leicaefi_chip_read(battery->efidev->efichip,
-				    LEICAEFI_REG_BAT_1_RSOC, &reg_value);
-	*val = reg_value;
+	/*
+	 * All messages are queued at once and executed back to back, the
+	 * extra reference is held by the submitter until all are queued.
+	 */
+	reinit_completion(&snapshot->done);
+	atomic_set(&snapshot->pending, LEICAEFI_BATTERY_MSG_COUNT + 1);
+
+	for (i = 0; i < LEICAEFI_BATTERY_MSG_COUNT; ++i) {
+		struct leicaefi_gencmd_request *req = &snapshot->requests[i];
+
+		memset(req, 0, sizeof(*req));
+		req->cmd = LEICAEFI_CMD_BATTERY1_READMSG_MASK |
+			   leicaefi_battery_msg_cmds[i];
+		req->complete = leicaefi_battery_msg_complete;
+		req->context = snapshot;
+
+		rv = leicaefi_chip_gencmd_submit(battery->efidev->efichip, req);
+		if (rv != 0) {
+			req->result = rv;
+			leicaefi_battery_msgs_put(snapshot);
+		}
+	}
 
-	dev_dbg(&battery->supply->dev, "%s value=%d rv=%d\n", __func__, *val,
-		rv);
+	leicaefi_battery_msgs_put(snapshot);
+	wait_for_completion(&snapshot->done);
 
-	return rv;
+	for (i = 0; i < LEICAEFI_BATTERY_MSG_COUNT; ++i) {
+		snapshot->msg_result[i] = snapshot->requests[i].result;
+		snapshot->msg_value[i] = snapshot->requests[i].output_data;
+
+		if (snapshot->msg_result[i] != 0) {
+			dev_warn(
+				&battery->supply->dev,
+				"%s cmd %d, failed to execute battery command, error %d\n",
+				__func__, (int)leicaefi_battery_msg_cmds[i],
+				snapshot->msg_result[i]);
+		}
+	}
 }
 
-static int leicaefi_battery_read_msg(struct leicaefi_battery *battery, u8 cmd,
-				     int *val, int default_value)
+static int leicaefi_battery_refresh(struct leicaefi_battery *battery)
 {
-	u16 reg_value = 0;
+	static const u8 regs[] = { LEICAEFI_REG_PWR_SRC_STATUS,
+				   LEICAEFI_REG_BAT_1_RSOC };
+	struct leicaefi_battery_snapshot *snapshot = &battery->snapshot;
+	u16 values[ARRAY_SIZE(regs)] = { 0 };
+	int generation = atomic_read(&snapshot->generation);
 	int rv = 0;
-	int exists = 0;
-
-	*val = default_value;
 
-	// check if battery is present, if not do not send message as it may hang forever
-	rv = leicaefi_battery_is_present(battery, &exists);
+	rv = leicaefi_chip_read_multi(battery->efidev->efichip, regs, values,
+				      ARRAY_SIZE(regs));
 	if (rv != 0) {
-		dev_warn(
-			&battery->supply->dev,
-			"%s cmd %d, failed to get battery presence, error %d\n",
-			__func__, (int)cmd, rv);
+		dev_warn(&battery->supply->dev,
+			 "%s failed to read battery status, error %d\n",
+			 __func__, rv);
 		return rv;
 	}
-	if (!exists) {
-		dev_dbg(&battery->supply->dev,
-			"%s cmd=%d, battery not present, default value=%d\n",
-			__func__, (int)cmd, *val);
 
+	snapshot->present = (values[0] & battery->desc->validity_bit) ? 1 : 0;
+	snapshot->rsoc = values[1];
+
+	// if battery is not present do not send messages as it may hang forever
+	if (snapshot->present) {
+		leicaefi_battery_read_msgs(battery);
+	} else {
+		memset(snapshot->msg_result, 0, sizeof(snapshot->msg_result));
+		memset(snapshot->msg_value, 0, sizeof(snapshot->msg_value));
+	}
+
+	/* if invalidated meanwhile the data will be refreshed on next use */
+	snapshot->data_generation = generation;
+	snapshot->timestamp = jiffies;
+	snapshot->fetch_time = ktime_get();
+
+	dev_dbg(&battery->supply->dev, "%s present=%d rsoc=%d\n", __func__,
+		snapshot->present, (int)snapshot->rsoc);
+
+	return 0;
+}
+
+/*
+ * Lock free as it is called from the IRQ thread, which may be needed to
+ * complete the refresh holding the lock.
+ */
+void leicaefi_battery_invalidate(struct leicaefi_battery *battery)
+{
+	atomic_inc(&battery->snapshot.generation);
+}
+
+/* Called with the snapshot lock held, refreshes the data if too old. */
+static int leicaefi_battery_update(struct leicaefi_battery *battery)
+{
+	struct leicaefi_battery_snapshot *snapshot = &battery->snapshot;
+	unsigned int max_age_ms = READ_ONCE(battery_snapshot_max_age_ms);
+
+	if ((snapshot->data_generation ==
+	     atomic_read(&snapshot->generation)) &&
+	    time_before(jiffies, snapshot->timestamp +
+					 msecs_to_jiffies(max_age_ms))) {
 		return 0;
 	}
 
-	rv = leicaefi_chip_gencmd(battery->efidev->efichip,
-				  LEICAEFI_CMD_BATTERY1_READMSG_MASK | cmd, 0,
-				  &reg_value);
+	return leicaefi_battery_refresh(battery);
+}
+
+static int leicaefi_battery_get_value(struct leicaefi_battery *battery,
+				      enum power_supply_property psp, int *val)
+{
+	struct leicaefi_battery_snapshot *snapshot = &battery->snapshot;
+	enum leicaefi_battery_msg msg = LEICAEFI_BATTERY_MSG_COUNT;
+	int rv = 0;
+
+	switch (psp) {
+	case POWER_SUPPLY_PROP_PRESENT:
+	case POWER_SUPPLY_PROP_CAPACITY:
+		break;
+	case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW:
+		msg = LEICAEFI_BATTERY_MSG_RUN_TIME_TO_EMPTY;
+		break;
+	case POWER_SUPPLY_PROP_TIME_TO_EMPTY_AVG:
+		msg = LEICAEFI_BATTERY_MSG_AVERAGE_TIME_TO_EMPTY;
+		break;
+	case POWER_SUPPLY_PROP_TIME_TO_FULL_AVG:
+		msg = LEICAEFI_BATTERY_MSG_AVERAGE_TIME_TO_FULL;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_NOW:
+		msg = LEICAEFI_BATTERY_MSG_CURRENT;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_AVG:
+		msg = LEICAEFI_BATTERY_MSG_AVERAGE_CURRENT;
+		break;
+	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
+		msg = LEICAEFI_BATTERY_MSG_VOLTAGE;
+		break;
+	case POWER_SUPPLY_PROP_TEMP:
+		msg = LEICAEFI_BATTERY_MSG_TEMPERATURE;
+		break;
+	case POWER_SUPPLY_PROP_CYCLE_COUNT:
+		msg = LEICAEFI_BATTERY_MSG_CYCLE_COUNT;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	mutex_lock(&snapshot->lock);
+
+	rv = leicaefi_battery_update(battery);
 	if (rv != 0) {
-		dev_warn(
-			&battery->supply->dev,
-			"%s cmd %d, failed to execute battery command, error %d\n",
-			__func__, (int)cmd, rv);
+		mutex_unlock(&snapshot->lock);
 		return rv;
 	}
 
-	*val = reg_value;
+	if (psp == POWER_SUPPLY_PROP_PRESENT) {
+		*val = snapshot->present;
+	} else if (psp == POWER_SUPPLY_PROP_CAPACITY) {
+		*val = snapshot->rsoc;
+	} else {
+		rv = snapshot->msg_result[msg];
+		*val = (rv == 0) ? snapshot->msg_value[msg] : 0;
+	}
 
-	dev_dbg(&battery->supply->dev, "%s cmd=%d, success, value=%d\n",
-		__func__, (int)cmd, *val);
+	mutex_unlock(&snapshot->lock);
 
-	return 0;
+	dev_dbg(&battery->supply->dev, "%s property=%d value=%d rv=%d\n",
+		__func__, psp, *val, rv);
+
+	return rv;
 }
 
-static int leicaefi_battery_read_time_min(struct leicaefi_battery *battery,
-					  u8 cmd, int *val, int default_value)
+static int leicaefi_battery_get_time_min(struct leicaefi_battery *battery,
+					 enum power_supply_property psp,
+					 int *val)
 {
-	int rv = leicaefi_battery_read_msg(battery, cmd, val, default_value);
+	int rv = leicaefi_battery_get_value(battery, psp, val);
 	if (rv == 0) {
-		*val *= 60; // min to sec
+		*val = leicaefi_battery_min_to_sec(*val);
 	}
 	return rv;
 }
 
-static int leicaefi_battery_read_micro_unit(struct leicaefi_battery *battery,
-					    u8 cmd, int *val, int default_value)
+static int leicaefi_battery_get_micro_unit(struct leicaefi_battery *battery,
+					   enum power_supply_property psp,
+					   int *val)
 {
-	int rv = leicaefi_battery_read_msg(battery, cmd, val, default_value);
+	int rv = leicaefi_battery_get_value(battery, psp, val);
 	if (rv == 0) {
-		*val *= 1000; // milli to micro
+		*val = leicaefi_battery_milli_to_micro(*val);
 	}
 	return rv;
 }
 
-static int
-leicaefi_battery_get_time_to_empty_now(struct leicaefi_battery *battery,
-				       int *val)
+static int leicaefi_battery_get_temp(struct leicaefi_battery *battery, int *val)
 {
-	return leicaefi_battery_read_time_min(
-		battery, LEICAEFI_BAT_MSG_RUN_TIME_TO_EMPTY, val, 0);
+	int rv = leicaefi_battery_get_value(battery, POWER_SUPPLY_PROP_TEMP,
+					    val);
+	if (rv == 0) {
+		*val = leicaefi_battery_dk_to_dc(*val);
+	}
+	return rv;
 }
 
-static int
-leicaefi_battery_get_time_to_empty_avg(struct leicaefi_battery *battery,
-				       int *val)
+/*
+ * Refreshes the snapshot and reads voltage and current from it. The cached
+ * data is not used as it may be older than the sampling interval.
+ */
+static int leicaefi_battery_sample_read(struct leicaefi_battery *battery,
+					ktime_t *time, s32 *voltage_mv,
+					s32 *current_ma)
 {
-	return leicaefi_battery_read_time_min(
-		battery, LEICAEFI_BAT_MSG_AVERAGE_TIME_TO_EMPTY, val, 0);
+	struct leicaefi_battery_snapshot *snapshot = &battery->snapshot;
+	int rv = 0;
+
+	mutex_lock(&snapshot->lock);
+
+	rv = leicaefi_battery_refresh(battery);
+	if (rv == 0 && !snapshot->present) {
+		rv = -ENODEV;
+	}
+	if (rv == 0) {
+		rv = snapshot->msg_result[LEICAEFI_BATTERY_MSG_VOLTAGE];
+	}
+	if (rv == 0) {
+		rv = snapshot->msg_result[LEICAEFI_BATTERY_MSG_CURRENT];
+	}
+	if (rv == 0) {
+		*time = snapshot->fetch_time;
+		*voltage_mv =
+			snapshot->msg_value[LEICAEFI_BATTERY_MSG_VOLTAGE];
+		*current_ma = leicaefi_battery_current_ma(
+			snapshot->msg_value[LEICAEFI_BATTERY_MSG_CURRENT]);
+	}
+
+	mutex_unlock(&snapshot->lock);
+
+	return rv;
 }
 
-static int
-leicaefi_battery_get_time_to_full_avg(struct leicaefi_battery *battery,
-				      int *val)
+VISIBLE_IF_KUNIT void
+leicaefi_battery_sampler_add(struct leicaefi_battery_sampler *sampler,
+			     ktime_t now, s32 voltage_mv, s32 current_ma)
+{
+	struct leicaefi_battery_sample *sample = NULL;
+	s64 power_uw = -(s64)voltage_mv * current_ma;
+
+	mutex_lock(&sampler->lock);
+
+	if (sampler->has_prev) {
+		s64 dt_ms = ktime_ms_delta(now, sampler->prev_time);
+
+		/* trapezoidal integration, uW * ms = nJ */
+		sampler->energy_nj +=
+			div_s64((sampler->prev_power_uw + power_uw) * dt_ms, 2);
+		sampler->power_avg_uw +=
+			div_s64(power_uw - sampler->power_avg_uw,
+				LEICAEFI_BATTERY_POWER_AVG_WEIGHT);
+	} else if (!sampler->has_data) {
+		sampler->power_avg_uw = power_uw;
+	}
+
+	sampler->has_prev = true;
+	sampler->has_data = true;
+	sampler->prev_time = now;
+	sampler->prev_power_uw = power_uw;
+
+	if (sampler->window_count == 0 || power_uw < sampler->window_min_uw) {
+		sampler->window_min_uw = power_uw;
+	}
+	if (sampler->window_count == 0 || power_uw > sampler->window_max_uw) {
+		sampler->window_max_uw = power_uw;
+	}
+	if (++sampler->window_count == LEICAEFI_BATTERY_WINDOW_SAMPLES) {
+		sampler->last_min_uw = sampler->window_min_uw;
+		sampler->last_max_uw = sampler->window_max_uw;
+		sampler->window_count = 0;
+	}
+
+	sample = &sampler->samples[sampler->samples_head];
+	sample->timestamp_ns = ktime_to_ns(now);
+	sample->voltage_mv = voltage_mv;
+	sample->current_ma = current_ma;
+	sample->power_uw = power_uw;
+	sample->energy_uwh = div_s64(sampler->energy_nj, 3600000);
+
+	sampler->samples_head =
+		(sampler->samples_head + 1) % LEICAEFI_BATTERY_SAMPLES_COUNT;
+	if (sampler->samples_count < LEICAEFI_BATTERY_SAMPLES_COUNT) {
+		++sampler->samples_count;
+	}
+
+	mutex_unlock(&sampler->lock);
+}
+EXPORT_SYMBOL_IF_KUNIT(leicaefi_battery_sampler_add);
+
+static void leicaefi_battery_sampler_work(struct work_struct *work)
+{
+	struct leicaefi_battery_sampler *sampler = container_of(
+		to_delayed_work(work), struct leicaefi_battery_sampler, work);
+	struct leicaefi_battery *battery =
+		container_of(sampler, struct leicaefi_battery, sampler);
+	unsigned int interval_ms = READ_ONCE(battery_sample_interval_ms);
+	ktime_t time = 0;
+	s32 voltage_mv = 0;
+	s32 current_ma = 0;
+	int rv = 0;
+
+	if (interval_ms == 0) {
+		/*
+		 * Disabled, the work is queued again when the interval is set.
+		 * The next sample starts a new integration period.
+		 */
+		mutex_lock(&sampler->lock);
+		sampler->has_prev = false;
+		mutex_unlock(&sampler->lock);
+		return;
+	}
+
+	rv = leicaefi_battery_sample_read(battery, &time, &voltage_mv,
+					  &current_ma);
+	if (rv == 0) {
+		leicaefi_battery_sampler_add(sampler, time, voltage_mv,
+					     current_ma);
+	} else {
+		/* energy is not integrated over the gap */
+		mutex_lock(&sampler->lock);
+		sampler->has_prev = false;
+		mutex_unlock(&sampler->lock);
+	}
+
+	queue_delayed_work(system_power_efficient_wq, &sampler->work,
+			   msecs_to_jiffies(interval_ms));
+}
+
+/*
+ * The energy drawn is accumulated since the sampler start, which is not the
+ * remaining energy of ENERGY_NOW, so it is only reported in debugfs.
+ */
+static int leicaefi_battery_get_power_avg(struct leicaefi_battery *battery,
+					  int *val)
+{
+	struct leicaefi_battery_sampler *sampler = &battery->sampler;
+	int rv = 0;
+
+	mutex_lock(&sampler->lock);
+
+	if (!sampler->has_data) {
+		rv = -ENODATA;
+	} else {
+		*val = (int)sampler->power_avg_uw;
+	}
+
+	mutex_unlock(&sampler->lock);
+
+	return rv;
+}
+
+/* Samples present when the 'samples' file was opened, oldest first. */
+struct leicaefi_battery_samples_copy {
+	size_t size;
+	struct leicaefi_battery_sample samples[LEICAEFI_BATTERY_SAMPLES_COUNT];
+};
+
+static int leicaefi_battery_samples_open(struct inode *inode,
+					 struct file *file)
 {
-	return leicaefi_battery_read_time_min(
-		battery, LEICAEFI_BAT_MSG_AVERAGE_TIME_TO_FULL, val, 0);
+	struct leicaefi_battery_sampler *sampler = inode->i_private;
+	struct leicaefi_battery_samples_copy *copy = NULL;
+	unsigned int first = 0;
+	unsigned int i = 0;
+
+	copy = kzalloc(sizeof(*copy), GFP_KERNEL);
+	if (!copy) {
+		return -ENOMEM;
+	}
+
+	/* the file shows the samples present when opened, oldest first */
+	mutex_lock(&sampler->lock);
+	first = (sampler->samples_head + LEICAEFI_BATTERY_SAMPLES_COUNT -
+		 sampler->samples_count) %
+		LEICAEFI_BATTERY_SAMPLES_COUNT;
+	for (i = 0; i < sampler->samples_count; ++i) {
+		copy->samples[i] =
+			sampler->samples[(first + i) %
+					 LEICAEFI_BATTERY_SAMPLES_COUNT];
+	}
+	copy->size = sampler->samples_count * sizeof(copy->samples[0]);
+	mutex_unlock(&sampler->lock);
+
+	file->private_data = copy;
+
+	return nonseekable_open(inode, file);
 }
 
-static int leicaefi_battery_get_current_now(struct leicaefi_battery *battery,
-					    int *val)
+static ssize_t leicaefi_battery_samples_read(struct file *file,
+					     char __user *buffer, size_t length,
+					     loff_t *offset)
 {
-	return leicaefi_battery_read_micro_unit(
-		battery, LEICAEFI_BAT_MSG_CURRENT, val, 0);
+	struct leicaefi_battery_samples_copy *copy = file->private_data;
+
+	return simple_read_from_buffer(buffer, length, offset, copy->samples,
+				       copy->size);
 }
 
-static int leicaefi_battery_get_current_avg(struct leicaefi_battery *battery,
-					    int *val)
+static int leicaefi_battery_samples_release(struct inode *inode,
+					    struct file *file)
 {
-	return leicaefi_battery_read_micro_unit(
-		battery, LEICAEFI_BAT_MSG_AVERAGE_CURRENT, val, 0);
+	kfree(file->private_data);
+
+	return 0;
 }
 
-static int leicaefi_battery_get_voltage_now(struct leicaefi_battery *battery,
-					    int *val)
+static const struct file_operations leicaefi_battery_samples_fops = {
+	.owner = THIS_MODULE,
+	.open = leicaefi_battery_samples_open,
+	.read = leicaefi_battery_samples_read,
+	.release = leicaefi_battery_samples_release,
+	.llseek = noop_llseek,
+};
+
+static int leicaefi_battery_energy_show(struct seq_file *s, void *data)
 {
-	return leicaefi_battery_read_micro_unit(
-		battery, LEICAEFI_BAT_MSG_VOLTAGE, val, 0);
+	struct leicaefi_battery_sampler *sampler = s->private;
+
+	mutex_lock(&sampler->lock);
+	seq_printf(s, "energy_uwh: %lld\n",
+		   (long long)div_s64(sampler->energy_nj, 3600000));
+	seq_printf(s, "power_avg_uw: %lld\n",
+		   (long long)sampler->power_avg_uw);
+	seq_printf(s, "power_min_uw: %lld\n",
+		   (long long)sampler->last_min_uw);
+	seq_printf(s, "power_max_uw: %lld\n",
+		   (long long)sampler->last_max_uw);
+	seq_printf(s, "samples: %u\n", sampler->samples_count);
+	mutex_unlock(&sampler->lock);
+
+	return 0;
 }
 
-static int leicaefi_battery_get_temp(struct leicaefi_battery *battery, int *val)
+static int leicaefi_battery_energy_open(struct inode *inode,
+					struct file *file)
 {
-	int rv = leicaefi_battery_read_msg(
-		battery, LEICAEFI_BAT_MSG_TEMPERATURE, val, 0);
-	if (rv == 0) {
-		*val -= 2732; // 0.1K to 0.1C (273.15 changed to tenths)
-	}
-	return rv;
+	return single_open(file, leicaefi_battery_energy_show,
+			   inode->i_private);
 }
 
-static int leicaefi_battery_get_cycle_count(struct leicaefi_battery *battery,
-					    int *val)
+static const struct file_operations leicaefi_battery_energy_fops = {
+	.owner = THIS_MODULE,
+	.open = leicaefi_battery_energy_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void leicaefi_battery_sampler_stop(void *data)
 {
-	return leicaefi_battery_read_msg(battery, LEICAEFI_BAT_MSG_CYCLE_COUNT,
-					 val, 0);
+	struct leicaefi_battery *battery = data;
+
+	mutex_lock(&leicaefi_battery_samplers_lock);
+	list_del(&battery->sampler.node);
+	mutex_unlock(&leicaefi_battery_samplers_lock);
+
+	debugfs_remove_recursive(battery->sampler.debugfs_dir);
+	cancel_delayed_work_sync(&battery->sampler.work);
+}
+
+static int leicaefi_battery_sampler_init(struct leicaefi_battery *battery)
+{
+	struct leicaefi_battery_sampler *sampler = &battery->sampler;
+	struct device *dev = &battery->efidev->pdev->dev;
+
+	mutex_init(&sampler->lock);
+	INIT_DELAYED_WORK(&sampler->work, leicaefi_battery_sampler_work);
+
+	sampler->samples =
+		devm_kcalloc(dev, LEICAEFI_BATTERY_SAMPLES_COUNT,
+			     sizeof(*sampler->samples), GFP_KERNEL);
+	if (!sampler->samples) {
+		return -ENOMEM;
+	}
+
+	/* debugfs errors are not fatal, the functions accept error values */
+	sampler->debugfs_dir =
+		debugfs_create_dir(battery->desc->kernel_desc.name, NULL);
+	debugfs_create_file("samples", 0444, sampler->debugfs_dir, sampler,
+			    &leicaefi_battery_samples_fops);
+	debugfs_create_file("energy", 0444, sampler->debugfs_dir, sampler,
+			    &leicaefi_battery_energy_fops);
+
+	mutex_lock(&leicaefi_battery_samplers_lock);
+	list_add_tail(&sampler->node, &leicaefi_battery_samplers);
+	if (battery_sample_interval_ms != 0) {
+		queue_delayed_work(system_power_efficient_wq, &sampler->work,
+				   0);
+	}
+	mutex_unlock(&leicaefi_battery_samplers_lock);
+
+	return devm_add_action_or_reset(dev, leicaefi_battery_sampler_stop,
+					battery);
 }
 
 static int leicaefi_battery_get_property(struct power_supply *psy,
@@ -205,28 +632,23 @@ static int leicaefi_battery_get_property(struct power_supply *psy,
 
 	switch (psp) {
 	case POWER_SUPPLY_PROP_PRESENT:
-		return leicaefi_battery_is_present(battery, &val->intval);
 	case POWER_SUPPLY_PROP_CAPACITY:
-		return leicaefi_battery_get_capacity(battery, &val->intval);
+	case POWER_SUPPLY_PROP_CYCLE_COUNT:
+		return leicaefi_battery_get_value(battery, psp, &val->intval);
 	case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW:
-		return leicaefi_battery_get_time_to_empty_now(battery,
-							      &val->intval);
 	case POWER_SUPPLY_PROP_TIME_TO_EMPTY_AVG:
-		return leicaefi_battery_get_time_to_empty_avg(battery,
-							      &val->intval);
 	case POWER_SUPPLY_PROP_TIME_TO_FULL_AVG:
-		return leicaefi_battery_get_time_to_full_avg(battery,
-							     &val->intval);
+		return leicaefi_battery_get_time_min(battery, psp,
+						     &val->intval);
 	case POWER_SUPPLY_PROP_CURRENT_NOW:
-		return leicaefi_battery_get_current_now(battery, &val->intval);
 	case POWER_SUPPLY_PROP_CURRENT_AVG:
-		return leicaefi_battery_get_current_avg(battery, &val->intval);
 	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
-		return leicaefi_battery_get_voltage_now(battery, &val->intval);
+		return leicaefi_battery_get_micro_unit(battery, psp,
+						       &val->intval);
 	case POWER_SUPPLY_PROP_TEMP:
 		return leicaefi_battery_get_temp(battery, &val->intval);
-	case POWER_SUPPLY_PROP_CYCLE_COUNT:
-		return leicaefi_battery_get_cycle_count(battery, &val->intval);
+	case POWER_SUPPLY_PROP_POWER_AVG:
+		return leicaefi_battery_get_power_avg(battery, &val->intval);
 	default:
 		break;
 	}
@@ -265,6 +687,12 @@ static int leicaefi_battery_register(struct leicaefi_power_device *efidev,
 	battery->efidev = efidev;
 	battery->desc = desc;
 
+	mutex_init(&battery->snapshot.lock);
+	init_completion(&battery->snapshot.done);
+	/* no data taken yet */
+	atomic_set(&battery->snapshot.generation, 1);
+	battery->snapshot.data_generation = 0;
+
 	battery->supply = devm_power_supply_register(
 		&efidev->pdev->dev, &battery->desc->kernel_desc, &config);
 	if (IS_ERR(battery->supply)) {
@@ -273,7 +701,8 @@ static int leicaefi_battery_register(struct leicaefi_power_device *efidev,
 			battery->desc->kernel_desc.name);
 		return PTR_ERR(battery->supply);
 	}
-	return 0;
+
+	return leicaefi_battery_sampler_init(battery);
 }
 
 int leicaefi_power_init_bat1(struct leicaefi_power_device *efidev)
@@ -1,3 +1,5 @@
+#include <common/leicaefi-adc.h>
+
 #include "leicaefi-power.h"
 
 static int leicaefi_charger_get_property(struct power_supply *psy,
@@ -30,6 +32,7 @@ static const struct leicaefi_charger_desc leicaefi_ext1_psy_desc = {
         .property_is_writeable = leicaefi_charger_property_is_writeable,
     },
     .validity_bit = LEICAEFI_POWERSRCBIT_EXT1VAL,
+    .active_bit = LEICAEFI_POWERSRCBIT_EXT1ACT,
     .voltage_register = LEICAEFI_REG_PWR_VEXT1,
 };
 
@@ -44,6 +47,7 @@ static const struct leicaefi_charger_desc leicaefi_ext2_psy_desc = {
         .property_is_writeable = leicaefi_charger_property_is_writeable,
     },
     .validity_bit = LEICAEFI_POWERSRCBIT_EXT2VAL,
+    .active_bit = LEICAEFI_POWERSRCBIT_EXT2ACT,
     .voltage_register = LEICAEFI_REG_PWR_VEXT2,
 };
 
@@ -58,6 +62,7 @@ static const struct leicaefi_charger_desc leicaefi_poe1_psy_desc = {
         .property_is_writeable = leicaefi_charger_property_is_writeable,
     },
     .validity_bit = LEICAEFI_POWERSRCBIT_POE1VAL,
+    .active_bit = LEICAEFI_POWERSRCBIT_POE1ACT,
     .voltage_register = LEICAEFI_REG_PWR_VPOE1,
 };
 
@@ -80,27 +85,12 @@ static int leicaefi_charger_get_voltage(struct leicaefi_charger *charger,
 					int *val)
 {
 	u16 reg_value = 0;
-	int value = 0;
 
 	int rv =
 		leicaefi_chip_read(charger->efidev->efichip,
 				   charger->desc->voltage_register, &reg_value);
 
-	static const int ADC_RESOLUTION = 0x03FF; // 10 bit
-
-	static const int ADC_VREF = 2500;
-	static const int ADC_DIVIDER_R1 = 104700;
-	static const int ADC_DIVIDER_R2 = 10000;
-	static const int ADC_MAX = ADC_RESOLUTION;
-	static const int ADC_VREF_COMP =
-		(ADC_VREF * (ADC_DIVIDER_R1 + ADC_DIVIDER_R2) / ADC_DIVIDER_R2);
-
-	value = (reg_value & ADC_RESOLUTION);
-	value *= ADC_VREF_COMP;
-	value /= ADC_MAX;
-	value *= 1000;
-
-	*val = value;
+	*val = leicaefi_adc_to_microvolts(reg_value);
 
 	dev_dbg(&charger->supply->dev, "%s value=%d rv=%d\n", __func__, *val,
 		rv);
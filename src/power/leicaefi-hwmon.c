@@ -0,0 +1,285 @@
+#include <linux/hwmon.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+
+#include <common/leicaefi-adc.h>
+
+#include "leicaefi-power.h"
+
+/* Registers sampled together, supply rails first then the temperature. */
+static const u8 leicaefi_hwmon_regs[LEICAEFI_HWMON_CHANNELS] = {
+	LEICAEFI_REG_PWR_VPOE1, LEICAEFI_REG_PWR_VEXT1, LEICAEFI_REG_PWR_VEXT2,
+	LEICAEFI_REG_PWR_VBAT1, LEICAEFI_REG_PWR_VLINE, LEICAEFI_REG_TEMP_DATA,
+};
+
+static const char *const leicaefi_hwmon_labels[LEICAEFI_HWMON_CHANNELS] = {
+	"vpoe1", "vext1", "vext2", "vbat1", "vline", "board",
+};
+
+#define LEICAEFI_HWMON_TEMP_CHANNEL (LEICAEFI_HWMON_IN_CHANNELS)
+
+static const unsigned int LEICAEFI_HWMON_UPDATE_INTERVAL_MS = 1000;
+
+/* Called with the lock held, reads all channels if the cache is too old. */
+static int leicaefi_hwmon_update(struct leicaefi_hwmon *hwmon)
+{
+	int rv = 0;
+
+	if (hwmon->valid &&
+	    time_before(jiffies,
+			hwmon->last_update +
+				msecs_to_jiffies(hwmon->update_interval_ms))) {
+		return 0;
+	}
+
+	rv = leicaefi_chip_read_multi(hwmon->efidev->efichip,
+				      leicaefi_hwmon_regs, hwmon->raw,
+				      LEICAEFI_HWMON_CHANNELS);
+	if (rv != 0) {
+		hwmon->valid = false;
+		return rv;
+	}
+
+	hwmon->valid = true;
+	hwmon->last_update = jiffies;
+
+	return 0;
+}
+
+static long leicaefi_hwmon_value(struct leicaefi_hwmon *hwmon, int index)
+{
+	if (index == LEICAEFI_HWMON_TEMP_CHANNEL) {
+		return leicaefi_adc_to_millicelsius(hwmon->raw[index]);
+	}
+
+	/* hwmon voltages are in millivolts */
+	return leicaefi_adc_to_microvolts(hwmon->raw[index]) / 1000;
+}
+
+static int leicaefi_hwmon_read_channel(struct leicaefi_hwmon *hwmon,
+				       int index, u32 attr, long *val)
+{
+	bool is_temp = (index == LEICAEFI_HWMON_TEMP_CHANNEL);
+	int rv = 0;
+
+	mutex_lock(&hwmon->lock);
+
+	if ((is_temp && attr == hwmon_temp_min) ||
+	    (!is_temp && attr == hwmon_in_min)) {
+		*val = hwmon->min[index];
+	} else if ((is_temp && attr == hwmon_temp_max) ||
+		   (!is_temp && attr == hwmon_in_max)) {
+		*val = hwmon->max[index];
+	} else {
+		rv = leicaefi_hwmon_update(hwmon);
+		if (rv == 0) {
+			long value = leicaefi_hwmon_value(hwmon, index);
+
+			if ((is_temp && attr == hwmon_temp_min_alarm) ||
+			    (!is_temp && attr == hwmon_in_min_alarm)) {
+				*val = (value < hwmon->min[index]) ? 1 : 0;
+			} else if ((is_temp && attr == hwmon_temp_max_alarm) ||
+				   (!is_temp && attr == hwmon_in_max_alarm)) {
+				*val = (value > hwmon->max[index]) ? 1 : 0;
+			} else {
+				*val = value;
+			}
+		}
+	}
+
+	mutex_unlock(&hwmon->lock);
+
+	return rv;
+}
+
+static int leicaefi_hwmon_read(struct device *dev,
+			       enum hwmon_sensor_types type, u32 attr,
+			       int channel, long *val)
+{
+	struct leicaefi_hwmon *hwmon = dev_get_drvdata(dev);
+
+	switch (type) {
+	case hwmon_chip:
+		if (attr != hwmon_chip_update_interval) {
+			return -EOPNOTSUPP;
+		}
+		mutex_lock(&hwmon->lock);
+		*val = hwmon->update_interval_ms;
+		mutex_unlock(&hwmon->lock);
+		return 0;
+	case hwmon_in:
+		return leicaefi_hwmon_read_channel(hwmon, channel, attr, val);
+	case hwmon_temp:
+		return leicaefi_hwmon_read_channel(
+			hwmon, LEICAEFI_HWMON_TEMP_CHANNEL, attr, val);
+	default:
+		break;
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static int leicaefi_hwmon_write(struct device *dev,
+				enum hwmon_sensor_types type, u32 attr,
+				int channel, long val)
+{
+	struct leicaefi_hwmon *hwmon = dev_get_drvdata(dev);
+	int index = (type == hwmon_temp) ? LEICAEFI_HWMON_TEMP_CHANNEL :
+					   channel;
+	int rv = 0;
+
+	mutex_lock(&hwmon->lock);
+
+	if (type == hwmon_chip && attr == hwmon_chip_update_interval) {
+		hwmon->update_interval_ms = clamp_val(val, 0, 60000);
+	} else if ((type == hwmon_in && attr == hwmon_in_min) ||
+		   (type == hwmon_temp && attr == hwmon_temp_min)) {
+		hwmon->min[index] = val;
+	} else if ((type == hwmon_in && attr == hwmon_in_max) ||
+		   (type == hwmon_temp && attr == hwmon_temp_max)) {
+		hwmon->max[index] = val;
+	} else {
+		rv = -EOPNOTSUPP;
+	}
+
+	mutex_unlock(&hwmon->lock);
+
+	return rv;
+}
+
+static int leicaefi_hwmon_read_string(struct device *dev,
+				      enum hwmon_sensor_types type, u32 attr,
+				      int channel, const char **str)
+{
+	switch (type) {
+	case hwmon_in:
+		*str = leicaefi_hwmon_labels[channel];
+		return 0;
+	case hwmon_temp:
+		*str = leicaefi_hwmon_labels[LEICAEFI_HWMON_TEMP_CHANNEL];
+		return 0;
+	default:
+		break;
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static umode_t leicaefi_hwmon_is_visible(const void *data,
+					 enum hwmon_sensor_types type,
+					 u32 attr, int channel)
+{
+	switch (type) {
+	case hwmon_chip:
+		return (attr == hwmon_chip_update_interval) ? 0644 : 0;
+	case hwmon_in:
+		switch (attr) {
+		case hwmon_in_min:
+		case hwmon_in_max:
+			return 0644;
+		default:
+			return 0444;
+		}
+	case hwmon_temp:
+		switch (attr) {
+		case hwmon_temp_min:
+		case hwmon_temp_max:
+			return 0644;
+		default:
+			return 0444;
+		}
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+#define LEICAEFI_HWMON_IN_CONFIG                                               \
+	(HWMON_I_INPUT | HWMON_I_LABEL | HWMON_I_MIN | HWMON_I_MAX |          \
+	 HWMON_I_MIN_ALARM | HWMON_I_MAX_ALARM)
+
+#define LEICAEFI_HWMON_TEMP_CONFIG                                             \
+	(HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_MIN | HWMON_T_MAX |          \
+	 HWMON_T_MIN_ALARM | HWMON_T_MAX_ALARM)
+
+static const u32 leicaefi_hwmon_chip_config[] = {
+	HWMON_C_UPDATE_INTERVAL,
+	0,
+};
+
+static const struct hwmon_channel_info leicaefi_hwmon_chip = {
+	.type = hwmon_chip,
+	.config = leicaefi_hwmon_chip_config,
+};
+
+static const u32 leicaefi_hwmon_in_config[] = {
+	LEICAEFI_HWMON_IN_CONFIG, LEICAEFI_HWMON_IN_CONFIG,
+	LEICAEFI_HWMON_IN_CONFIG, LEICAEFI_HWMON_IN_CONFIG,
+	LEICAEFI_HWMON_IN_CONFIG, 0,
+};
+
+static const struct hwmon_channel_info leicaefi_hwmon_in = {
+	.type = hwmon_in,
+	.config = leicaefi_hwmon_in_config,
+};
+
+static const u32 leicaefi_hwmon_temp_config[] = {
+	LEICAEFI_HWMON_TEMP_CONFIG,
+	0,
+};
+
+static const struct hwmon_channel_info leicaefi_hwmon_temp = {
+	.type = hwmon_temp,
+	.config = leicaefi_hwmon_temp_config,
+};
+
+static const struct hwmon_channel_info *leicaefi_hwmon_info[] = {
+	&leicaefi_hwmon_chip,
+	&leicaefi_hwmon_in,
+	&leicaefi_hwmon_temp,
+	NULL,
+};
+
+static const struct hwmon_ops leicaefi_hwmon_ops = {
+	.is_visible = leicaefi_hwmon_is_visible,
+	.read = leicaefi_hwmon_read,
+	.read_string = leicaefi_hwmon_read_string,
+	.write = leicaefi_hwmon_write,
+};
+
+static const struct hwmon_chip_info leicaefi_hwmon_chip_info = {
+	.ops = &leicaefi_hwmon_ops,
+	.info = leicaefi_hwmon_info,
+};
+
+int leicaefi_power_init_hwmon(struct leicaefi_power_device *efidev)
+{
+	struct leicaefi_hwmon *hwmon = &efidev->hwmon;
+	struct device *hwmon_dev = NULL;
+	int i = 0;
+
+	hwmon->efidev = efidev;
+	mutex_init(&hwmon->lock);
+	hwmon->update_interval_ms = LEICAEFI_HWMON_UPDATE_INTERVAL_MS;
+
+	/* thresholds are not limiting until set by the user */
+	for (i = 0; i < LEICAEFI_HWMON_IN_CHANNELS; ++i) {
+		hwmon->min[i] = 0;
+		hwmon->max[i] = LEICAEFI_ADC_VREF_COMP_MV;
+	}
+	hwmon->min[LEICAEFI_HWMON_TEMP_CHANNEL] = -273150;
+	hwmon->max[LEICAEFI_HWMON_TEMP_CHANNEL] = 200000;
+
+	hwmon_dev = devm_hwmon_device_register_with_info(
+		&efidev->pdev->dev, "leicaefi", hwmon,
+		&leicaefi_hwmon_chip_info, NULL);
+	if (IS_ERR(hwmon_dev)) {
+		dev_err(&efidev->pdev->dev,
+			"Failed to register hwmon device: %ld\n",
+			PTR_ERR(hwmon_dev));
+		return PTR_ERR(hwmon_dev);
+	}
+
+	return 0;
+}
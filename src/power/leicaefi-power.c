@@ -4,6 +4,116 @@
 
 #include "leicaefi-power.h"
 
+static void leicaefi_power_notify(struct power_supply *supply, u16 changed,
+				  u16 mask)
+{
+	if (changed & mask) {
+		power_supply_changed(supply);
+	}
+}
+
+static irqreturn_t leicaefi_power_irq_handler(int irq, void *data)
+{
+	struct leicaefi_power_device *efidev = data;
+	u16 status = 0;
+	u16 changed = 0;
+	int rv = 0;
+
+	/* SRC/PWR/CBL often come together, only the first one sees a change */
+	mutex_lock(&efidev->status_lock);
+	rv = leicaefi_chip_read(efidev->efichip, LEICAEFI_REG_PWR_SRC_STATUS,
+				&status);
+	if (rv == 0) {
+		changed = status ^ efidev->src_status;
+		efidev->src_status = status;
+	}
+	mutex_unlock(&efidev->status_lock);
+
+	if (rv != 0) {
+		dev_err(&efidev->pdev->dev,
+			"%s - cannot read power source status: %d\n", __func__,
+			rv);
+		return IRQ_HANDLED;
+	}
+
+	dev_dbg(&efidev->pdev->dev, "%s status=%04X changed=%04X\n", __func__,
+		(unsigned int)status, (unsigned int)changed);
+
+	leicaefi_power_notify(efidev->ext1_psy.supply, changed,
+			      efidev->ext1_psy.desc->validity_bit |
+				      efidev->ext1_psy.desc->active_bit);
+	leicaefi_power_notify(efidev->ext2_psy.supply, changed,
+			      efidev->ext2_psy.desc->validity_bit |
+				      efidev->ext2_psy.desc->active_bit);
+	leicaefi_power_notify(efidev->poe1_psy.supply, changed,
+			      efidev->poe1_psy.desc->validity_bit |
+				      efidev->poe1_psy.desc->active_bit);
+	/* cached battery data is not valid after insertion/removal */
+	if (changed & efidev->bat1_psy.desc->validity_bit) {
+		leicaefi_battery_invalidate(&efidev->bat1_psy);
+	}
+
+	leicaefi_power_notify(efidev->bat1_psy.supply, changed,
+			      efidev->bat1_psy.desc->validity_bit |
+				      efidev->bat1_psy.desc->active_bit);
+
+	return IRQ_HANDLED;
+}
+
+static int leicaefi_power_init_irq(struct leicaefi_power_device *efidev,
+				   const char *irq_name)
+{
+	int irq = 0;
+	int rv = 0;
+
+	irq = platform_get_irq_byname(efidev->pdev, irq_name);
+	if (irq < 0) {
+		dev_err(&efidev->pdev->dev,
+			"failed: cannot find irq %s (error :%d)\n", irq_name,
+			irq);
+		return -EINVAL;
+	}
+
+	rv = devm_request_threaded_irq(&efidev->pdev->dev, irq, NULL,
+				       leicaefi_power_irq_handler,
+				       IRQF_ONESHOT | IRQF_SHARED, NULL,
+				       efidev);
+	if (rv < 0) {
+		dev_err(&efidev->pdev->dev,
+			"failed: irq request (IRQ: %s/%d, error :%d)\n",
+			irq_name, irq, rv);
+		return rv;
+	}
+
+	return 0;
+}
+
+static int leicaefi_power_init_irqs(struct leicaefi_power_device *efidev)
+{
+	int rv = 0;
+
+	mutex_init(&efidev->status_lock);
+
+	/* initial snapshot, changes are reported relative to it */
+	rv = leicaefi_chip_read(efidev->efichip, LEICAEFI_REG_PWR_SRC_STATUS,
+				&efidev->src_status);
+	if (rv != 0) {
+		return rv;
+	}
+
+	rv = leicaefi_power_init_irq(efidev, "LEICAEFI_SRC");
+	if (rv != 0) {
+		return rv;
+	}
+
+	rv = leicaefi_power_init_irq(efidev, "LEICAEFI_PWR");
+	if (rv != 0) {
+		return rv;
+	}
+
+	return leicaefi_power_init_irq(efidev, "LEICAEFI_CBL");
+}
+
 static int leicaefi_power_probe(struct platform_device *pdev)
 {
 	struct leicaefi_power_device *efidev = NULL;
@@ -65,6 +175,20 @@ static int leicaefi_power_probe(struct platform_device *pdev)
 		return rv;
 	}
 
+	rv = leicaefi_power_init_hwmon(efidev);
+	if (rv != 0) {
+		dev_err(&efidev->pdev->dev,
+			"Cannot initialize hwmon device (error: %d).\n", rv);
+		return rv;
+	}
+
+	rv = leicaefi_power_init_irqs(efidev);
+	if (rv != 0) {
+		dev_err(&efidev->pdev->dev,
+			"Cannot initialize interrupts (error: %d).\n", rv);
+		return rv;
+	}
+
 	return 0;
 }
 
@@ -3,6 +3,13 @@
 
 #include <linux/power_supply.h>
 #include <linux/platform_device.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
 
 #include <leicaefi.h>
 #include <common/leicaefi-chip.h>
@@ -17,13 +24,15 @@ struct leicaefi_power_device;
 
 struct leicaefi_charger_desc {
 	const struct power_supply_desc kernel_desc;
-	u8 validity_bit;
+	u16 validity_bit;
+	u16 active_bit;
 	u8 voltage_register;
 };
 
 struct leicaefi_battery_desc {
 	const struct power_supply_desc kernel_desc;
-	u8 validity_bit;
+	u16 validity_bit;
+	u16 active_bit;
 };
 
 struct leicaefi_charger {
@@ -32,10 +41,100 @@ struct leicaefi_charger {
 	struct power_supply *supply;
 };
 
+/* Battery messages fetched in a snapshot. */
+enum leicaefi_battery_msg {
+	LEICAEFI_BATTERY_MSG_TEMPERATURE,
+	LEICAEFI_BATTERY_MSG_VOLTAGE,
+	LEICAEFI_BATTERY_MSG_CURRENT,
+	LEICAEFI_BATTERY_MSG_AVERAGE_CURRENT,
+	LEICAEFI_BATTERY_MSG_RUN_TIME_TO_EMPTY,
+	LEICAEFI_BATTERY_MSG_AVERAGE_TIME_TO_EMPTY,
+	LEICAEFI_BATTERY_MSG_AVERAGE_TIME_TO_FULL,
+	LEICAEFI_BATTERY_MSG_CYCLE_COUNT,
+	LEICAEFI_BATTERY_MSG_COUNT,
+};
+
+struct leicaefi_battery_snapshot {
+	struct mutex lock;
+	/* data is valid if taken in the current generation */
+	atomic_t generation;
+	int data_generation;
+	unsigned long timestamp;
+	/* when the messages were fetched, the time of the battery samples */
+	ktime_t fetch_time;
+
+	int present;
+	u16 rsoc;
+	int msg_result[LEICAEFI_BATTERY_MSG_COUNT];
+	u16 msg_value[LEICAEFI_BATTERY_MSG_COUNT];
+
+	/* requests of the refresh in progress */
+	struct leicaefi_gencmd_request requests[LEICAEFI_BATTERY_MSG_COUNT];
+	atomic_t pending;
+	struct completion done;
+};
+
+/* Number of samples kept for the debugfs 'samples' file. */
+#define LEICAEFI_BATTERY_SAMPLES_COUNT (256)
+/* Weight of the new sample in the smoothed power is 1/N. */
+#define LEICAEFI_BATTERY_POWER_AVG_WEIGHT (8)
+/* Number of samples in the power min/max window. */
+#define LEICAEFI_BATTERY_WINDOW_SAMPLES (60)
+
+struct leicaefi_battery_sampler {
+	/* entry in the list of samplers restarted on interval change */
+	struct list_head node;
+	struct delayed_work work;
+	/* protects the values below */
+	struct mutex lock;
+
+	/* previous sample, not valid after a gap (e.g. no battery) */
+	bool has_prev;
+	ktime_t prev_time;
+	s64 prev_power_uw;
+
+	/* energy drawn and smoothed power (valid if has_data is set) */
+	bool has_data;
+	s64 energy_nj;
+	s64 power_avg_uw;
+
+	/* min/max power of the current and the last complete window */
+	unsigned int window_count;
+	s64 window_min_uw;
+	s64 window_max_uw;
+	s64 last_min_uw;
+	s64 last_max_uw;
+
+	struct leicaefi_battery_sample *samples;
+	unsigned int samples_head;
+	unsigned int samples_count;
+
+	struct dentry *debugfs_dir;
+};
+
 struct leicaefi_battery {
 	struct leicaefi_power_device *efidev;
 	const struct leicaefi_battery_desc *desc;
 	struct power_supply *supply;
+	struct leicaefi_battery_snapshot snapshot;
+	struct leicaefi_battery_sampler sampler;
+};
+
+/* Supply rails (VPOE1, VEXT1, VEXT2, VBAT1, VLINE) and the temperature. */
+#define LEICAEFI_HWMON_IN_CHANNELS (5)
+#define LEICAEFI_HWMON_CHANNELS (LEICAEFI_HWMON_IN_CHANNELS + 1)
+
+struct leicaefi_hwmon {
+	struct leicaefi_power_device *efidev;
+	/* protects the cache and the settings */
+	struct mutex lock;
+	bool valid;
+	unsigned long last_update;
+	unsigned int update_interval_ms;
+	u16 raw[LEICAEFI_HWMON_CHANNELS];
+	/* alarm thresholds, mV for the rails, millidegree C for temperature */
+	long min[LEICAEFI_HWMON_CHANNELS];
+	long max[LEICAEFI_HWMON_CHANNELS];
 };
 
 struct leicaefi_power_device {
@@ -46,6 +145,12 @@ struct leicaefi_power_device {
 	struct leicaefi_charger ext2_psy;
 	struct leicaefi_charger poe1_psy;
 	struct leicaefi_battery bat1_psy;
+
+	struct leicaefi_hwmon hwmon;
+
+	/* last PWR_SRC_STATUS value, used to find the changed supplies */
+	struct mutex status_lock;
+	u16 src_status;
 };
 
 int leicaefi_power_init_ext1(struct leicaefi_power_device *efidev);
@@ -56,4 +161,45 @@ int leicaefi_power_init_poe1(struct leicaefi_power_device *efidev);
 
 int leicaefi_power_init_bat1(struct leicaefi_power_device *efidev);
 
+#if IS_REACHABLE(CONFIG_HWMON)
+int leicaefi_power_init_hwmon(struct leicaefi_power_device *efidev);
+#else
+static inline int
+leicaefi_power_init_hwmon(struct leicaefi_power_device *efidev)
+{
+	return 0;
+}
+#endif
+
+/* Drops the cached battery data, e.g. after battery insertion/removal. */
+void leicaefi_battery_invalidate(struct leicaefi_battery *battery);
+
+/* SBS battery message values to the power supply class units. */
+static inline int leicaefi_battery_min_to_sec(int value)
+{
+	return value * 60;
+}
+
+static inline int leicaefi_battery_milli_to_micro(int value)
+{
+	return value * 1000;
+}
+
+/* 0.1K to 0.1C (273.15 changed to tenths) */
+static inline int leicaefi_battery_dk_to_dc(int value)
+{
+	return value - 2732;
+}
+
+/* SBS current is signed, positive when charging */
+static inline s32 leicaefi_battery_current_ma(u16 value)
+{
+	return (s16)value;
+}
+
+#if IS_ENABLED(CONFIG_KUNIT)
+void leicaefi_battery_sampler_add(struct leicaefi_battery_sampler *sampler,
+				  ktime_t now, s32 voltage_mv, s32 current_ma);
+#endif /* CONFIG_KUNIT */
+
 #endif /*_LINUX_LEICAEFI_POWER_H*/
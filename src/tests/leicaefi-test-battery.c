@@ -0,0 +1,159 @@
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <kunit/test.h>
+
+#include <power/leicaefi-power.h>
+
+#include "leicaefi-test.h"
+
+static struct leicaefi_battery_sampler *
+leicaefi_battery_test_sampler(struct kunit *test)
+{
+	struct leicaefi_battery_sampler *sampler = NULL;
+
+	sampler = kunit_kzalloc(test, sizeof(*sampler), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sampler);
+
+	sampler->samples =
+		kunit_kcalloc(test, LEICAEFI_BATTERY_SAMPLES_COUNT,
+			      sizeof(*sampler->samples), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sampler->samples);
+
+	mutex_init(&sampler->lock);
+
+	return sampler;
+}
+
+static void leicaefi_battery_test_units(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_min_to_sec(5), 300);
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_milli_to_micro(12), 12000);
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_milli_to_micro(0), 0);
+	/* 298.2K */
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_dk_to_dc(2982), 250);
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_dk_to_dc(2632), -100);
+	/* two's complement, positive when charging */
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_current_ma(100), 100);
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_current_ma(0xFFF6), -10);
+	KUNIT_EXPECT_EQ(test, leicaefi_battery_current_ma(0x8000), -32768);
+}
+
+static void leicaefi_battery_test_energy(struct kunit *test)
+{
+	struct leicaefi_battery_sampler *sampler =
+		leicaefi_battery_test_sampler(test);
+	const struct leicaefi_battery_sample *sample = NULL;
+
+	/* discharging with 6 W, then 12 W */
+	leicaefi_battery_sampler_add(sampler, ms_to_ktime(1000), 12000, -500);
+
+	KUNIT_EXPECT_TRUE(test, sampler->has_data);
+	KUNIT_EXPECT_EQ(test, sampler->energy_nj, 0LL);
+	KUNIT_EXPECT_EQ(test, sampler->power_avg_uw, 6000000LL);
+
+	leicaefi_battery_sampler_add(sampler, ms_to_ktime(2000), 12000, -1000);
+
+	/* trapezoid of one second */
+	KUNIT_EXPECT_EQ(test, sampler->energy_nj, 9000000000LL);
+	KUNIT_EXPECT_EQ(test, sampler->power_avg_uw,
+			6000000LL +
+				6000000LL / LEICAEFI_BATTERY_POWER_AVG_WEIGHT);
+
+	KUNIT_EXPECT_EQ(test, sampler->samples_count, 2U);
+	sample = &sampler->samples[1];
+	KUNIT_EXPECT_EQ(test, sample->timestamp_ns, 2000000000LL);
+	KUNIT_EXPECT_EQ(test, sample->voltage_mv, 12000);
+	KUNIT_EXPECT_EQ(test, sample->current_ma, -1000);
+	KUNIT_EXPECT_EQ(test, sample->power_uw, 12000000LL);
+	KUNIT_EXPECT_EQ(test, sample->energy_uwh, 2500LL);
+}
+
+static void leicaefi_battery_test_charging(struct kunit *test)
+{
+	struct leicaefi_battery_sampler *sampler =
+		leicaefi_battery_test_sampler(test);
+
+	leicaefi_battery_sampler_add(sampler, ms_to_ktime(0), 8000, 250);
+	leicaefi_battery_sampler_add(sampler, ms_to_ktime(3600), 8000, 250);
+
+	KUNIT_EXPECT_EQ(test, sampler->samples[0].power_uw, -2000000LL);
+	KUNIT_EXPECT_EQ(test, sampler->samples[1].energy_uwh, -2000LL);
+}
+
+static void leicaefi_battery_test_window(struct kunit *test)
+{
+	struct leicaefi_battery_sampler *sampler =
+		leicaefi_battery_test_sampler(test);
+	unsigned int i = 0;
+
+	for (i = 0; i < LEICAEFI_BATTERY_WINDOW_SAMPLES; ++i) {
+		/* 1 V steps at 1 A, peak in the middle of the window */
+		s32 voltage_mv = (i == LEICAEFI_BATTERY_WINDOW_SAMPLES / 2) ?
+					 100000 :
+					 (s32)(i + 1) * 1000;
+
+		leicaefi_battery_sampler_add(sampler, ms_to_ktime(i * 1000),
+					     voltage_mv, -1000);
+	}
+
+	KUNIT_EXPECT_EQ(test, sampler->window_count, 0U);
+	KUNIT_EXPECT_EQ(test, sampler->last_min_uw, 1000000LL);
+	KUNIT_EXPECT_EQ(test, sampler->last_max_uw, 100000000LL);
+
+	/* next window starts over */
+	leicaefi_battery_sampler_add(sampler, ms_to_ktime(i * 1000), 5000,
+				     -1000);
+	KUNIT_EXPECT_EQ(test, sampler->window_count, 1U);
+	KUNIT_EXPECT_EQ(test, sampler->window_min_uw, 5000000LL);
+	KUNIT_EXPECT_EQ(test, sampler->window_max_uw, 5000000LL);
+	KUNIT_EXPECT_EQ(test, sampler->last_max_uw, 100000000LL);
+}
+
+static void leicaefi_battery_test_ring(struct kunit *test)
+{
+	struct leicaefi_battery_sampler *sampler =
+		leicaefi_battery_test_sampler(test);
+	unsigned int i = 0;
+
+	for (i = 0; i < LEICAEFI_BATTERY_SAMPLES_COUNT + 3; ++i) {
+		leicaefi_battery_sampler_add(sampler, ms_to_ktime(i * 100),
+					     12000, -(s32)i);
+	}
+
+	KUNIT_EXPECT_EQ(test, sampler->samples_count,
+			(unsigned int)LEICAEFI_BATTERY_SAMPLES_COUNT);
+	KUNIT_EXPECT_EQ(test, sampler->samples_head, 3U);
+	/* oldest samples overwritten */
+	KUNIT_EXPECT_EQ(test, sampler->samples[0].current_ma,
+			-(s32)LEICAEFI_BATTERY_SAMPLES_COUNT);
+	KUNIT_EXPECT_EQ(test, sampler->samples[3].current_ma, -3);
+}
+
+static void leicaefi_battery_test_bench_add(struct kunit *test)
+{
+	struct leicaefi_battery_sampler *sampler =
+		leicaefi_battery_test_sampler(test);
+	s64 time_ms = 0;
+
+	LEICAEFI_TEST_BENCH(test, "battery sampler add", 100000, {
+		time_ms += 1000;
+		leicaefi_battery_sampler_add(sampler, ms_to_ktime(time_ms),
+					     12000, -750);
+	});
+}
+
+static struct kunit_case leicaefi_battery_test_cases[] = {
+	KUNIT_CASE(leicaefi_battery_test_units),
+	KUNIT_CASE(leicaefi_battery_test_energy),
+	KUNIT_CASE(leicaefi_battery_test_charging),
+	KUNIT_CASE(leicaefi_battery_test_window),
+	KUNIT_CASE(leicaefi_battery_test_ring),
+	KUNIT_CASE_SLOW(leicaefi_battery_test_bench_add),
+	{}
+};
+
+struct kunit_suite leicaefi_battery_test_suite = {
+	.name = "leicaefi-battery",
+	.test_cases = leicaefi_battery_test_cases,
+};
@@ -0,0 +1,248 @@
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <kunit/test.h>
+
+#include <core/leicaefi-chip-internal.h>
+#include <common/leicaefi-chip.h>
+#include <leicaefi-defs.h>
+#include <leicaefi.h>
+
+#include "leicaefi-test.h"
+
+#define LEICAEFI_GENCMD_TEST_REQUESTS (4)
+
+/* Completed requests in the order of completion. */
+struct leicaefi_gencmd_test_log {
+	struct leicaefi_gencmd_request *done[LEICAEFI_GENCMD_TEST_REQUESTS];
+	unsigned int count;
+};
+
+static void leicaefi_gencmd_test_complete(struct leicaefi_gencmd_request *req)
+{
+	struct leicaefi_gencmd_test_log *log = req->context;
+
+	if (log->count < LEICAEFI_GENCMD_TEST_REQUESTS) {
+		log->done[log->count] = req;
+	}
+	++log->count;
+}
+
+static void leicaefi_gencmd_test_init(struct leicaefi_gencmd_request *req,
+				      struct leicaefi_gencmd_test_log *log,
+				      u16 cmd, u16 input_data)
+{
+	memset(req, 0, sizeof(*req));
+	req->cmd = cmd;
+	req->input_data = input_data;
+	req->complete = leicaefi_gencmd_test_complete;
+	req->context = log;
+}
+
+static void leicaefi_gencmd_test_fifo(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req1;
+	struct leicaefi_gencmd_request req2;
+
+	leicaefi_gencmd_test_init(&req1, &log, 0x0101, 0x0011);
+	leicaefi_gencmd_test_init(&req2, &log, 0x0102, 0x0022);
+
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req1),
+			0);
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req2),
+			0);
+
+	/* second command waits for the first one */
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_CMD_CTRL),
+			(u16)0x0101);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_CMD_DATA),
+			(u16)0x0011);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_CMD_CTRL),
+			1U);
+	KUNIT_EXPECT_TRUE(test, leicaefi_chip_gencmd_in_progress(tc->efichip));
+
+	leicaefi_test_set_reg(tc, LEICAEFI_REG_CMD_DATA, 0xAAAA);
+	leicaefi_chip_gencmd_finish(tc->efichip, 0);
+
+	KUNIT_EXPECT_EQ(test, log.count, 1U);
+	KUNIT_EXPECT_PTR_EQ(test, log.done[0], &req1);
+	KUNIT_EXPECT_EQ(test, req1.result, 0);
+	KUNIT_EXPECT_EQ(test, req1.output_data, (u16)0xAAAA);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_CMD_CTRL),
+			(u16)0x0102);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_CMD_DATA),
+			(u16)0x0022);
+
+	leicaefi_test_set_reg(tc, LEICAEFI_REG_CMD_DATA, 0xBBBB);
+	leicaefi_chip_gencmd_finish(tc->efichip, 0);
+
+	KUNIT_EXPECT_EQ(test, log.count, 2U);
+	KUNIT_EXPECT_PTR_EQ(test, log.done[1], &req2);
+	KUNIT_EXPECT_EQ(test, req2.output_data, (u16)0xBBBB);
+	KUNIT_EXPECT_FALSE(test,
+			   leicaefi_chip_gencmd_in_progress(tc->efichip));
+}
+
+static void leicaefi_gencmd_test_error(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req;
+
+	leicaefi_gencmd_test_init(&req, &log, 0x0101, 0);
+
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req),
+			0);
+	leicaefi_chip_gencmd_finish(tc->efichip, -LEICAEFI_EGENCMDFAIL);
+
+	KUNIT_EXPECT_EQ(test, log.count, 1U);
+	KUNIT_EXPECT_EQ(test, req.result, -LEICAEFI_EGENCMDFAIL);
+	/* output is not read for failed commands */
+	KUNIT_EXPECT_EQ(test, tc->transport.reads[LEICAEFI_REG_CMD_DATA], 0U);
+}
+
+static void leicaefi_gencmd_test_start_failure(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req;
+
+	leicaefi_gencmd_test_init(&req, &log, 0x0101, 0);
+
+	tc->transport.fail_rc = -EIO;
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req),
+			0);
+
+	/* completed from the submitter context */
+	KUNIT_EXPECT_EQ(test, log.count, 1U);
+	KUNIT_EXPECT_EQ(test, req.result, -EIO);
+	KUNIT_EXPECT_FALSE(test,
+			   leicaefi_chip_gencmd_in_progress(tc->efichip));
+}
+
+static void leicaefi_gencmd_test_shared_read(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req1;
+	struct leicaefi_gencmd_request req2;
+	u16 cmd = LEICAEFI_CMD_READ_FLAG | 0x0A00;
+
+	leicaefi_gencmd_test_init(&req1, &log, cmd, 0x0009);
+	leicaefi_gencmd_test_init(&req2, &log, cmd, 0x0009);
+
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req1),
+			0);
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req2),
+			0);
+
+	leicaefi_test_set_reg(tc, LEICAEFI_REG_CMD_DATA, 0x1234);
+	leicaefi_chip_gencmd_finish(tc->efichip, 0);
+
+	/* executed once, both completed with the same result */
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_CMD_CTRL),
+			1U);
+	KUNIT_EXPECT_EQ(test, log.count, 2U);
+	KUNIT_EXPECT_EQ(test, req1.output_data, (u16)0x1234);
+	KUNIT_EXPECT_EQ(test, req2.output_data, (u16)0x1234);
+	KUNIT_EXPECT_EQ(test, req2.result, 0);
+}
+
+/* Late completion of a timed out command must not finish the next one. */
+static void leicaefi_gencmd_test_timeout_late_completion(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req1;
+	struct leicaefi_gencmd_request req2;
+
+	leicaefi_gencmd_test_init(&req1, &log, 0x0101, 0);
+	leicaefi_gencmd_test_init(&req2, &log, 0x0102, 0);
+
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req1),
+			0);
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req2),
+			0);
+
+	leicaefi_chip_gencmd_expire(tc->efichip);
+
+	KUNIT_EXPECT_EQ(test, log.count, 1U);
+	KUNIT_EXPECT_EQ(test, req1.result, -ETIMEDOUT);
+	/* next command is held back until the chip is idle */
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_CMD_CTRL),
+			1U);
+
+	leicaefi_chip_gencmd_finish(tc->efichip, 0);
+
+	KUNIT_EXPECT_EQ(test, log.count, 1U);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_CMD_CTRL),
+			2U);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_CMD_CTRL),
+			(u16)0x0102);
+
+	leicaefi_chip_gencmd_finish(tc->efichip, 0);
+
+	KUNIT_EXPECT_EQ(test, log.count, 2U);
+	KUNIT_EXPECT_PTR_EQ(test, log.done[1], &req2);
+	KUNIT_EXPECT_EQ(test, req2.result, 0);
+}
+
+static void leicaefi_gencmd_test_timeout_drain_end(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req1;
+	struct leicaefi_gencmd_request req2;
+
+	leicaefi_gencmd_test_init(&req1, &log, 0x0101, 0);
+	leicaefi_gencmd_test_init(&req2, &log, 0x0102, 0);
+
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req1),
+			0);
+	KUNIT_ASSERT_EQ(test, leicaefi_chip_gencmd_submit(tc->efichip, &req2),
+			0);
+
+	leicaefi_chip_gencmd_expire(tc->efichip);
+	leicaefi_chip_gencmd_drain_end(tc->efichip);
+
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_CMD_CTRL),
+			(u16)0x0102);
+	KUNIT_EXPECT_TRUE(test, leicaefi_chip_gencmd_in_progress(tc->efichip));
+
+	leicaefi_chip_gencmd_finish(tc->efichip, 0);
+
+	KUNIT_EXPECT_EQ(test, log.count, 2U);
+	KUNIT_EXPECT_EQ(test, req2.result, 0);
+}
+
+static void leicaefi_gencmd_test_bench(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	struct leicaefi_gencmd_test_log log = {};
+	struct leicaefi_gencmd_request req;
+
+	LEICAEFI_TEST_BENCH(test, "gencmd submit+finish", 10000, {
+		leicaefi_gencmd_test_init(&req, &log, 0x0101, 0);
+		leicaefi_chip_gencmd_submit(tc->efichip, &req);
+		leicaefi_chip_gencmd_finish(tc->efichip, 0);
+	});
+
+	KUNIT_EXPECT_EQ(test, log.count, 10000U);
+}
+
+static struct kunit_case leicaefi_gencmd_test_cases[] = {
+	KUNIT_CASE(leicaefi_gencmd_test_fifo),
+	KUNIT_CASE(leicaefi_gencmd_test_error),
+	KUNIT_CASE(leicaefi_gencmd_test_start_failure),
+	KUNIT_CASE(leicaefi_gencmd_test_shared_read),
+	KUNIT_CASE(leicaefi_gencmd_test_timeout_late_completion),
+	KUNIT_CASE(leicaefi_gencmd_test_timeout_drain_end),
+	KUNIT_CASE_SLOW(leicaefi_gencmd_test_bench),
+	{}
+};
+
+struct kunit_suite leicaefi_gencmd_test_suite = {
+	.name = "leicaefi-gencmd",
+	.test_cases = leicaefi_gencmd_test_cases,
+};
@@ -0,0 +1,142 @@
+#include <linux/kernel.h>
+#include <kunit/test.h>
+
+#include <core/leicaefi-irq.h>
+#include <common/leicaefi-chip.h>
+#include <common/leicaefi-irqs.h>
+#include <leicaefi-defs.h>
+
+#include "leicaefi-test.h"
+
+static void leicaefi_irq_test_mask_changes(struct kunit *test)
+{
+	bool current_mask[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	bool requested[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	u16 enable_mask = 0;
+	u16 disable_mask = 0;
+
+	requested[LEICAEFI_IRQNO_FLASH] = true;
+	requested[LEICAEFI_IRQNO_KEY] = true;
+	/* ERR register interrupts have no enable bit */
+	requested[LEICAEFI_IRQNO_ERR_FLASH] = true;
+
+	leicaefi_irq_mask_changes(current_mask, requested, &enable_mask,
+				  &disable_mask);
+	KUNIT_EXPECT_EQ(test, enable_mask,
+			(u16)(LEICAEFI_IRQBIT_FLASH | LEICAEFI_IRQBIT_KEY));
+	KUNIT_EXPECT_EQ(test, disable_mask, (u16)0);
+	KUNIT_EXPECT_MEMEQ(test, current_mask, requested, sizeof(requested));
+
+	requested[LEICAEFI_IRQNO_KEY] = false;
+	requested[LEICAEFI_IRQNO_ERR_FLASH] = false;
+
+	leicaefi_irq_mask_changes(current_mask, requested, &enable_mask,
+				  &disable_mask);
+	KUNIT_EXPECT_EQ(test, enable_mask, (u16)0);
+	KUNIT_EXPECT_EQ(test, disable_mask, (u16)LEICAEFI_IRQBIT_KEY);
+	KUNIT_EXPECT_MEMEQ(test, current_mask, requested, sizeof(requested));
+}
+
+static void leicaefi_irq_test_mask_no_changes(struct kunit *test)
+{
+	bool current_mask[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	bool requested[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	u16 enable_mask = 0xFFFF;
+	u16 disable_mask = 0xFFFF;
+
+	current_mask[LEICAEFI_IRQNO_SRC] = true;
+	requested[LEICAEFI_IRQNO_SRC] = true;
+
+	leicaefi_irq_mask_changes(current_mask, requested, &enable_mask,
+				  &disable_mask);
+	KUNIT_EXPECT_EQ(test, enable_mask, (u16)0);
+	KUNIT_EXPECT_EQ(test, disable_mask, (u16)0);
+}
+
+/* MOD_IE updates as done on bus sync unlock send only the changed bits. */
+static void leicaefi_irq_test_mod_ie_sync(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+	bool current_mask[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	bool requested[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	u16 enable_mask = 0;
+	u16 disable_mask = 0;
+
+	requested[LEICAEFI_IRQNO_CBL] = true;
+	requested[LEICAEFI_IRQNO_SRC] = true;
+	leicaefi_irq_mask_changes(current_mask, requested, &enable_mask,
+				  &disable_mask);
+
+	KUNIT_EXPECT_EQ(test,
+			leicaefi_chip_set_bits(tc->efichip, LEICAEFI_REG_MOD_IE,
+					       enable_mask),
+			0);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_MOD_IE),
+			(u16)(LEICAEFI_IRQBIT_CBL | LEICAEFI_IRQBIT_SRC));
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_MOD_IE),
+			1U);
+
+	requested[LEICAEFI_IRQNO_SRC] = false;
+	leicaefi_irq_mask_changes(current_mask, requested, &enable_mask,
+				  &disable_mask);
+
+	KUNIT_EXPECT_EQ(test,
+			leicaefi_chip_clear_bits(tc->efichip,
+						 LEICAEFI_REG_MOD_IE,
+						 disable_mask),
+			0);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(tc, LEICAEFI_REG_MOD_IE),
+			(u16)LEICAEFI_IRQBIT_CBL);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_MOD_IE),
+			2U);
+
+	/* bit already set, nothing is sent */
+	KUNIT_EXPECT_EQ(test,
+			leicaefi_chip_set_bits(tc->efichip, LEICAEFI_REG_MOD_IE,
+					       LEICAEFI_IRQBIT_CBL),
+			0);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(tc, LEICAEFI_REG_MOD_IE),
+			2U);
+}
+
+static void leicaefi_irq_test_bench_mask_changes(struct kunit *test)
+{
+	bool current_mask[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	bool requested[LEICAEFI_TOTAL_IRQ_COUNT] = {};
+	u16 enable_mask = 0;
+	u16 disable_mask = 0;
+	unsigned int irqno = 0;
+
+	LEICAEFI_TEST_BENCH(test, "irq mask sync", 100000, {
+		irqno = (irqno + 1) % LEICAEFI_TOTAL_IRQ_COUNT;
+		requested[irqno] = !requested[irqno];
+		leicaefi_irq_mask_changes(current_mask, requested,
+					  &enable_mask, &disable_mask);
+	});
+}
+
+static void leicaefi_irq_test_bench_mod_ie(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = leicaefi_test_chip_create(test);
+
+	LEICAEFI_TEST_BENCH(test, "MOD_IE set+clear", 10000, {
+		leicaefi_chip_set_bits(tc->efichip, LEICAEFI_REG_MOD_IE,
+				       LEICAEFI_IRQBIT_KEY);
+		leicaefi_chip_clear_bits(tc->efichip, LEICAEFI_REG_MOD_IE,
+					 LEICAEFI_IRQBIT_KEY);
+	});
+}
+
+static struct kunit_case leicaefi_irq_test_cases[] = {
+	KUNIT_CASE(leicaefi_irq_test_mask_changes),
+	KUNIT_CASE(leicaefi_irq_test_mask_no_changes),
+	KUNIT_CASE(leicaefi_irq_test_mod_ie_sync),
+	KUNIT_CASE_SLOW(leicaefi_irq_test_bench_mask_changes),
+	KUNIT_CASE_SLOW(leicaefi_irq_test_bench_mod_ie),
+	{}
+};
+
+struct kunit_suite leicaefi_irq_test_suite = {
+	.name = "leicaefi-irq",
+	.test_cases = leicaefi_irq_test_cases,
+};
@@ -0,0 +1,218 @@
+#include <linux/kernel.h>
+#include <linux/platform_device.h>
+#include <kunit/test.h>
+
+#include <leds/leicaefi-leds.h>
+#include <leicaefi-defs.h>
+
+#include "leicaefi-test.h"
+
+/* 16-bit registers, two bits per led */
+#define LEICAEFI_LEDS_TEST_COUNT (LEICAEFI_LED_REG_COUNT * 8)
+
+struct leicaefi_leds_test {
+	struct leicaefi_test_chip *tc;
+	struct leicaefi_leds_device *efidev;
+};
+
+static void leicaefi_leds_test_pdev_release(void *data)
+{
+	platform_device_unregister(data);
+}
+
+static struct leicaefi_leds_test *leicaefi_leds_test_create(struct kunit *test)
+{
+	struct leicaefi_leds_test *lt = NULL;
+	struct platform_device *pdev = NULL;
+
+	lt = kunit_kzalloc(test, sizeof(*lt), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, lt);
+
+	lt->tc = leicaefi_test_chip_create(test);
+
+	/* not bound to the driver, only the device managed resources used */
+	pdev = platform_device_register_simple("leicaefi-leds-test",
+					       PLATFORM_DEVID_AUTO, NULL, 0);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pdev);
+	KUNIT_ASSERT_EQ(test,
+			kunit_add_action_or_reset(
+				test, leicaefi_leds_test_pdev_release, pdev),
+			0);
+
+	lt->efidev = leicaefi_leds_alloc(&pdev->dev);
+	KUNIT_ASSERT_NOT_NULL(test, lt->efidev);
+
+	lt->efidev->pdev = pdev;
+	lt->efidev->efichip = lt->tc->efichip;
+
+	return lt;
+}
+
+static void leicaefi_leds_test_blink(struct leicaefi_led *led,
+				     unsigned long delay_on,
+				     unsigned long delay_off,
+				     unsigned long start_step)
+{
+	led->delay_on_intervals = delay_on;
+	led->delay_off_intervals = delay_off;
+	led->blink_start_step = start_step;
+}
+
+static unsigned long leicaefi_leds_test_update(struct leicaefi_leds_test *lt,
+					       unsigned long step)
+{
+	unsigned long next_step = 0;
+
+	mutex_lock(&lt->efidev->lock);
+	next_step = leicaefi_leds_update_unlocked(lt->efidev, step);
+	mutex_unlock(&lt->efidev->lock);
+
+	return next_step;
+}
+
+static void leicaefi_leds_test_blink_state(struct kunit *test)
+{
+	struct leicaefi_led led = {};
+	unsigned long steps_left = 0;
+
+	leicaefi_leds_test_blink(&led, 2, 3, 10);
+
+	/* cycle not started yet */
+	KUNIT_EXPECT_FALSE(test,
+			   leicaefi_led_blink_state(&led, 5, &steps_left));
+	KUNIT_EXPECT_EQ(test, steps_left, 5UL);
+
+	KUNIT_EXPECT_TRUE(test,
+			  leicaefi_led_blink_state(&led, 10, &steps_left));
+	KUNIT_EXPECT_EQ(test, steps_left, 2UL);
+	KUNIT_EXPECT_TRUE(test,
+			  leicaefi_led_blink_state(&led, 11, &steps_left));
+	KUNIT_EXPECT_EQ(test, steps_left, 1UL);
+
+	KUNIT_EXPECT_FALSE(test,
+			   leicaefi_led_blink_state(&led, 12, &steps_left));
+	KUNIT_EXPECT_EQ(test, steps_left, 3UL);
+	KUNIT_EXPECT_FALSE(test,
+			   leicaefi_led_blink_state(&led, 14, &steps_left));
+	KUNIT_EXPECT_EQ(test, steps_left, 1UL);
+
+	/* next period */
+	KUNIT_EXPECT_TRUE(test,
+			  leicaefi_led_blink_state(&led, 15, &steps_left));
+	KUNIT_EXPECT_EQ(test, steps_left, 2UL);
+}
+
+static void leicaefi_leds_test_update_register(struct kunit *test)
+{
+	struct leicaefi_leds_test *lt = leicaefi_leds_test_create(test);
+
+	/* other leds of the register are not touched */
+	leicaefi_test_set_reg(lt->tc, LEICAEFI_REG_LED_CTRL1, 0x4000);
+
+	leicaefi_leds_test_blink(&lt->efidev->leds[0], 1, 2, 0);
+
+	KUNIT_EXPECT_EQ(test, leicaefi_leds_test_update(lt, 0), 1UL);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(lt->tc, LEICAEFI_REG_LED_CTRL1),
+			(u16)(0x4000 | LEICAEFI_LED_VALUE_DIMMED));
+
+	KUNIT_EXPECT_EQ(test, leicaefi_leds_test_update(lt, 1), 3UL);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(lt->tc, LEICAEFI_REG_LED_CTRL1),
+			(u16)0x4000);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(lt->tc,
+						   LEICAEFI_REG_LED_CTRL2),
+			0U);
+
+	/* only the changed bits are sent, unchanged state is not resent */
+	KUNIT_EXPECT_EQ(test, leicaefi_leds_test_update(lt, 2), 3UL);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_writes(lt->tc,
+						   LEICAEFI_REG_LED_CTRL1),
+			2U);
+}
+
+/* Two leds of an icon blinking the same way alternate. */
+static void leicaefi_leds_test_inverted_pair(struct kunit *test)
+{
+	struct leicaefi_leds_test *lt = leicaefi_leds_test_create(test);
+	u16 red = LEICAEFI_LED_VALUE_DIMMED
+		  << lt->efidev->leds[0].desc->efi_reg_offset;
+	u16 green = LEICAEFI_LED_VALUE_DIMMED
+		    << lt->efidev->leds[1].desc->efi_reg_offset;
+
+	leicaefi_leds_test_blink(&lt->efidev->leds[0], 2, 2, 0);
+	leicaefi_leds_test_blink(&lt->efidev->leds[1], 2, 2, 0);
+
+	KUNIT_EXPECT_EQ(test, leicaefi_leds_test_update(lt, 0), 2UL);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(lt->tc, LEICAEFI_REG_LED_CTRL1),
+			red);
+
+	KUNIT_EXPECT_EQ(test, leicaefi_leds_test_update(lt, 2), 4UL);
+	KUNIT_EXPECT_EQ(test, leicaefi_test_reg(lt->tc, LEICAEFI_REG_LED_CTRL1),
+			green);
+}
+
+/* With hw_blink_delay_ms at its default the firmware mode is not used. */
+static void leicaefi_leds_test_no_hw_blink(struct kunit *test)
+{
+	struct leicaefi_leds_test *lt = leicaefi_leds_test_create(test);
+	unsigned long step = 0;
+
+	leicaefi_leds_test_blink(&lt->efidev->leds[0], 1, 1, 0);
+
+	for (step = 0; step < 4; ++step) {
+		u16 value = 0;
+
+		leicaefi_leds_test_update(lt, step);
+		value = leicaefi_test_reg(lt->tc, LEICAEFI_REG_LED_CTRL1) &
+			LEICAEFI_LED_VALUE_BIT_MASK;
+
+		KUNIT_EXPECT_NE(test, value,
+				(u16)LEICAEFI_LED_VALUE_DIMMED_BLINKING);
+		KUNIT_EXPECT_EQ(test, value,
+				(u16)((step & 1) ? LEICAEFI_LED_VALUE_OFF :
+						   LEICAEFI_LED_VALUE_DIMMED));
+	}
+}
+
+static void leicaefi_leds_test_bench_update(struct kunit *test)
+{
+	struct leicaefi_leds_test *lt = leicaefi_leds_test_create(test);
+	unsigned long step = 0;
+	size_t i = 0;
+
+	for (i = 0; i < LEICAEFI_LEDS_TEST_COUNT; i++) {
+		leicaefi_leds_test_blink(&lt->efidev->leds[i], 1 + i % 3,
+					 1 + i % 5, 0);
+	}
+
+	LEICAEFI_TEST_BENCH(test, "leds update (all blinking)", 10000, {
+		step = leicaefi_leds_test_update(lt, step);
+	});
+}
+
+static void leicaefi_leds_test_bench_blink_state(struct kunit *test)
+{
+	struct leicaefi_led led = {};
+	unsigned long steps_left = 0;
+	unsigned long step = 0;
+
+	leicaefi_leds_test_blink(&led, 3, 7, 0);
+
+	LEICAEFI_TEST_BENCH(test, "led blink state", 100000, {
+		leicaefi_led_blink_state(&led, step++, &steps_left);
+	});
+}
+
+static struct kunit_case leicaefi_leds_test_cases[] = {
+	KUNIT_CASE(leicaefi_leds_test_blink_state),
+	KUNIT_CASE(leicaefi_leds_test_update_register),
+	KUNIT_CASE(leicaefi_leds_test_inverted_pair),
+	KUNIT_CASE(leicaefi_leds_test_no_hw_blink),
+	KUNIT_CASE_SLOW(leicaefi_leds_test_bench_update),
+	KUNIT_CASE_SLOW(leicaefi_leds_test_bench_blink_state),
+	{}
+};
+
+struct kunit_suite leicaefi_leds_test_suite = {
+	.name = "leicaefi-leds",
+	.test_cases = leicaefi_leds_test_cases,
+};
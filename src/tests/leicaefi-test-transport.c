@@ -0,0 +1,122 @@
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/spinlock.h>
+#include <kunit/test.h>
+#include <kunit/device.h>
+
+#include <leicaefi-defs.h>
+
+#include "leicaefi-test.h"
+
+static bool leicaefi_test_is_sc_reg(u8 reg_no)
+{
+	switch (reg_no) {
+	case LEICAEFI_REG_MOD_IE:
+	case LEICAEFI_REG_PWR_SETTINGS:
+	case LEICAEFI_REG_LED_CTRL1:
+	case LEICAEFI_REG_LED_CTRL2:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int leicaefi_test_write_word(void *context, u8 cmd, u16 value)
+{
+	struct leicaefi_test_transport *tt = context;
+	u8 reg_no = cmd & LEICAEFI_REGNO_MASK;
+	int rc = 0;
+
+	spin_lock(&tt->lock);
+
+	rc = tt->fail_rc;
+	if (rc == 0) {
+		++tt->writes[reg_no];
+
+		if ((cmd & LEICAEFI_SCBIT_MASK) == LEICAEFI_SCBIT_SET) {
+			tt->regs[reg_no] |= value;
+		} else if (leicaefi_test_is_sc_reg(reg_no)) {
+			tt->regs[reg_no] &= ~value;
+		} else {
+			tt->regs[reg_no] = value;
+		}
+	}
+
+	spin_unlock(&tt->lock);
+
+	return rc;
+}
+
+static int leicaefi_test_read_word(void *context, u8 cmd, u16 *value)
+{
+	struct leicaefi_test_transport *tt = context;
+	u8 reg_no = cmd & LEICAEFI_REGNO_MASK;
+	int rc = 0;
+
+	spin_lock(&tt->lock);
+
+	rc = tt->fail_rc;
+	if (rc == 0) {
+		++tt->reads[reg_no];
+		*value = tt->regs[reg_no];
+	}
+
+	spin_unlock(&tt->lock);
+
+	return rc;
+}
+
+const struct leicaefi_transport_ops leicaefi_test_transport_ops = {
+	.write_word = leicaefi_test_write_word,
+	.read_word = leicaefi_test_read_word,
+};
+
+struct leicaefi_test_chip *leicaefi_test_chip_create(struct kunit *test)
+{
+	struct leicaefi_test_chip *tc = NULL;
+	int rc = 0;
+
+	tc = kunit_kzalloc(test, sizeof(*tc), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, tc);
+
+	spin_lock_init(&tc->transport.lock);
+
+	tc->dev = kunit_device_register(test, "leicaefi-test");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, tc->dev);
+
+	rc = devm_leicaefi_add_chip(tc->dev, &leicaefi_test_transport_ops,
+				    &tc->transport, &tc->efichip);
+	KUNIT_ASSERT_EQ(test, rc, 0);
+
+	return tc;
+}
+
+u16 leicaefi_test_reg(struct leicaefi_test_chip *tc, u8 reg_no)
+{
+	u16 value = 0;
+
+	spin_lock(&tc->transport.lock);
+	value = tc->transport.regs[reg_no];
+	spin_unlock(&tc->transport.lock);
+
+	return value;
+}
+
+void leicaefi_test_set_reg(struct leicaefi_test_chip *tc, u8 reg_no,
+			   u16 value)
+{
+	spin_lock(&tc->transport.lock);
+	tc->transport.regs[reg_no] = value;
+	spin_unlock(&tc->transport.lock);
+}
+
+unsigned int leicaefi_test_writes(struct leicaefi_test_chip *tc, u8 reg_no)
+{
+	unsigned int count = 0;
+
+	spin_lock(&tc->transport.lock);
+	count = tc->transport.writes[reg_no];
+	spin_unlock(&tc->transport.lock);
+
+	return count;
+}
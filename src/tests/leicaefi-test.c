@@ -0,0 +1,28 @@
+#include <linux/module.h>
+#include <linux/version.h>
+#include <kunit/test.h>
+
+#include "leicaefi-test.h"
+
+/*
+ * Unit tests of the driver logic. The chip is accessed through a fake
+ * transport, so no hardware (nor the emulator) is needed:
+ *   modprobe leicaefi-test
+ * Results are reported in the kernel log (KTAP), the benchmark cases print
+ * the time per operation.
+ */
+
+kunit_test_suites(&leicaefi_irq_test_suite, &leicaefi_gencmd_test_suite,
+		  &leicaefi_leds_test_suite, &leicaefi_battery_test_suite);
+
+// Module information
+MODULE_DESCRIPTION("Leica EFI driver unit tests");
+MODULE_AUTHOR(
+	"Krzysztof Kapuscik <krzysztof.kapuscik-ext@leica-geosystems.com>");
+MODULE_VERSION("0.1");
+MODULE_LICENSE("GPL v2");
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+#else
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+#endif
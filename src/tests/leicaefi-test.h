@@ -0,0 +1,69 @@
+#ifndef _LINUX_LEICAEFI_TEST_H
+#define _LINUX_LEICAEFI_TEST_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <kunit/test.h>
+
+#include <core/leicaefi-chip-internal.h>
+#include <core/leicaefi-transport.h>
+#include <leicaefi-defs.h>
+
+#define LEICAEFI_TEST_REG_COUNT (LEICAEFI_REGNO_MASK + 1)
+
+/*
+ * Register file behind the fake transport. Set/clear registers are changed
+ * by the SC bit of the command as on the chip, the other registers keep the
+ * value written. Counters are per register number.
+ */
+struct leicaefi_test_transport {
+	spinlock_t lock;
+	u16 regs[LEICAEFI_TEST_REG_COUNT];
+	unsigned int writes[LEICAEFI_TEST_REG_COUNT];
+	unsigned int reads[LEICAEFI_TEST_REG_COUNT];
+	/* returned by all accesses if not 0 */
+	int fail_rc;
+};
+
+extern const struct leicaefi_transport_ops leicaefi_test_transport_ops;
+
+/* Chip added on a KUnit managed device, released with the test. */
+struct leicaefi_test_chip {
+	struct device *dev;
+	struct leicaefi_test_transport transport;
+	struct leicaefi_chip *efichip;
+};
+
+struct leicaefi_test_chip *leicaefi_test_chip_create(struct kunit *test);
+
+u16 leicaefi_test_reg(struct leicaefi_test_chip *tc, u8 reg_no);
+
+void leicaefi_test_set_reg(struct leicaefi_test_chip *tc, u8 reg_no,
+			   u16 value);
+
+unsigned int leicaefi_test_writes(struct leicaefi_test_chip *tc, u8 reg_no);
+
+/* Runs the statement 'iterations' times and reports the time per run. */
+#define LEICAEFI_TEST_BENCH(test, name, iterations, stmt)                      \
+	do {                                                                   \
+		unsigned int __i = 0;                                          \
+		ktime_t __start = ktime_get();                                 \
+		s64 __ns = 0;                                                  \
+                                                                               \
+		for (__i = 0; __i < (iterations); ++__i) {                     \
+			stmt;                                                  \
+		}                                                              \
+                                                                               \
+		__ns = ktime_to_ns(ktime_sub(ktime_get(), __start));           \
+		kunit_info(test, "%s: %lld ns/op\n", name,                     \
+			   div_s64(__ns, iterations));                         \
+	} while (0)
+
+extern struct kunit_suite leicaefi_irq_test_suite;
+extern struct kunit_suite leicaefi_gencmd_test_suite;
+extern struct kunit_suite leicaefi_leds_test_suite;
+extern struct kunit_suite leicaefi_battery_test_suite;
+
+#endif /*_LINUX_LEICAEFI_TEST_H*/
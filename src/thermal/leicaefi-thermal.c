@@ -0,0 +1,275 @@
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
+#include <linux/thermal.h>
+#include <linux/version.h>
+
+#include <leicaefi.h>
+#include <common/leicaefi-chip.h>
+#include <common/leicaefi-device.h>
+#include <common/leicaefi-adc.h>
+
+static unsigned int polling_delay_ms = 1000;
+module_param(polling_delay_ms, uint, 0444);
+MODULE_PARM_DESC(
+	polling_delay_ms,
+	"Polling delay in ms of the zone registered without device tree (before 6.7, later the zone has no trips and is not polled)");
+
+/* Readings are reused for this time, until the DEV interrupt. */
+static const unsigned int LEICAEFI_THERMAL_CACHE_MS = 250;
+
+struct leicaefi_thermal_device {
+	struct platform_device *pdev;
+	struct leicaefi_chip *efichip;
+
+	struct thermal_zone_device *tz;
+
+	/* protects the cached reading */
+	struct mutex lock;
+	bool valid;
+	unsigned long timestamp;
+	int temp;
+};
+
+static int leicaefi_thermal_read(struct leicaefi_thermal_device *efidev,
+				 int *temp)
+{
+	u16 reg_value = 0;
+	int rv = 0;
+
+	mutex_lock(&efidev->lock);
+
+	if (efidev->valid &&
+	    time_before(jiffies,
+			efidev->timestamp +
+				msecs_to_jiffies(LEICAEFI_THERMAL_CACHE_MS))) {
+		*temp = efidev->temp;
+		mutex_unlock(&efidev->lock);
+		return 0;
+	}
+
+	rv = leicaefi_chip_read(efidev->efichip, LEICAEFI_REG_TEMP_DATA,
+				&reg_value);
+	if (rv == 0) {
+		efidev->temp = leicaefi_adc_to_millicelsius(reg_value);
+		efidev->timestamp = jiffies;
+		efidev->valid = true;
+		*temp = efidev->temp;
+	}
+
+	mutex_unlock(&efidev->lock);
+
+	if (rv == 0) {
+		dev_dbg(&efidev->pdev->dev, "%s value=%d\n", __func__, *temp);
+	} else {
+		dev_dbg(&efidev->pdev->dev, "%s failed: %d\n", __func__, rv);
+	}
+
+	return rv;
+}
+
+static int leicaefi_thermal_get_temp(struct thermal_zone_device *tz,
+				     int *temp)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	return leicaefi_thermal_read(thermal_zone_device_priv(tz), temp);
+#else
+	return leicaefi_thermal_read(tz->devdata, temp);
+#endif
+}
+
+/* the ops are const since the registration API rework in 6.7 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+static const struct thermal_zone_device_ops leicaefi_thermal_ops = {
+#else
+static struct thermal_zone_device_ops leicaefi_thermal_ops = {
+#endif
+	.get_temp = leicaefi_thermal_get_temp,
+};
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+static int leicaefi_thermal_of_get_temp(void *data, int *temp)
+{
+	return leicaefi_thermal_read(data, temp);
+}
+
+static const struct thermal_zone_of_device_ops leicaefi_thermal_of_ops = {
+	.get_temp = leicaefi_thermal_of_get_temp,
+};
+#endif
+
+/* Zone described in the device tree, with its trip points and delays. */
+static struct thermal_zone_device *
+leicaefi_thermal_register_of_zone(struct leicaefi_thermal_device *efidev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	return devm_thermal_of_zone_register(&efidev->pdev->dev, 0, efidev,
+					     &leicaefi_thermal_ops);
+#else
+	return devm_thermal_zone_of_sensor_register(
+		&efidev->pdev->dev, 0, efidev, &leicaefi_thermal_of_ops);
+#endif
+}
+
+static irqreturn_t leicaefi_thermal_irq_handler(int irq, void *data)
+{
+	struct leicaefi_thermal_device *efidev = data;
+
+	dev_dbg(&efidev->pdev->dev, "%s\n", __func__);
+
+	/* the reported state may have changed, do not use cached value */
+	mutex_lock(&efidev->lock);
+	efidev->valid = false;
+	mutex_unlock(&efidev->lock);
+
+	thermal_zone_device_update(efidev->tz, THERMAL_EVENT_UNSPECIFIED);
+
+	return IRQ_HANDLED;
+}
+
+static void leicaefi_thermal_unregister(void *data)
+{
+	thermal_zone_device_unregister(data);
+}
+
+/* Zone without trip points for boards without a device tree zone. */
+static int
+leicaefi_thermal_register_zone(struct leicaefi_thermal_device *efidev)
+{
+	struct thermal_zone_device *tz = NULL;
+	int rv = 0;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+	tz = thermal_tripless_zone_device_register("leicaefi", efidev,
+						   &leicaefi_thermal_ops, NULL);
+#else
+	tz = thermal_zone_device_register("leicaefi", 0, 0, efidev,
+					  &leicaefi_thermal_ops, NULL, 0,
+					  polling_delay_ms);
+#endif
+	if (IS_ERR(tz)) {
+		return PTR_ERR(tz);
+	}
+
+	rv = devm_add_action_or_reset(&efidev->pdev->dev,
+				      leicaefi_thermal_unregister, tz);
+	if (rv != 0) {
+		return rv;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+	rv = thermal_zone_device_enable(tz);
+	if (rv != 0) {
+		return rv;
+	}
+#endif
+
+	efidev->tz = tz;
+
+	return 0;
+}
+
+static int leicaefi_thermal_probe(struct platform_device *pdev)
+{
+	struct leicaefi_thermal_device *efidev = NULL;
+	struct leicaefi_platform_data *pdata = NULL;
+	int irq = 0;
+	int rv = 0;
+
+	dev_dbg(&pdev->dev, "%s\n", __func__);
+
+	efidev = devm_kzalloc(&pdev->dev, sizeof(*efidev), GFP_KERNEL);
+	if (efidev == NULL) {
+		dev_err(&pdev->dev, "Cannot allocate memory for device\n");
+		return -ENOMEM;
+	}
+
+	platform_set_drvdata(pdev, efidev);
+	efidev->pdev = pdev;
+	mutex_init(&efidev->lock);
+
+	pdata = pdev->dev.platform_data;
+	if (!pdata) {
+		dev_err(&efidev->pdev->dev, "Platform data not available.\n");
+		return -ENODEV;
+	}
+
+	efidev->efichip = pdata->efichip;
+	if (!efidev->efichip) {
+		dev_err(&efidev->pdev->dev, "Chip not available.\n");
+		return -ENODEV;
+	}
+
+	/* trip points and polling delays come from the device tree zone */
+	efidev->tz = leicaefi_thermal_register_of_zone(efidev);
+	if (IS_ERR(efidev->tz)) {
+		dev_info(&efidev->pdev->dev,
+			 "No device tree thermal zone (%ld), registering own\n",
+			 PTR_ERR(efidev->tz));
+
+		rv = leicaefi_thermal_register_zone(efidev);
+		if (rv != 0) {
+			dev_err(&efidev->pdev->dev,
+				"Cannot register thermal zone (error: %d).\n",
+				rv);
+			return rv;
+		}
+	}
+
+	irq = platform_get_irq_byname(pdev, "LEICAEFI_DEV");
+	if (irq < 0) {
+		dev_err(&efidev->pdev->dev,
+			"failed: cannot find irq (error :%d)\n", irq);
+		return -EINVAL;
+	}
+
+	rv = devm_request_threaded_irq(&efidev->pdev->dev, irq, NULL,
+				       leicaefi_thermal_irq_handler,
+				       IRQF_ONESHOT | IRQF_SHARED, NULL,
+				       efidev);
+	if (rv < 0) {
+		dev_err(&efidev->pdev->dev,
+			"failed: irq request (IRQ: %d, error :%d)\n", irq, rv);
+		return rv;
+	}
+
+	return 0;
+}
+
+static int leicaefi_thermal_remove(struct platform_device *pdev)
+{
+	dev_dbg(&pdev->dev, "%s\n", __func__);
+
+	// resources allocated using devm are freed automatically
+
+	return 0;
+}
+
+static const struct of_device_id leicaefi_thermal_of_id_table[] = {
+	{
+		.compatible = "leica,efi-thermal",
+	},
+	{},
+};
+MODULE_DEVICE_TABLE(of, leicaefi_thermal_of_id_table);
+
+static struct platform_driver leicaefi_thermal_driver = {
+	.driver =
+		{
+			.name = "leica-efi-thermal",
+			.of_match_table = leicaefi_thermal_of_id_table,
+		},
+	.probe = leicaefi_thermal_probe,
+	.remove = leicaefi_thermal_remove,
+};
+
+module_platform_driver(leicaefi_thermal_driver);
+
+// Module information
+MODULE_DESCRIPTION("Leica EFI thermal sensor driver");
+MODULE_AUTHOR(
+	"Krzysztof Kapuscik <krzysztof.kapuscik-ext@leica-geosystems.com>");
+MODULE_VERSION("0.1");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,194 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM leicaefi
+
+#if !defined(_TRACE_LEICAEFI_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LEICAEFI_H
+
+#include <linux/ktime.h>
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+
+#ifndef LEICAEFI_TRACE_ASSIGN_STR
+/* the source argument was dropped in 6.10, it is taken from __string() */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#define LEICAEFI_TRACE_ASSIGN_STR(dst, src) __assign_str(dst)
+#else
+#define LEICAEFI_TRACE_ASSIGN_STR(dst, src) __assign_str(dst, src)
+#endif
+#endif
+
+/* Register access, duration is measured from 'start' to the event. */
+DECLARE_EVENT_CLASS(leicaefi_reg,
+
+	TP_PROTO(u8 reg, u16 value, int rc, ktime_t start),
+
+	TP_ARGS(reg, value, rc, start),
+
+	TP_STRUCT__entry(
+		__field(u8, reg)
+		__field(u16, value)
+		__field(int, rc)
+		__field(s64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__entry->reg = reg;
+		__entry->value = value;
+		__entry->rc = rc;
+		__entry->duration_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	),
+
+	TP_printk("reg=0x%02x value=0x%04x rc=%d duration_ns=%lld",
+		  __entry->reg, __entry->value, __entry->rc,
+		  __entry->duration_ns)
+);
+
+DEFINE_EVENT(leicaefi_reg, leicaefi_reg_read,
+	TP_PROTO(u8 reg, u16 value, int rc, ktime_t start),
+	TP_ARGS(reg, value, rc, start)
+);
+
+DEFINE_EVENT(leicaefi_reg, leicaefi_reg_write,
+	TP_PROTO(u8 reg, u16 value, int rc, ktime_t start),
+	TP_ARGS(reg, value, rc, start)
+);
+
+DEFINE_EVENT(leicaefi_reg, leicaefi_reg_set_bits,
+	TP_PROTO(u8 reg, u16 value, int rc, ktime_t start),
+	TP_ARGS(reg, value, rc, start)
+);
+
+DEFINE_EVENT(leicaefi_reg, leicaefi_reg_clear_bits,
+	TP_PROTO(u8 reg, u16 value, int rc, ktime_t start),
+	TP_ARGS(reg, value, rc, start)
+);
+
+DEFINE_EVENT(leicaefi_reg, leicaefi_reg_update_bits,
+	TP_PROTO(u8 reg, u16 value, int rc, ktime_t start),
+	TP_ARGS(reg, value, rc, start)
+);
+
+TRACE_EVENT(leicaefi_gencmd_submit,
+
+	TP_PROTO(u16 cmd, u16 input_data, bool coalesced),
+
+	TP_ARGS(cmd, input_data, coalesced),
+
+	TP_STRUCT__entry(
+		__field(u16, cmd)
+		__field(u16, input_data)
+		__field(bool, coalesced)
+	),
+
+	TP_fast_assign(
+		__entry->cmd = cmd;
+		__entry->input_data = input_data;
+		__entry->coalesced = coalesced;
+	),
+
+	TP_printk("cmd=0x%04x input=0x%04x coalesced=%d", __entry->cmd,
+		  __entry->input_data, __entry->coalesced)
+);
+
+/* Command finished, duration is measured from the submission. */
+DECLARE_EVENT_CLASS(leicaefi_gencmd_done,
+
+	TP_PROTO(u16 cmd, u16 output_data, int result, ktime_t submit_time),
+
+	TP_ARGS(cmd, output_data, result, submit_time),
+
+	TP_STRUCT__entry(
+		__field(u16, cmd)
+		__field(u16, output_data)
+		__field(int, result)
+		__field(s64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__entry->cmd = cmd;
+		__entry->output_data = output_data;
+		__entry->result = result;
+		__entry->duration_ns =
+			ktime_to_ns(ktime_sub(ktime_get(), submit_time));
+	),
+
+	TP_printk("cmd=0x%04x output=0x%04x result=%d duration_ns=%lld",
+		  __entry->cmd, __entry->output_data, __entry->result,
+		  __entry->duration_ns)
+);
+
+DEFINE_EVENT(leicaefi_gencmd_done, leicaefi_gencmd_complete,
+	TP_PROTO(u16 cmd, u16 output_data, int result, ktime_t submit_time),
+	TP_ARGS(cmd, output_data, result, submit_time)
+);
+
+DEFINE_EVENT(leicaefi_gencmd_done, leicaefi_gencmd_fail,
+	TP_PROTO(u16 cmd, u16 output_data, int result, ktime_t submit_time),
+	TP_ARGS(cmd, output_data, result, submit_time)
+);
+
+TRACE_EVENT(leicaefi_irq_dispatch,
+
+	TP_PROTO(u16 ifg, u16 err, int rc),
+
+	TP_ARGS(ifg, err, rc),
+
+	TP_STRUCT__entry(
+		__field(u16, ifg)
+		__field(u16, err)
+		__field(int, rc)
+	),
+
+	TP_fast_assign(
+		__entry->ifg = ifg;
+		__entry->err = err;
+		__entry->rc = rc;
+	),
+
+	TP_printk("ifg=0x%04x err=0x%04x rc=%d", __entry->ifg, __entry->err,
+		  __entry->rc)
+);
+
+TRACE_EVENT(leicaefi_flash_start,
+
+	TP_PROTO(const char *op),
+
+	TP_ARGS(op),
+
+	TP_STRUCT__entry(
+		__string(op, op)
+	),
+
+	TP_fast_assign(
+		LEICAEFI_TRACE_ASSIGN_STR(op, op);
+	),
+
+	TP_printk("op=%s", __get_str(op))
+);
+
+TRACE_EVENT(leicaefi_flash_finish,
+
+	TP_PROTO(const char *op, int rc, ktime_t start),
+
+	TP_ARGS(op, rc, start),
+
+	TP_STRUCT__entry(
+		__string(op, op)
+		__field(int, rc)
+		__field(s64, duration_ns)
+	),
+
+	TP_fast_assign(
+		LEICAEFI_TRACE_ASSIGN_STR(op, op);
+		__entry->rc = rc;
+		__entry->duration_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	),
+
+	TP_printk("op=%s rc=%d duration_ns=%lld", __get_str(op), __entry->rc,
+		  __entry->duration_ns)
+);
+
+#endif /* _TRACE_LEICAEFI_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>